@@ -74,7 +74,7 @@ void DynamicLightManager::contribute(uint32_t frameNo, vec3 position, vec3 *colo
 	const float DLIGHT_AT_RADIUS = 16; // at the edge of a dlight's influence, this amount of light will be added
 	const float DLIGHT_MINIMUM_RADIUS = 16; // never calculate a range less than this to prevent huge light numbers
 
-	for (uint8_t i = 0; i < nLights_; i++)
+	for (uint16_t i = 0; i < nLights_; i++)
 	{
 		const DynamicLight &dl = lights_[frameNo % BGFX_NUM_BUFFER_FRAMES][i];
 		vec3 dir = dl.position_type.xyz() - position;
@@ -88,24 +88,15 @@ void DynamicLightManager::contribute(uint32_t frameNo, vec3 position, vec3 *colo
 
 void DynamicLightManager::initializeGrid()
 {
-	const int minCellSize = 200;
-	const uint8_t maxGridSize = 32;
-	const vec3 worldSize = world::GetBounds().toSize();
-
-	for (size_t i = 0; i < 3; i++)
-	{
-		cellSize_[i] = std::max(minCellSize, (int)std::ceil(worldSize[i] / maxGridSize));
-		gridSize_[i] = std::min(maxGridSize, (uint8_t)std::ceil(worldSize[i] / cellSize_[i]));
-		cellSize_[i] = int(worldSize[i] / gridSize_[i]);
-	}
-
-	interface::Printf("dlight grid size is %ux%ux%u\n", gridSize_.x, gridSize_.y, gridSize_.z);
-	gridOffset_ = vec3::empty - world::GetBounds().min;
+	// x and y are screen space tiles, z is exponential depth slices.
+	gridSize_ = vec3i(16, 8, 24);
+	interface::Printf("dlight froxel grid size is %dx%dx%d\n", gridSize_.x, gridSize_.y, gridSize_.z);
+	froxels_.resize(gridSize_.x * gridSize_.y * gridSize_.z);
 
 	// Cells texture.
-	cellsTextureSize_ = util::CalculateSmallestPowerOfTwoTextureSize((int)gridSize_.x * (int)gridSize_.y * (int)gridSize_.z);
+	cellsTextureSize_ = util::CalculateSmallestPowerOfTwoTextureSize(gridSize_.x * gridSize_.y * gridSize_.z);
 	interface::Printf("dlight cells texture size is %ux%u\n", cellsTextureSize_, cellsTextureSize_);
-	cellsTexture_ = bgfx::createTexture2D(cellsTextureSize_, cellsTextureSize_, false, 1, bgfx::TextureFormat::R16U, BGFX_TEXTURE_U_CLAMP | BGFX_TEXTURE_V_CLAMP | BGFX_TEXTURE_MIN_POINT | BGFX_TEXTURE_MAG_POINT);
+	cellsTexture_ = bgfx::createTexture2D(cellsTextureSize_, cellsTextureSize_, false, 1, bgfx::TextureFormat::R32U, BGFX_TEXTURE_U_CLAMP | BGFX_TEXTURE_V_CLAMP | BGFX_TEXTURE_MIN_POINT | BGFX_TEXTURE_MAG_POINT);
 
 	for (int i = 0; i < BGFX_NUM_BUFFER_FRAMES; i++)
 	{
@@ -113,160 +104,228 @@ void DynamicLightManager::initializeGrid()
 	}
 
 	// Indices textures.
-	indicesTextureSize_ = 512;
+	indicesTextureSize_ = 1024;
 	interface::Printf("dlight indices texture size is %ux%u\n", indicesTextureSize_, indicesTextureSize_);
-	indicesTexture_ = bgfx::createTexture2D(indicesTextureSize_, indicesTextureSize_, false, 1, bgfx::TextureFormat::R8U, BGFX_TEXTURE_U_CLAMP | BGFX_TEXTURE_V_CLAMP | BGFX_TEXTURE_MIN_POINT | BGFX_TEXTURE_MAG_POINT);
+	indicesTexture_ = bgfx::createTexture2D(indicesTextureSize_, indicesTextureSize_, false, 1, bgfx::TextureFormat::R16U, BGFX_TEXTURE_U_CLAMP | BGFX_TEXTURE_V_CLAMP | BGFX_TEXTURE_MIN_POINT | BGFX_TEXTURE_MAG_POINT);
 
 	for (int i = 0; i < BGFX_NUM_BUFFER_FRAMES; i++)
 	{
 		indicesTextureData_[i].resize(indicesTextureSize_ * indicesTextureSize_);
 	}
 
-	assignedLights_.reserve(512); // Arbitrary initial size.
+	cellCounts_.resize(froxels_.size());
+	sliceLightGroups_.resize(gridSize_.z * nLightGroupMaskWords);
+}
+
+bool DynamicLightManager::isTouchingBounds(const Bounds &bounds) const
+{
+	for (uint16_t i = 0; i < nCulledLights_; i++)
+	{
+		if (!Bounds::intersect(lightBounds_[i], bounds))
+			continue;
+
+		// Capsules only use the AABB test.
+		if (lightCullData_.inverseLengthSquared[i] > 0)
+			return true;
+
+		// Point lights: distance from the sphere center to the closest point in the bounds.
+		const vec3 center(lightCullData_.startX[i], lightCullData_.startY[i], lightCullData_.startZ[i]);
+		vec3 closest;
+
+		for (int j = 0; j < 3; j++)
+			closest[j] = math::Clamped(center[j], bounds.min[j], bounds.max[j]);
+
+		if (vec3::distance(center, closest) <= lightCullData_.radius[i])
+			return true;
+	}
+
+	return false;
 }
 
-void DynamicLightManager::updateTextures(uint32_t frameNo)
+void DynamicLightManager::updateTextures(uint32_t frameNo, vec3 cameraPosition, const mat3 &cameraRotation, vec2 fov)
 {
 	assert(world::IsLoaded());
 	PROFILE_SCOPED(DynamicLightManager::updateTextures)
 	const uint32_t buffer = frameNo % BGFX_NUM_BUFFER_FRAMES;
 
-	// Assign lights to cells.
-	PROFILE_BEGIN(AssignLights)
-	assignedLights_.clear();
-	const float cellRadius = vec3::distance(vec3::empty, vec3((float)cellSize_.x, (float)cellSize_.y, (float)cellSize_.z)) / 2.0f;
+	// Build the froxel grid from the scene camera.
+	// Depth range matches the world camera projection.
+	PROFILE_BEGIN(BuildGrid)
+	froxelPosition_ = cameraPosition;
+	froxelRotation_ = cameraRotation;
+	froxelTanHalfFov_ = vec2(tanf(DEG2RAD(fov.x) * 0.5f), tanf(DEG2RAD(fov.y) * 0.5f));
+	zNear_ = 4;
+	zFar_ = std::max(zNear_ * 2, world::GetBounds().calculateFarthestCornerDistance(cameraPosition));
+	sliceScale_ = gridSize_.z / logf(zFar_ / zNear_);
+
+	// Bounding sphere for each froxel.
+	g_jobSystem->parallelFor(gridSize_.z, 1, [this](size_t begin, size_t end)
+	{
+		for (int z = (int)begin; z < (int)end; z++)
+		{
+			for (int y = 0; y < gridSize_.y; y++)
+			{
+				for (int x = 0; x < gridSize_.x; x++)
+				{
+					std::array<vec3, 8> corners;
+
+					for (int i = 0; i < 8; i++)
+						corners[i] = worldspacePositionFromFroxelCorner(x + (i & 1), y + ((i >> 1) & 1), z + ((i >> 2) & 1));
+
+					Froxel &froxel = froxels_[cellIndexFromCellPosition(vec3i(x, y, z))];
+					froxel.center = vec3::empty;
 
-	for (uint8_t i = 0; i < nLights_; i++)
+					for (const vec3 &corner : corners)
+						froxel.center += corner;
+
+					froxel.center = froxel.center / 8.0f;
+					froxel.radius = 0;
+
+					for (const vec3 &corner : corners)
+						froxel.radius = std::max(froxel.radius, vec3::distance(froxel.center, corner));
+				}
+			}
+		}
+	});
+	PROFILE_END // BuildGrid
+
+	// Convert the lights to SoA and find the depth slices each one may touch.
+	PROFILE_BEGIN(PrepareLights)
+	std::fill(sliceLightGroups_.begin(), sliceLightGroups_.end(), 0);
+	const size_t nGroups = (nLights_ + 3) / 4;
+
+	for (size_t i = 0; i < nGroups * 4; i++)
 	{
+		if (i >= nLights_)
+		{
+			// Padding. Far enough away that the distance squared is infinite.
+			lightCullData_.startX[i] = lightCullData_.startY[i] = lightCullData_.startZ[i] = FLT_MAX;
+			lightCullData_.dirX[i] = lightCullData_.dirY[i] = lightCullData_.dirZ[i] = 0;
+			lightCullData_.inverseLengthSquared[i] = 0;
+			lightCullData_.radius[i] = 0;
+			continue;
+		}
+
 		const DynamicLight &dl = lights_[buffer][i];
-		vec3b min(gridSize_.x, gridSize_.y, gridSize_.z);
-		vec3b max;
+		const vec3 start = dl.position_type.xyz();
+		const vec3 end = dl.position_type.w == DynamicLight::Capsule ? dl.capsuleEnd.xyz() : start;
+		const vec3 dir = end - start;
+		const float lengthSquared = vec3::dotProduct(dir, dir);
+		lightCullData_.startX[i] = start.x;
+		lightCullData_.startY[i] = start.y;
+		lightCullData_.startZ[i] = start.z;
+		lightCullData_.dirX[i] = dir.x;
+		lightCullData_.dirY[i] = dir.y;
+		lightCullData_.dirZ[i] = dir.z;
+		lightCullData_.inverseLengthSquared[i] = lengthSquared > 0 ? 1.0f / lengthSquared : 0;
+		lightCullData_.radius[i] = dl.color_radius.w;
+		lightBounds_[i] = Bounds::merge(Bounds(start, dl.color_radius.w), Bounds(end, dl.color_radius.w));
 
 		// Coarse culling.
-		// Get the cell positions at the sphere AABB corners.
-		// The min/max will be the range of cells this light touches.
+		// Get the depth slices at the sphere AABB corners.
 		// For capsules, use the start and end positions.
-		for (int j = 0; j < (dl.position_type.w == DynamicLight::Point ? 1 : 2); j++)
-		{
-			Bounds aabb;
+		float minSlice = (float)gridSize_.z, maxSlice = -1;
 
-			if (j == 0)
-			{
-				aabb = Bounds(dl.position_type.xyz(), dl.color_radius.w);
-			}
-			else
-			{
-				assert(dl.position_type.w == DynamicLight::Capsule);
-				aabb = Bounds(dl.capsuleEnd.xyz(), dl.color_radius.w);
-			}
-
-			std::array<vec3, 8> corners = aabb.toVertices();
+		for (int j = 0; j < (start == end ? 1 : 2); j++)
+		{
+			const std::array<vec3, 8> corners = Bounds(j == 0 ? start : end, dl.color_radius.w).toVertices();
 
 			for (const vec3 &corner : corners)
 			{
-				const vec3b cellPosition = cellPositionFromWorldspacePosition(corner);
-
-				for (int k = 0; k < 3; k++)
-				{
-					if (cellPosition[k] < min[k])
-						min[k] = cellPosition[k];
-					if (cellPosition[k] > max[k])
-						max[k] = cellPosition[k];
-				}
+				vec3 froxelPosition;
+				froxelPositionFromWorldspacePosition(corner, &froxelPosition);
+				minSlice = std::min(minSlice, froxelPosition.z);
+				maxSlice = std::max(maxSlice, froxelPosition.z);
 			}
 		}
 
-		for (uint8_t x = min.x; x <= max.x; x++)
+		const int minZ = (int)math::Clamped(std::floor(minSlice), 0.0f, float(gridSize_.z - 1));
+		const int maxZ = (int)math::Clamped(std::floor(maxSlice), 0.0f, float(gridSize_.z - 1));
+		const size_t group = i / 4;
+
+		for (int z = minZ; z <= maxZ; z++)
 		{
-			for (uint8_t y = min.y; y <= max.y; y++)
-			{
-				for (uint8_t z = min.z; z <= max.z; z++)
-				{
-					// Finer grained culling.
-					// Check cells against light radius for point lights.
-					// Capsule lights use radius from the closest point on the capsule light segment.
-					vec3 cellCenter;
-					cellCenter.x = -gridOffset_.x + x * cellSize_.x + cellSize_.x / 2.0f;
-					cellCenter.y = -gridOffset_.y + y * cellSize_.y + cellSize_.y / 2.0f;
-					cellCenter.z = -gridOffset_.z + z * cellSize_.z + cellSize_.z / 2.0f;
-					vec3 comparePosition;
-
-					if (dl.position_type.w == DynamicLight::Point)
-					{
-						comparePosition = dl.position_type.xyz();
-					}
-					else if (dl.position_type.w == DynamicLight::Capsule)
-					{
-						comparePosition = math::ClosestPointOnLineSegment(dl.position_type.xyz(), dl.capsuleEnd.xyz(), cellCenter);
-					}
-
-					if (vec3::distance(cellCenter, comparePosition) > cellRadius + dl.color_radius.w)
-						continue;
-
-					assignedLights_.push_back(encodeAssignedLight(vec3b(x, y, z), i));
-				}
-			}
+			sliceLightGroups_[z * nLightGroupMaskWords + group / 64] |= uint64_t(1) << (group % 64);
 		}
 	}
-	PROFILE_END // AssignLights
-
-	// Sort the assigned lights.
-	std::sort(assignedLights_.begin(), assignedLights_.end());
+	nCulledLights_ = nLights_;
+	PROFILE_END // PrepareLights
 
-	// Fill cells and indices texture data.
+	// Assign lights to cells.
+	// First pass counts the lights in each cell, then a prefix sum gives each cell its offset in the indices texture, then the second pass writes the light indices.
 	// Make sure the first index uses num 0, so all empty cells can use it.
-	memset(cellsTextureData_[buffer].data(), 0, cellsTextureData_[buffer].size() * sizeof(uint16_t));
-	uint16_t indicesOffset = 0;
-	indicesTextureData_[buffer][indicesOffset++] = 0; // Empty cells will point here.
-	size_t currentCellIndex = 0;
-	uint16_t indicesNumLightsOffset = 0;
+	// Always leave room for the list containing every light at the end.
+	PROFILE_BEGIN(AssignLights)
+	const uint32_t nCells = uint32_t(froxels_.size());
+	const uint32_t cellsPerSlice = uint32_t(gridSize_.x * gridSize_.y);
 
-	for (size_t i = 0; i < assignedLights_.size(); i++)
+	g_jobSystem->parallelFor(nCells, cellsPerSlice, [this](size_t begin, size_t end)
 	{
-		vec3b cellPosition;
-		uint8_t lightIndex;
-		decodeAssignedLight(assignedLights_[i], &cellPosition, &lightIndex);
-		const size_t cellIndex = cellIndexFromCellPosition(cellPosition);
+		for (size_t i = begin; i < end; i++)
+			cellCounts_[i] = cullLights((uint32_t)i, nullptr);
+	});
 
-		// First cell, or cell index has changed?
-		if (i == 0 || cellIndex != currentCellIndex)
-		{
-			currentCellIndex = cellIndex;
+	memset(cellsTextureData_[buffer].data(), 0, cellsTextureData_[buffer].size() * sizeof(uint32_t));
+	const uint32_t maxIndices = uint32_t(indicesTextureData_[buffer].size()) - (nLights_ + 1);
+	uint32_t indicesOffset = 0;
+	indicesTextureData_[buffer][indicesOffset++] = 0; // Empty cells will point here.
 
-			// Point the cell to the indices.
-			cellsTextureData_[buffer][cellIndex] = indicesOffset;
+	for (uint32_t i = 0; i < nCells; i++)
+	{
+		if (cellCounts_[i] == 0)
+			continue;
 
-			// Store the offset in the indices texture where we want to write number of lights to.
-			indicesNumLightsOffset = indicesOffset;
+		if (indicesOffset + 1 + cellCounts_[i] > maxIndices)
+		{
+			interface::PrintWarningf("Too many assigned lights.\n");
 
-			// Initialize num lights to 0.
-			indicesTextureData_[buffer][indicesNumLightsOffset] = 0;
-			indicesOffset++;
+			// Leave the remaining cells empty.
+			std::fill(cellCounts_.begin() + i, cellCounts_.end(), 0);
+			break;
 		}
 
-		// Increment num lights.
-		indicesTextureData_[buffer][indicesNumLightsOffset]++;
+		cellsTextureData_[buffer][i] = indicesOffset;
+		indicesOffset += 1 + cellCounts_[i];
+	}
 
-		// Write the light index.
-		indicesTextureData_[buffer][indicesOffset++] = lightIndex;
+	uint16_t *indices = indicesTextureData_[buffer].data();
+	const uint32_t *cellOffsets = cellsTextureData_[buffer].data();
 
-		if (indicesOffset > uint16_t(UINT16_MAX - 2))
+	g_jobSystem->parallelFor(nCells, cellsPerSlice, [this, indices, cellOffsets](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
 		{
-			interface::PrintWarningf("Too many assigned lights.\n");
-			break;
+			if (cellCounts_[i] == 0)
+				continue;
+
+			uint16_t *cellIndices = &indices[cellOffsets[i]];
+			cellIndices[0] = (uint16_t)cellCounts_[i];
+			const uint32_t n = cullLights((uint32_t)i, &cellIndices[1]);
+			assert(n == cellCounts_[i]);
+			BX_UNUSED(n);
 		}
+	});
+	PROFILE_END // AssignLights
+
+	// Positions outside the froxel grid use this.
+	allLightsOffset_ = indicesOffset;
+	indicesTextureData_[buffer][indicesOffset++] = nLights_;
+
+	for (uint16_t i = 0; i < nLights_; i++)
+	{
+		indicesTextureData_[buffer][indicesOffset++] = i;
 	}
 
 	// Update the cells texture.
-	bgfx::updateTexture2D(cellsTexture_, 0, 0, 0, 0, cellsTextureSize_, cellsTextureSize_, bgfx::makeRef(cellsTextureData_[buffer].data(), uint32_t(cellsTextureData_[buffer].size() * sizeof(uint16_t))));
+	bgfx::updateTexture2D(cellsTexture_, 0, 0, 0, 0, cellsTextureSize_, cellsTextureSize_, bgfx::makeRef(cellsTextureData_[buffer].data(), uint32_t(cellsTextureData_[buffer].size() * sizeof(uint32_t))));
 
 	// Update the indices texture.
-	if (nLights_ > 0 && indicesOffset > 0)
+	if (nLights_ > 0)
 	{
-		assert(indicesOffset < indicesTextureSize_ * indicesTextureSize_);
-		const uint16_t width = std::min(indicesOffset, indicesTextureSize_);
-		const uint16_t height = (uint16_t)std::ceil(indicesOffset / (float)indicesTextureSize_);
-		bgfx::updateTexture2D(indicesTexture_, 0, 0, 0, 0, width, height, bgfx::makeRef(indicesTextureData_[buffer].data(), indicesOffset));
+		assert(indicesOffset <= uint32_t(indicesTextureSize_ * indicesTextureSize_));
+		const uint16_t width = (uint16_t)std::min(indicesOffset, (uint32_t)indicesTextureSize_);
+		const uint16_t height = (uint16_t)((indicesOffset + indicesTextureSize_ - 1) / indicesTextureSize_);
+		bgfx::updateTexture2D(indicesTexture_, 0, 0, 0, 0, width, height, bgfx::makeRef(indicesTextureData_[buffer].data(), uint32_t(width * height * sizeof(uint16_t))));
 	}
 
 	// Update the lights texture.
@@ -284,41 +343,117 @@ void DynamicLightManager::updateTextures(uint32_t frameNo)
 void DynamicLightManager::updateUniforms(Uniforms *uniforms)
 {
 	assert(uniforms);
-	uniforms->dynamicLightCellSize.set(vec4((float)cellSize_.x, (float)cellSize_.y, (float)cellSize_.z, (float)cellsTextureSize_));
-	uniforms->dynamicLightGridOffset.set(gridOffset_);
-	uniforms->dynamicLightGridSize.set(vec4((float)gridSize_.x, (float)gridSize_.y, (float)gridSize_.z, 0));
+	uniforms->dynamicLightFroxelPosition.set(vec4(froxelPosition_, zNear_));
+	uniforms->dynamicLightFroxelForward.set(vec4(froxelRotation_[0], sliceScale_));
+	uniforms->dynamicLightFroxelLeft.set(vec4(froxelRotation_[1], 1.0f / froxelTanHalfFov_.x));
+	uniforms->dynamicLightFroxelUp.set(vec4(froxelRotation_[2], 1.0f / froxelTanHalfFov_.y));
+	uniforms->dynamicLightGridSize.set(vec4((float)gridSize_.x, (float)gridSize_.y, (float)gridSize_.z, (float)allLightsOffset_));
 	uniforms->dynamicLight_Num_Intensity.set(vec4((float)nLights_, g_cvars.dynamicLightIntensity.getFloat(), 0, 0));
 	uniforms->dynamicLightTextureSizes_Cells_Indices_Lights.set(vec4((float)cellsTextureSize_, (float)indicesTextureSize_, (float)lightsTextureSize_, 0));
 }
 
-void DynamicLightManager::decodeAssignedLight(uint32_t value, vec3b *cellPosition, uint8_t *lightIndex) const
+uint32_t DynamicLightManager::cullLightGroup(const Froxel &froxel, size_t group) const
 {
-	assert(cellPosition);
-	assert(lightIndex);
-	cellPosition->x = (value >> 24) & 0xff;
-	cellPosition->y = (value >> 16) & 0xff;
-	cellPosition->z = (value >> 8) & 0xff;
-	*lightIndex = value & 0xff;
+	using namespace bx;
+	const size_t i = group * 4;
+	const simd128_t centerX = simd_splat<simd128_t>(froxel.center.x);
+	const simd128_t centerY = simd_splat<simd128_t>(froxel.center.y);
+	const simd128_t centerZ = simd_splat<simd128_t>(froxel.center.z);
+	const simd128_t startX = simd_ld<simd128_t>(&lightCullData_.startX[i]);
+	const simd128_t startY = simd_ld<simd128_t>(&lightCullData_.startY[i]);
+	const simd128_t startZ = simd_ld<simd128_t>(&lightCullData_.startZ[i]);
+	const simd128_t dirX = simd_ld<simd128_t>(&lightCullData_.dirX[i]);
+	const simd128_t dirY = simd_ld<simd128_t>(&lightCullData_.dirY[i]);
+	const simd128_t dirZ = simd_ld<simd128_t>(&lightCullData_.dirZ[i]);
+
+	// Closest point on the light segment to the froxel center.
+	const simd128_t toCenterX = simd_sub(centerX, startX);
+	const simd128_t toCenterY = simd_sub(centerY, startY);
+	const simd128_t toCenterZ = simd_sub(centerZ, startZ);
+	const simd128_t projection = simd_madd(toCenterX, dirX, simd_madd(toCenterY, dirY, simd_mul(toCenterZ, dirZ)));
+	const simd128_t t = simd_clamp(simd_mul(projection, simd_ld<simd128_t>(&lightCullData_.inverseLengthSquared[i])), simd_zero<simd128_t>(), simd_splat<simd128_t>(1.0f));
+
+	// Compare distance squared against the sum of the radii squared.
+	const simd128_t deltaX = simd_nmsub(dirX, t, toCenterX);
+	const simd128_t deltaY = simd_nmsub(dirY, t, toCenterY);
+	const simd128_t deltaZ = simd_nmsub(dirZ, t, toCenterZ);
+	const simd128_t distanceSquared = simd_madd(deltaX, deltaX, simd_madd(deltaY, deltaY, simd_mul(deltaZ, deltaZ)));
+	const simd128_t radius = simd_add(simd_splat<simd128_t>(froxel.radius), simd_ld<simd128_t>(&lightCullData_.radius[i]));
+	const simd128_t touching = simd_cmple(distanceSquared, simd_mul(radius, radius));
+
+	if (!simd_test_any_xyzw(touching))
+		return 0;
+
+	alignas(16) uint32_t lanes[4];
+	simd_st(lanes, touching);
+	return (lanes[0] & 1) | (lanes[1] & 2) | (lanes[2] & 4) | (lanes[3] & 8);
 }
 
-uint32_t DynamicLightManager::encodeAssignedLight(vec3b cellPosition, uint8_t lightIndex) const
+uint32_t DynamicLightManager::cullLights(uint32_t cellIndex, uint16_t *indices) const
 {
-	return (cellPosition.x << 24) + (cellPosition.y << 16) + (cellPosition.z << 8) + lightIndex;
+	const Froxel &froxel = froxels_[cellIndex];
+	const uint64_t *groupMasks = &sliceLightGroups_[(cellIndex / (gridSize_.x * gridSize_.y)) * nLightGroupMaskWords];
+	uint32_t nIndices = 0;
+
+	for (size_t word = 0; word < nLightGroupMaskWords; word++)
+	{
+		uint64_t groupMask = groupMasks[word];
+
+		while (groupMask)
+		{
+			const size_t bit = bx::uint64_cnttz(groupMask);
+			groupMask &= groupMask - 1;
+			const size_t group = word * 64 + bit;
+			uint32_t lightMask = cullLightGroup(froxel, group);
+
+			while (lightMask)
+			{
+				const uint32_t lane = bx::uint32_cnttz(lightMask);
+				lightMask &= lightMask - 1;
+
+				if (indices)
+					indices[nIndices] = uint16_t(group * 4 + lane);
+
+				nIndices++;
+			}
+		}
+	}
+
+	return nIndices;
+}
+
+uint32_t DynamicLightManager::cellIndexFromCellPosition(vec3i position) const
+{
+	return uint32_t(position.x + (position.y * gridSize_.x) + (position.z * gridSize_.x * gridSize_.y));
 }
 
-size_t DynamicLightManager::cellIndexFromCellPosition(vec3b position) const
+bool DynamicLightManager::froxelPositionFromWorldspacePosition(vec3 position, vec3 *froxelPosition) const
 {
-	return position.x + (position.y * (size_t)gridSize_.x) + (position.z * (size_t)gridSize_.x * (size_t)gridSize_.y);
+	assert(froxelPosition);
+	const vec3 dir = position - froxelPosition_;
+	const float depth = vec3::dotProduct(dir, froxelRotation_[0]);
+
+	if (depth < 1.0f)
+	{
+		froxelPosition->x = froxelPosition->y = 0;
+		froxelPosition->z = -1;
+		return false;
+	}
+
+	const float ndcX = vec3::dotProduct(dir, froxelRotation_[1]) / (depth * froxelTanHalfFov_.x);
+	const float ndcY = vec3::dotProduct(dir, froxelRotation_[2]) / (depth * froxelTanHalfFov_.y);
+	froxelPosition->x = (ndcX * 0.5f + 0.5f) * gridSize_.x;
+	froxelPosition->y = (ndcY * 0.5f + 0.5f) * gridSize_.y;
+	froxelPosition->z = logf(std::max(depth, zNear_) / zNear_) * sliceScale_;
+	return true;
 }
 
-vec3b DynamicLightManager::cellPositionFromWorldspacePosition(vec3 position) const
+vec3 DynamicLightManager::worldspacePositionFromFroxelCorner(int x, int y, int z) const
 {
-	const vec3 local = gridOffset_ + position;
-	vec3b cellPosition;
-	cellPosition.x = std::min(uint8_t(std::max(0.0f, local.x / cellSize_.x)), uint8_t(gridSize_.x - 1));
-	cellPosition.y = std::min(uint8_t(std::max(0.0f, local.y / cellSize_.y)), uint8_t(gridSize_.y - 1));
-	cellPosition.z = std::min(uint8_t(std::max(0.0f, local.z / cellSize_.z)), uint8_t(gridSize_.z - 1));
-	return cellPosition;
+	const float depth = zNear_ * expf(z / sliceScale_);
+	const float ndcX = x / (float)gridSize_.x * 2.0f - 1.0f;
+	const float ndcY = y / (float)gridSize_.y * 2.0f - 1.0f;
+	return froxelPosition_ + froxelRotation_[0] * depth + froxelRotation_[1] * (ndcX * depth * froxelTanHalfFov_.x) + froxelRotation_[2] * (ndcY * depth * froxelTanHalfFov_.y);
 }
 
 } // namespace renderer
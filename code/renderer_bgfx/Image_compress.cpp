@@ -0,0 +1,440 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+#include "Precompiled.h"
+#pragma hdrstop
+#include "bimg/bimg.h"
+#include "bx/readerwriter.h"
+
+namespace renderer {
+
+static void ReleaseImageData(void *data, void *userData)
+{
+	free(data);
+}
+
+static uint16_t PackRgb565(const int *c)
+{
+	const int r = math::Clamped(c[0], 0, 255), g = math::Clamped(c[1], 0, 255), b = math::Clamped(c[2], 0, 255);
+	return uint16_t(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+static void UnpackRgb565(uint16_t v, int *c)
+{
+	c[0] = (v >> 11) & 31;
+	c[1] = (v >> 5) & 63;
+	c[2] = v & 31;
+	c[0] = (c[0] << 3) | (c[0] >> 2);
+	c[1] = (c[1] << 2) | (c[1] >> 4);
+	c[2] = (c[2] << 3) | (c[2] >> 2);
+}
+
+/// @brief Calculate the 4 color mode indices for the given endpoints.
+/// @return The sum of squared errors.
+static int EvaluateColorBlock(const uint8_t *block, uint16_t e0, uint16_t e1, uint32_t *indices)
+{
+	int palette[4][3];
+	UnpackRgb565(e0, palette[0]);
+	UnpackRgb565(e1, palette[1]);
+
+	for (int j = 0; j < 3; j++)
+	{
+		palette[2][j] = (2 * palette[0][j] + palette[1][j]) / 3;
+		palette[3][j] = (palette[0][j] + 2 * palette[1][j]) / 3;
+	}
+
+	int totalError = 0;
+	*indices = 0;
+
+	for (int i = 0; i < 16; i++)
+	{
+		const uint8_t *c = &block[i * 4];
+		int bestError = INT32_MAX, bestIndex = 0;
+
+		for (int k = 0; k < 4; k++)
+		{
+			const int dr = c[0] - palette[k][0], dg = c[1] - palette[k][1], db = c[2] - palette[k][2];
+			const int error = dr * dr + dg * dg + db * db;
+
+			if (error < bestError)
+			{
+				bestError = error;
+				bestIndex = k;
+			}
+		}
+
+		*indices |= uint32_t(bestIndex) << (i * 2);
+		totalError += bestError;
+	}
+
+	return totalError;
+}
+
+/// @brief Least squares fit of the endpoints to the colors, keeping the current indices.
+static bool RefitColorEndpoints(const uint8_t *block, uint32_t indices, uint16_t *e0, uint16_t *e1)
+{
+	static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	float aa = 0, bb = 0, ab = 0;
+	float ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+
+	for (int i = 0; i < 16; i++)
+	{
+		const float a = weights[(indices >> (i * 2)) & 3], b = 1.0f - a;
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+
+		for (int j = 0; j < 3; j++)
+		{
+			ax[j] += a * block[i * 4 + j];
+			bx[j] += b * block[i * 4 + j];
+		}
+	}
+
+	const float det = aa * bb - ab * ab;
+
+	if (std::abs(det) < 1e-6f)
+		return false;
+
+	int c0[3], c1[3];
+
+	for (int j = 0; j < 3; j++)
+	{
+		c0[j] = (int)std::round((ax[j] * bb - bx[j] * ab) / det);
+		c1[j] = (int)std::round((bx[j] * aa - ax[j] * ab) / det);
+	}
+
+	*e0 = PackRgb565(c0);
+	*e1 = PackRgb565(c1);
+	return true;
+}
+
+/// @brief Encode the RGB of a block of 16 RGBA8 texels, always using 4 color mode.
+static void EncodeColorBlock(const uint8_t *block, uint8_t *dest)
+{
+	// Start with the bounding box of the colors, choosing the diagonal that follows the channel with the largest range.
+	int mins[3] = { 255, 255, 255 }, maxs[3] = { 0, 0, 0 };
+	float mean[3] = { 0, 0, 0 };
+
+	for (int i = 0; i < 16; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			mins[j] = std::min(mins[j], (int)block[i * 4 + j]);
+			maxs[j] = std::max(maxs[j], (int)block[i * 4 + j]);
+			mean[j] += block[i * 4 + j] / 16.0f;
+		}
+	}
+
+	int axis = 0;
+
+	for (int j = 1; j < 3; j++)
+	{
+		if (maxs[j] - mins[j] > maxs[axis] - mins[axis])
+			axis = j;
+	}
+
+	int c0[3], c1[3];
+
+	for (int j = 0; j < 3; j++)
+	{
+		float covariance = 0;
+
+		for (int i = 0; i < 16; i++)
+		{
+			covariance += (block[i * 4 + axis] - mean[axis]) * (block[i * 4 + j] - mean[j]);
+		}
+
+		// Inset the box slightly, the extremes are rarely the best endpoints.
+		const int inset = (maxs[j] - mins[j]) >> 4;
+		c0[j] = maxs[j] - inset;
+		c1[j] = mins[j] + inset;
+
+		if (covariance < 0)
+			std::swap(c0[j], c1[j]);
+	}
+
+	uint16_t e0 = PackRgb565(c0), e1 = PackRgb565(c1);
+	uint32_t indices;
+	int error = EvaluateColorBlock(block, e0, e1, &indices);
+
+	// One refinement pass.
+	uint16_t refit0, refit1;
+
+	if (error > 0 && RefitColorEndpoints(block, indices, &refit0, &refit1))
+	{
+		uint32_t refitIndices;
+		const int refitError = EvaluateColorBlock(block, refit0, refit1, &refitIndices);
+
+		if (refitError < error)
+		{
+			e0 = refit0;
+			e1 = refit1;
+			indices = refitIndices;
+		}
+	}
+
+	// e0 > e1 selects 4 color mode for BC1. Swapping endpoints swaps indices 0/1 and 2/3.
+	if (e0 < e1)
+	{
+		std::swap(e0, e1);
+		indices ^= 0x55555555;
+	}
+	else if (e0 == e1)
+	{
+		indices = 0;
+	}
+
+	dest[0] = uint8_t(e0 & 0xff);
+	dest[1] = uint8_t(e0 >> 8);
+	dest[2] = uint8_t(e1 & 0xff);
+	dest[3] = uint8_t(e1 >> 8);
+	dest[4] = uint8_t(indices & 0xff);
+	dest[5] = uint8_t((indices >> 8) & 0xff);
+	dest[6] = uint8_t((indices >> 16) & 0xff);
+	dest[7] = uint8_t(indices >> 24);
+}
+
+/// @brief Encode the alpha of a block of 16 RGBA8 texels, using 8 alpha mode.
+static void EncodeAlphaBlock(const uint8_t *block, uint8_t *dest)
+{
+	int a0 = 0, a1 = 255;
+
+	for (int i = 0; i < 16; i++)
+	{
+		a0 = std::max(a0, (int)block[i * 4 + 3]);
+		a1 = std::min(a1, (int)block[i * 4 + 3]);
+	}
+
+	uint64_t indices = 0;
+
+	if (a0 != a1)
+	{
+		int palette[8];
+		palette[0] = a0;
+		palette[1] = a1;
+
+		for (int k = 2; k < 8; k++)
+		{
+			palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			const int a = block[i * 4 + 3];
+			int bestError = INT32_MAX, bestIndex = 0;
+
+			for (int k = 0; k < 8; k++)
+			{
+				const int error = std::abs(a - palette[k]);
+
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIndex = k;
+				}
+			}
+
+			indices |= uint64_t(bestIndex) << (i * 3);
+		}
+	}
+
+	dest[0] = uint8_t(a0);
+	dest[1] = uint8_t(a1);
+
+	for (int i = 0; i < 6; i++)
+	{
+		dest[2 + i] = uint8_t((indices >> (i * 8)) & 0xff);
+	}
+}
+
+static uint32_t CalculateCompressedMipSize(int width, int height, bgfx::TextureFormat::Enum format)
+{
+	const uint32_t blockSize = format == bgfx::TextureFormat::BC1 ? 8 : 16;
+	return uint32_t((width + 3) / 4) * uint32_t((height + 3) / 4) * blockSize;
+}
+
+Image CompressImage(const Image &image, bgfx::TextureFormat::Enum *format)
+{
+	assert(image.data);
+	assert(image.nComponents == 4);
+	assert(format);
+	Image compressed;
+
+	if ((image.width & 3) != 0 || (image.height & 3) != 0)
+		return compressed;
+
+	// Use BC1 if the whole image is opaque.
+	*format = bgfx::TextureFormat::BC1;
+	const uint32_t nTexels = image.dataSize / 4;
+
+	for (uint32_t i = 0; i < nTexels; i++)
+	{
+		if (image.data[i * 4 + 3] != 255)
+		{
+			*format = bgfx::TextureFormat::BC3;
+			break;
+		}
+	}
+
+	int width = image.width, height = image.height;
+
+	for (int i = 0; i < image.nMips; i++)
+	{
+		compressed.dataSize += CalculateCompressedMipSize(width, height, *format);
+		width = std::max(1, width >> 1);
+		height = std::max(1, height >> 1);
+	}
+
+	compressed.width = image.width;
+	compressed.height = image.height;
+	compressed.nComponents = image.nComponents;
+	compressed.nMips = image.nMips;
+	compressed.data = (uint8_t *)malloc(compressed.dataSize);
+	compressed.release = ReleaseImageData;
+	const uint8_t *src = image.data;
+	uint8_t *dest = compressed.data;
+	width = image.width;
+	height = image.height;
+
+	for (int i = 0; i < image.nMips; i++)
+	{
+		for (int by = 0; by < height; by += 4)
+		{
+			for (int bx = 0; bx < width; bx += 4)
+			{
+				// Mips smaller than a block repeat their edge texels.
+				uint8_t block[16 * 4];
+
+				for (int y = 0; y < 4; y++)
+				{
+					for (int x = 0; x < 4; x++)
+					{
+						const int sx = std::min(bx + x, width - 1), sy = std::min(by + y, height - 1);
+						memcpy(&block[(x + y * 4) * 4], &src[(sx + sy * width) * 4], 4);
+					}
+				}
+
+				if (*format == bgfx::TextureFormat::BC3)
+				{
+					EncodeAlphaBlock(block, dest);
+					dest += 8;
+				}
+
+				EncodeColorBlock(block, dest);
+				dest += 8;
+			}
+		}
+
+		src += width * height * 4;
+		width = std::max(1, width >> 1);
+		height = std::max(1, height >> 1);
+	}
+
+	return compressed;
+}
+
+class VectorWriter : public bx::WriterI
+{
+public:
+	VectorWriter(std::vector<uint8_t> *data) : data_(data) {}
+
+	int32_t write(const void *data, int32_t size, bx::Error *err) override
+	{
+		const size_t offset = data_->size();
+		data_->resize(offset + size);
+		memcpy(&(*data_)[offset], data, size);
+		return size;
+	}
+
+private:
+	std::vector<uint8_t> *data_;
+};
+
+void WriteCompressedImage(const Image &image, bgfx::TextureFormat::Enum format, std::vector<uint8_t> *data)
+{
+	assert(data);
+	data->clear();
+	VectorWriter writer(data);
+	bx::Error err;
+	bimg::imageWriteKtx(&writer, bimg::TextureFormat::Enum(format), false, image.width, image.height, 1, (uint8_t)image.nMips, 0, image.data, &err);
+
+	if (!err.isOk())
+		data->clear();
+}
+
+Image ReadCompressedImage(const uint8_t *fileBuffer, size_t fileLength, bgfx::TextureFormat::Enum *format)
+{
+	assert(format);
+	Image image;
+	bimg::ImageContainer container;
+
+	if (!bimg::imageParse(container, fileBuffer, (uint32_t)fileLength))
+		return image;
+
+	*format = bgfx::TextureFormat::Enum(container.m_format);
+
+	if (!container.m_ktx || container.m_cubeMap || container.m_depth > 1 || container.m_numLayers > 1)
+		return image;
+
+	if (*format != bgfx::TextureFormat::BC1 && *format != bgfx::TextureFormat::BC3)
+		return image;
+
+	// bimg doesn't check the mip sizes against the file size.
+	int width = (int)container.m_width, height = (int)container.m_height;
+	size_t offset = container.m_offset;
+
+	for (int i = 0; i < container.m_numMips; i++)
+	{
+		const uint32_t mipSize = CalculateCompressedMipSize(width, height, *format);
+		offset += sizeof(uint32_t) + mipSize;
+		image.dataSize += mipSize;
+		width = std::max(1, width >> 1);
+		height = std::max(1, height >> 1);
+	}
+
+	if (offset > fileLength)
+	{
+		image.dataSize = 0;
+		return image;
+	}
+
+	// KTX prefixes each mip with its size, bgfx wants the mips packed together.
+	image.width = (int)container.m_width;
+	image.height = (int)container.m_height;
+	image.nComponents = 4;
+	image.nMips = container.m_numMips;
+	image.data = (uint8_t *)malloc(image.dataSize);
+	image.release = ReleaseImageData;
+	uint8_t *dest = image.data;
+
+	for (uint8_t i = 0; i < container.m_numMips; i++)
+	{
+		bimg::ImageMip mip;
+		bimg::imageGetRawData(container, 0, i, fileBuffer, (uint32_t)fileLength, mip);
+		memcpy(dest, mip.m_data, mip.m_size);
+		dest += mip.m_size;
+	}
+
+	return image;
+}
+
+} // namespace renderer
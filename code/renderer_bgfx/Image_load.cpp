@@ -25,6 +25,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 namespace renderer {
 
 #define STB_IMAGE_IMPLEMENTATION
+// The failure reason is a plain static, and images are decoded on worker threads.
+#define STBI_NO_FAILURE_STRINGS
 #include "stb_image.h"
 
 #define STB_IMAGE_RESIZE_IMPLEMENTATION
@@ -46,11 +48,9 @@ static void Stbi_LoadImage(const char *filename, const uint8_t *fileBuffer, size
 	image->data = stbi_load_from_memory(fileBuffer, (int)fileLength, &width, &height, &nComponents, 4);
 	nComponents = 4;
 
+	// Don't print the error here, this may be running on a worker thread.
 	if (image->data == nullptr)
-	{
-		interface::Printf("Error loading image \"%s\". Reason: \"%s\"\n", filename, stbi_failure_reason());
 		return;
-	}
 
 	image->width = width;
 	image->height = height;
@@ -77,6 +77,19 @@ static const ImageHandler imageHandlers[] =
 
 static const size_t nImageHandlers = sizeof(imageHandlers) / sizeof(imageHandlers[0]);
 
+static const ImageHandler *FindImageHandler(const char *filename)
+{
+	const char *extension = util::GetExtension(filename);
+
+	for (size_t i = 0; i < nImageHandlers; i++)
+	{
+		if (!util::Stricmp(imageHandlers[i].extension, extension))
+			return &imageHandlers[i];
+	}
+
+	return nullptr;
+}
+
 static int CalculateNumMips(int width, int height)
 {
 	return 1 + (int)std::floor(std::log2(std::max(width, height)));
@@ -102,6 +115,101 @@ static void ReleaseImageData(void *data, void *userData)
 	free(data);
 }
 
+/// @brief Gamma 2.2 conversion tables for mip generation.
+struct MipGammaTables
+{
+	MipGammaTables()
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			toLinear[i] = std::pow(i / 255.0f, 2.2f);
+		}
+
+		for (int i = 0; i < nFromLinear; i++)
+		{
+			const float linear = (i / float(nFromLinear - 1)) * (i / float(nFromLinear - 1));
+			fromLinear[i] = uint8_t(std::round(255.0f * std::pow(linear, 1.0f / 2.2f)));
+		}
+	}
+
+	float toLinear[256];
+
+	/// @brief Indexed by the square root of the linear value, so dark values get more precision.
+	static const int nFromLinear = 4096;
+	uint8_t fromLinear[nFromLinear];
+};
+
+static const MipGammaTables &GetMipGammaTables()
+{
+	static MipGammaTables tables;
+	return tables;
+}
+
+/// @brief Downsample rows [destY0, destY1) of a 2x2 box filtered mip. Color is averaged in linear space and weighted by alpha, so fully transparent texels don't bleed into their neighbours.
+static void Rgba8Downsample2x2Rows(int width, int height, const uint8_t *src, uint8_t *dest, int destY0, int destY1)
+{
+	using namespace bx;
+	const MipGammaTables &tables = GetMipGammaTables();
+	const int destWidth = std::max(1, width >> 1);
+	const simd128_t scaleFromLinear = simd_splat<simd128_t>(float(MipGammaTables::nFromLinear - 1));
+	const simd128_t half = simd_splat<simd128_t>(0.5f);
+	const simd128_t one = simd_splat<simd128_t>(1.0f);
+	BX_ALIGN_DECL_16(int32_t indices[4]);
+
+	for (int dy = destY0; dy < destY1; dy++)
+	{
+		const uint8_t *row0 = &src[std::min(dy * 2, height - 1) * width * 4];
+		const uint8_t *row1 = &src[std::min(dy * 2 + 1, height - 1) * width * 4];
+		uint8_t *destTexel = &dest[dy * destWidth * 4];
+
+		for (int dx = 0; dx < destWidth; dx++)
+		{
+			const int x0 = std::min(dx * 2, width - 1) * 4, x1 = std::min(dx * 2 + 1, width - 1) * 4;
+			const uint8_t *texels[4] = { &row0[x0], &row0[x1], &row1[x0], &row1[x1] };
+			simd128_t weighted = simd_zero<simd128_t>();
+			simd128_t unweighted = simd_zero<simd128_t>();
+			int alphaSum = 0;
+
+			for (int i = 0; i < 4; i++)
+			{
+				const uint8_t *t = texels[i];
+				const simd128_t linear = simd_ld<simd128_t>(tables.toLinear[t[0]], tables.toLinear[t[1]], tables.toLinear[t[2]], 0.0f);
+				weighted = simd_madd(linear, simd_splat<simd128_t>(float(t[3])), weighted);
+				unweighted = simd_add(unweighted, linear);
+				alphaSum += t[3];
+			}
+
+			const simd128_t average = alphaSum > 0 ? simd_mul(weighted, simd_splat<simd128_t>(1.0f / alphaSum)) : simd_mul(unweighted, simd_splat<simd128_t>(0.25f));
+			const simd128_t index = simd_madd(simd_sqrt(simd_min(average, one)), scaleFromLinear, half);
+			simd_st(indices, simd_ftoi(index));
+			destTexel[0] = tables.fromLinear[indices[0]];
+			destTexel[1] = tables.fromLinear[indices[1]];
+			destTexel[2] = tables.fromLinear[indices[2]];
+			destTexel[3] = uint8_t((alphaSum + 2) / 4);
+			destTexel += 4;
+		}
+	}
+}
+
+/// @brief Generate the next mip of an RGBA8 image with even dimensions (or a dimension of 1).
+static void Rgba8Downsample2x2(int width, int height, const uint8_t *src, uint8_t *dest)
+{
+	const int destWidth = std::max(1, width >> 1), destHeight = std::max(1, height >> 1);
+
+	// Large mips are split across the job system. Nested calls (e.g. when decoding on a worker) run serially.
+	if (g_jobSystem && destWidth * destHeight >= 128 * 128)
+	{
+		g_jobSystem->parallelFor((size_t)destHeight, 16, [&](size_t begin, size_t end)
+		{
+			Rgba8Downsample2x2Rows(width, height, src, dest, (int)begin, (int)end);
+		});
+	}
+	else
+	{
+		Rgba8Downsample2x2Rows(width, height, src, dest, 0, destHeight);
+	}
+}
+
 static void FinalizeImage(Image *image, int flags)
 {
 	assert(image);
@@ -142,12 +250,15 @@ static void FinalizeImage(Image *image, int flags)
 		{
 			uint8_t *mipDest = mipSource + (width * height * image->nComponents);
 
-#if 1
-			stbir_resize_uint8(mipSource, width, height, 0, mipDest, std::max(1, width >> 1), std::max(1, height >> 1), 0, image->nComponents);
-#else
-			// Causes lightshaft artifacts.
-			bgfx::imageRgba8Downsample2x2(width, height, width * image->nComponents, mipSource, mipDest);
-#endif
+			// The 2x2 box filter would drop the last row or column of odd sized images.
+			if (image->nComponents != 4 || (width > 1 && (width & 1)) || (height > 1 && (height & 1)))
+			{
+				stbir_resize_uint8(mipSource, width, height, 0, mipDest, std::max(1, width >> 1), std::max(1, height >> 1), 0, image->nComponents);
+			}
+			else
+			{
+				Rgba8Downsample2x2(width, height, mipSource, mipDest);
+			}
 			mipSource = mipDest;
 			width = std::max(1, width >> 1);
 			height = std::max(1, height >> 1);
@@ -203,7 +314,10 @@ Image LoadImage(const char *filename, int flags)
 			handler->load(filename, file.getData(), file.getLength(), &image);
 
 			if (!image.data)
+			{
+				interface::Printf("Error loading image \"%s\"\n", filename);
 				break;
+			}
 			
 			FinalizeImage(&image, flags);
 			return image;
@@ -232,7 +346,10 @@ Image LoadImage(const char *filename, int flags)
 		handler->load(newFilename, file.getData(), file.getLength(), &image);
 			
 		if (!image.data)
+		{
+			interface::Printf("Error loading image \"%s\"\n", newFilename);
 			continue;
+		}
 
 		FinalizeImage(&image, flags);
 		return image;
@@ -241,4 +358,63 @@ Image LoadImage(const char *filename, int flags)
 	return image;
 }
 
+std::unique_ptr<ReadOnlyFile> ReadImageFile(const char *filename, char *resolvedFilename, size_t resolvedFilenameSize)
+{
+	assert(resolvedFilename);
+
+	// Try the filename as is first, then with all the other supported extensions. Same order as LoadImage.
+	const ImageHandler *triedHandler = FindImageHandler(filename);
+
+	if (triedHandler)
+	{
+		auto file = std::make_unique<ReadOnlyFile>(filename);
+
+		if (file->isValid())
+		{
+			util::Strncpyz(resolvedFilename, filename, (int)resolvedFilenameSize);
+			return file;
+		}
+	}
+
+	char newFilename[MAX_QPATH];
+
+	for (size_t i = 0; i < nImageHandlers; i++)
+	{
+		const ImageHandler *handler = &imageHandlers[i];
+
+		if (handler == triedHandler)
+			continue;
+
+		util::StripExtension(filename, newFilename, sizeof(newFilename));
+		util::Strcat(newFilename, sizeof(newFilename), util::VarArgs(".%s", handler->extension));
+		auto file = std::make_unique<ReadOnlyFile>(newFilename);
+
+		if (file->isValid())
+		{
+			util::Strncpyz(resolvedFilename, newFilename, (int)resolvedFilenameSize);
+			return file;
+		}
+	}
+
+	return nullptr;
+}
+
+Image DecodeImage(const char *filename, const uint8_t *fileBuffer, size_t fileLength, int flags)
+{
+	Image image;
+	const ImageHandler *handler = FindImageHandler(filename);
+
+	if (!handler)
+		return image;
+
+	handler->load(filename, fileBuffer, fileLength, &image);
+
+	if (image.data)
+	{
+		FinalizeImage(&image, flags);
+	}
+
+	return image;
+}
+
 } // namespace renderer
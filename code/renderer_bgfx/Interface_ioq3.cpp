@@ -751,6 +751,7 @@ static void RE_SetWorldVisData(const byte *vis)
 
 static void RE_EndRegistration()
 {
+	main::EndRegistration();
 }
 
 static void RE_ClearScene()
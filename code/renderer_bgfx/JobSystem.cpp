@@ -0,0 +1,178 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+#include "Precompiled.h"
+#pragma hdrstop
+#include <atomic>
+
+namespace renderer {
+
+struct JobSystem::Batch
+{
+	const std::function<void(size_t begin, size_t end)> *fn;
+	size_t count;
+	size_t granularity;
+	std::atomic<size_t> nextBegin;
+};
+
+/// @brief Set on worker threads, and on the calling thread while it is running a batch. Used to run nested parallelFor calls serially instead of deadlocking.
+static thread_local bool s_isRunningJob = false;
+
+JobSystem::JobSystem(int nWorkers)
+{
+	if (nWorkers <= 0)
+		return;
+
+	submitMutex_ = SDL_CreateMutex();
+	mutex_ = SDL_CreateMutex();
+	wakeCondition_ = SDL_CreateCond();
+	doneCondition_ = SDL_CreateCond();
+
+	if (!submitMutex_ || !mutex_ || !wakeCondition_ || !doneCondition_)
+	{
+		interface::PrintWarningf("Creating job system synchronization primitives failed. Reason: \"%s\"", SDL_GetError());
+		return;
+	}
+
+	for (int i = 0; i < nWorkers; i++)
+	{
+		SDL_Thread *thread = SDL_CreateThread(WorkerThread, "JobSystem", this);
+
+		if (!thread)
+		{
+			interface::PrintWarningf("Creating job system worker thread failed. Reason: \"%s\"", SDL_GetError());
+			break;
+		}
+
+		threads_.push_back(thread);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	if (mutex_)
+	{
+		SDL_LockMutex(mutex_);
+		quit_ = true;
+		SDL_CondBroadcast(wakeCondition_);
+		SDL_UnlockMutex(mutex_);
+	}
+
+	for (SDL_Thread *thread : threads_)
+		SDL_WaitThread(thread, nullptr);
+
+	if (doneCondition_)
+		SDL_DestroyCond(doneCondition_);
+
+	if (wakeCondition_)
+		SDL_DestroyCond(wakeCondition_);
+
+	if (mutex_)
+		SDL_DestroyMutex(mutex_);
+
+	if (submitMutex_)
+		SDL_DestroyMutex(submitMutex_);
+}
+
+void JobSystem::parallelFor(size_t count, size_t granularity, const std::function<void(size_t begin, size_t end)> &fn)
+{
+	if (count == 0)
+		return;
+
+	granularity = std::max(granularity, size_t(1));
+
+	// Run serially if there's only one range, there are no workers, this is a nested call, or another thread is already using the pool.
+	if (count <= granularity || threads_.empty() || s_isRunningJob || SDL_TryLockMutex(submitMutex_) != 0)
+	{
+		fn(0, count);
+		return;
+	}
+
+	Batch batch;
+	batch.fn = &fn;
+	batch.count = count;
+	batch.granularity = granularity;
+	batch.nextBegin = 0;
+	SDL_LockMutex(mutex_);
+	batch_ = &batch;
+	batchId_++;
+	SDL_CondBroadcast(wakeCondition_);
+	SDL_UnlockMutex(mutex_);
+	s_isRunningJob = true;
+	runBatch(&batch);
+	s_isRunningJob = false;
+
+	// All ranges have been claimed. Wait for any workers still running one before the batch goes out of scope.
+	SDL_LockMutex(mutex_);
+	batch_ = nullptr;
+
+	while (nActiveWorkers_ > 0)
+		SDL_CondWait(doneCondition_, mutex_);
+
+	SDL_UnlockMutex(mutex_);
+	SDL_UnlockMutex(submitMutex_);
+}
+
+int JobSystem::WorkerThread(void *data)
+{
+	auto js = (JobSystem *)data;
+	s_isRunningJob = true;
+	uint32_t lastBatchId = 0;
+	SDL_LockMutex(js->mutex_);
+
+	for (;;)
+	{
+		while (!js->quit_ && (!js->batch_ || js->batchId_ == lastBatchId))
+			SDL_CondWait(js->wakeCondition_, js->mutex_);
+
+		if (js->quit_)
+			break;
+
+		Batch *batch = js->batch_;
+		lastBatchId = js->batchId_;
+		js->nActiveWorkers_++;
+		SDL_UnlockMutex(js->mutex_);
+		js->runBatch(batch);
+		SDL_LockMutex(js->mutex_);
+		js->nActiveWorkers_--;
+
+		if (js->nActiveWorkers_ == 0)
+			SDL_CondSignal(js->doneCondition_);
+	}
+
+	SDL_UnlockMutex(js->mutex_);
+	return 0;
+}
+
+void JobSystem::runBatch(Batch *batch)
+{
+	for (;;)
+	{
+		const size_t begin = batch->nextBegin.fetch_add(batch->granularity);
+
+		if (begin >= batch->count)
+			break;
+
+		(*batch->fn)(begin, std::min(begin + batch->granularity, batch->count));
+	}
+}
+
+} // namespace renderer
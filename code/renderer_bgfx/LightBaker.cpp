@@ -215,7 +215,7 @@ static int Thread(void *data)
 
 			if (IsSurfaceLightmapped(surface))
 			{
-				s_lightBaker->totalLightmappedTriangles += int(surface.indices.size() / 3);
+				s_lightBaker->totalLightmappedTriangles += int(world::GetSurfaceGeometry(mi, si).nIndices / 3);
 			}
 		}
 	}
@@ -185,17 +185,11 @@ static bool CreateEmbreeGeometry(int nVertices, int nTriangles)
 
 	auto vertices = (vec4 *)embreeMapBuffer(s_lightBaker->embreeScene, embreeMesh, RTC_VERTEX_BUFFER);
 	CHECK_EMBREE_ERROR(embreeMapBuffer);
-	size_t currentVertex = 0;
+	const std::vector<Vertex> &worldVertices = world::GetVertices();
 
-	for (int i = 0; i < world::GetNumVertexBuffers(); i++)
+	for (size_t i = 0; i < worldVertices.size(); i++)
 	{
-		const std::vector<Vertex> &worldVertices = world::GetVertexBuffer(i);
-
-		for (size_t vi = 0; vi < worldVertices.size(); vi++)
-		{
-			vertices[currentVertex] = worldVertices[vi].pos;
-			currentVertex++;
-		}
+		vertices[i] = worldVertices[i].pos;
 	}
 
 	embreeUnmapBuffer(s_lightBaker->embreeScene, embreeMesh, RTC_VERTEX_BUFFER);
@@ -213,20 +207,17 @@ static bool CreateEmbreeGeometry(int nVertices, int nTriangles)
 		if (!DoesSurfaceOccludeLight(surface))
 			continue;
 
-		// Adjust for combining multiple vertex buffers.
-		uint32_t indexOffset = 0;
-
-		for (int i = 0; i < (int)surface.bufferIndex; i++)
-			indexOffset += (uint32_t)world::GetVertexBuffer(i).size();
+		const world::SurfaceGeometry &geometry = world::GetSurfaceGeometry(0, si);
+		const uint32_t *indices = world::GetSurfaceIndices(geometry);
 
-		for (size_t i = 0; i < surface.indices.size(); i += 3)
+		for (size_t i = 0; i < geometry.nIndices; i += 3)
 		{
 			if (surface.material->isSky || (surface.flags & SURF_SKY))
 				s_lightBaker->faceFlags[faceIndex] |= FaceFlags::Sky;
 
-			triangles[faceIndex].indices[0] = indexOffset + surface.indices[i + 0];
-			triangles[faceIndex].indices[1] = indexOffset + surface.indices[i + 1];
-			triangles[faceIndex].indices[2] = indexOffset + surface.indices[i + 2];
+			triangles[faceIndex].indices[0] = indices[i + 0];
+			triangles[faceIndex].indices[1] = indices[i + 1];
+			triangles[faceIndex].indices[2] = indices[i + 2];
 			faceIndex++;
 		}
 	}
@@ -617,7 +608,7 @@ static void CreateAreaLights()
 				light.color = texture ? texture->normalizedColor : vec4::white;
 				light.flags = StaticLightFlags::DefaultMask;
 				light.photons = surface.material->surfaceLight * s_lightBaker->pointScale;
-				light.position = surface.cullinfo.bounds.midpoint();
+				light.position = world::GetSurfaceCullData(mi, si).cullinfo.bounds.midpoint();
 				CalculateLightEnvelope(&light);
 				s_lightBaker->lights.push_back(light);
 				continue;
@@ -627,15 +618,17 @@ static void CreateAreaLights()
 			light.modelIndex = mi;
 			light.surfaceIndex = si;
 			light.texture = texture;
-			const std::vector<Vertex> &vertices = world::GetVertexBuffer((int)surface.bufferIndex);
+			const std::vector<Vertex> &vertices = world::GetVertices();
+			const world::SurfaceGeometry &geometry = world::GetSurfaceGeometry(mi, si);
+			const uint32_t *indices = world::GetSurfaceIndices(geometry);
 
 			// Create one sample per triangle at the midpoint.
-			for (size_t i = 0; i < surface.indices.size(); i += 3)
+			for (size_t i = 0; i < geometry.nIndices; i += 3)
 			{
 				const Vertex *v[3];
-				v[0] = &vertices[surface.indices[i + 0]];
-				v[1] = &vertices[surface.indices[i + 1]];
-				v[2] = &vertices[surface.indices[i + 2]];
+				v[0] = &vertices[indices[i + 0]];
+				v[1] = &vertices[indices[i + 1]];
+				v[2] = &vertices[indices[i + 2]];
 
 				// From q3map2 RadSubdivideDiffuseLight
 				const float area = vec3::crossProduct(v[1]->pos - v[0]->pos, v[2]->pos - v[0]->pos).length();
@@ -842,18 +835,13 @@ bool InitializeDirectLight()
 
 			if (mi == 0 && DoesSurfaceOccludeLight(surface))
 			{
-				totalOccluderTriangles += (int)surface.indices.size() / 3;
+				totalOccluderTriangles += (int)world::GetSurfaceGeometry(mi, si).nIndices / 3;
 			}
 		}
 	}
 
 	// Count total vertices.
-	int totalVertices = 0;
-
-	for (int i = 0; i < world::GetNumVertexBuffers(); i++)
-	{
-		totalVertices += (int)world::GetVertexBuffer(i).size();
-	}
+	const int totalVertices = (int)world::GetVertices().size();
 
 	// Setup embree.
 	if (!CreateEmbreeGeometry(totalVertices, totalOccluderTriangles))
@@ -499,7 +499,7 @@ static bool CurrentOrNextValidTriangle()
 		
 		const world::Surface &surface = world::GetSurface(s_rasterizer.modelIndex, s_rasterizer.surfaceIndex);
 
-		if (!IsSurfaceLightmapped(surface) || s_rasterizer.triangleIndex >= surface.indices.size() / 3)
+		if (!IsSurfaceLightmapped(surface) || s_rasterizer.triangleIndex >= world::GetSurfaceGeometry(s_rasterizer.modelIndex, s_rasterizer.surfaceIndex).nIndices / 3)
 		{
 			// Surface is invalid, or we're finished with the surface's triangles. Move to the next surface.
 			s_rasterizer.triangleIndex = 0;
@@ -577,12 +577,13 @@ Luxel RasterizeLuxel()
 		{
 			// Setup rasterizer for this triangle.
 			const vec2i lightmapSize = world::GetLightmapSize();
-			const std::vector<Vertex> &vertices = world::GetVertexBuffer((int)surface.bufferIndex);
+			const std::vector<Vertex> &vertices = world::GetVertices();
+			const uint32_t *indices = world::GetSurfaceIndices(world::GetSurfaceGeometry(s_rasterizer.modelIndex, s_rasterizer.surfaceIndex));
 			lm_vec2 uvMin = lm_v2(FLT_MAX, FLT_MAX), uvMax = lm_v2(-FLT_MAX, -FLT_MAX);
 
 			for (int i = 0; i < 3; i++)
 			{
-				const Vertex &v = vertices[surface.indices[s_rasterizer.triangleIndex * 3 + i]];
+				const Vertex &v = vertices[indices[s_rasterizer.triangleIndex * 3 + i]];
 				ctx.triangle.p[i].x = v.pos.x;
 				ctx.triangle.p[i].y = v.pos.y;
 				ctx.triangle.p[i].z = v.pos.z;
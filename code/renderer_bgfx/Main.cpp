@@ -35,6 +35,7 @@ uint8_t g_gammaTable[g_gammaTableSize];
 bool g_hardwareGammaEnabled;
 ConsoleVariables g_cvars;
 const uint8_t *g_externalVisData = nullptr;
+JobSystem *g_jobSystem = nullptr;
 MaterialCache *g_materialCache = nullptr;
 ModelCache *g_modelCache = nullptr;
 TextureCache *g_textureCache = nullptr;
@@ -353,6 +354,12 @@ void DebugPrint(const char *format, ...)
 	s_main->debugTextY++;
 }
 
+void EndRegistration()
+{
+	// Make sure all the textures loaded by the level are ready before the first frame is rendered.
+	g_textureCache->processPendingTextures();
+}
+
 const Entity *GetCurrentEntity()
 {
 	return s_main->currentEntity;
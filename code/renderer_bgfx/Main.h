@@ -92,10 +92,11 @@ struct GenericShaderProgramVariant
 		// Fragment
 		AlphaTest = 1 << 0,
 		DynamicLights = 1 << 1,
-		SoftSprite = 1 << 2,
-		SunLight = 1 << 3,
+		LightGrid = 1 << 2,
+		SoftSprite = 1 << 3,
+		SunLight = 1 << 4,
 
-		Num = 1 << 4
+		Num = 1 << 5
 	};
 };
 
@@ -144,6 +145,9 @@ struct Main
 	/// Does the current camera render the world - i.e. not part of a HUD/UI scene.
 	bool isWorldCamera = false;
 
+	/// Per camera fog parameters, indexed by fog index.
+	std::vector<world::FogCameraParameters> cameraFogs;
+
 	/// @}
 
 	/// @name Fonts
@@ -189,6 +193,8 @@ struct Main
 	int noisePerm[noiseSize];
 	/// @}
 
+	std::unique_ptr<JobSystem> jobSystem;
+
 	/// @name Resource caches
 	/// @{
 	std::unique_ptr<TextureCache> textureCache;
@@ -205,6 +211,12 @@ struct Main
 	std::vector<Bounds> sceneDebugBounds;
 	std::vector<Entity> sceneEntities;
 
+	/// @brief Scratch buffers for sampling the light grid for all scene entities at once.
+	/// @{
+	std::vector<vec3> entityLightPositions;
+	std::vector<vec3> entityLightSamples;
+	/// @}
+
 	struct Polygon
 	{
 		Material *material;
@@ -235,6 +247,20 @@ struct Main
 	/// @{
 	bool skyboxPortalEnabled = false;
 	SceneDefinition skyboxPortalScene;
+
+	/// @brief The skybox portal scene rendered to the faces of a cube. Drawn as the sky box of the camera containing the skybox portal.
+	/// @remarks Only used if r_skyboxPortalCubemapRate is greater than 0.
+	FrameBuffer skyboxPortalCubemapFb[6];
+	static const int skyboxPortalCubemapSize = 512;
+
+	/// @brief The time the cube faces were last rendered.
+	int skyboxPortalCubemapTime = 0;
+
+	/// @brief The cube faces have been rendered at least once since they were created.
+	bool skyboxPortalCubemapValid = false;
+
+	/// @brief The current scene uses the cube faces instead of rendering the skybox portal as a camera.
+	bool skyboxPortalCubemapActive = false;
 	/// @}
 
 	/// @name SMAA
@@ -47,7 +47,8 @@ struct RenderCameraFlags
 		IsSkyboxPortal       = 1<<1,
 		SkipUnlitSurfaces    = 1<<2,
 		UseClippingPlane     = 1<<3,
-		UseStencilTest       = 1<<4
+		UseScissorRect       = 1<<4,
+		UseStencilTest       = 1<<5
 	};
 };
 
@@ -64,6 +65,10 @@ struct RenderCameraArgs
 	int flags = 0;
 	const mat4 *customProjectionMatrix = nullptr;
 	const FrameBuffer *customFrameBuffer = nullptr;
+
+	/// @brief Only the part of rect that the camera can be seen through, e.g. a portal surface.
+	/// @remarks Used if flags has UseScissorRect.
+	Rect scissorRect;
 };
 
 bgfx::ViewId PushView(const FrameBuffer &frameBuffer, uint16_t clearFlags, const mat4 &viewMatrix, const mat4 &projectionMatrix, Rect rect, int flags)
@@ -317,27 +322,40 @@ static void ClampEntityLight(vec3 *light)
 	}
 }
 
-static void SetupEntityLighting(Entity *entity)
+static vec3 GetEntityLightPosition(const Entity &entity)
 {
-	assert(entity);
-
-	// Trace a sample point down to find ambient light.
-	vec3 lightPosition;
-	
-	if (entity->flags & EntityFlags::LightingPosition)
+	if (entity.flags & EntityFlags::LightingPosition)
 	{
 		// Seperate lightOrigins are needed so an object that is sinking into the ground can still be lit, and so multi-part models can be lit identically.
-		lightPosition = entity->lightingPosition;
-	}
-	else
-	{
-		lightPosition = entity->position;
+		return entity.lightingPosition;
 	}
 
+	return entity.position;
+}
+
+/// @brief Calculate the ambient and directed light of an entity.
+/// @param gridSample Light grid sample at the entity lighting position: ambient, directed and direction. nullptr if not sampled on the CPU.
+static void SetupEntityLighting(Entity *entity, bool isWorldScene, const vec3 *gridSample)
+{
+	assert(entity);
+
+	// Trace a sample point down to find ambient light.
+	const vec3 lightPosition = GetEntityLightPosition(*entity);
+	entity->lightOffset = lightPosition - entity->position;
+
 	// If not a world scene, only use dynamic lights (menu system, etc.)
-	if (s_main->isWorldCamera && world::HasLightGrid())
+	// If the light grid can be sampled in the generic shader, it doesn't need to be sampled here.
+	if (gridSample)
 	{
-		world::SampleLightGrid(lightPosition, &entity->ambientLight, &entity->directedLight, &entity->lightDir);
+		entity->ambientLight = gridSample[0];
+		entity->directedLight = gridSample[1];
+		entity->lightDir = gridSample[2];
+	}
+	else if (isWorldScene && world::HasLightGridTextures())
+	{
+		entity->ambientLight = vec3::empty;
+		entity->directedLight = vec3::empty;
+		entity->lightDir = s_main->sunLight.direction;
 	}
 	else
 	{
@@ -354,7 +372,7 @@ static void SetupEntityLighting(Entity *entity)
 	}
 
 	// Modify the light by dynamic lights.
-	if (!s_main->isWorldCamera)
+	if (!isWorldScene)
 	{
 		s_main->dlightManager->contribute(s_main->frameNo, lightPosition, &entity->directedLight, &entity->lightDir);
 	}
@@ -364,6 +382,73 @@ static void SetupEntityLighting(Entity *entity)
 	entity->lightDir.normalize();
 }
 
+/// @brief Compute the entity data that doesn't depend on the camera - lighting and fog index - once per scene, instead of once per camera.
+static void PreprocessSceneEntities(bool isWorldScene)
+{
+	PROFILE_SCOPED(PreprocessSceneEntities)
+	const size_t nEntities = s_main->sceneEntities.size();
+
+	if (nEntities == 0)
+		return;
+
+	// Sample the light grid for each range of entities in one batch.
+	const bool sampleLightGrid = isWorldScene && world::HasLightGrid() && !world::HasLightGridTextures();
+	std::vector<vec3> &positions = s_main->entityLightPositions;
+	std::vector<vec3> &samples = s_main->entityLightSamples;
+
+	if (sampleLightGrid)
+	{
+		positions.resize(nEntities);
+		samples.resize(nEntities * 3);
+
+		for (size_t i = 0; i < nEntities; i++)
+		{
+			positions[i] = GetEntityLightPosition(s_main->sceneEntities[i]);
+		}
+	}
+
+	g_jobSystem->parallelFor(nEntities, 16, [&](size_t begin, size_t end)
+	{
+		const size_t n = end - begin;
+
+		if (sampleLightGrid)
+		{
+			// Each range uses its own slice of the sample buffer: ambient, then directed, then direction.
+			vec3 *ambient = &samples[begin * 3];
+			vec3 *directed = ambient + n;
+			vec3 *direction = directed + n;
+			world::SampleLightGrid(&positions[begin], n, ambient, directed, direction);
+
+			for (size_t i = 0; i < n; i++)
+			{
+				const vec3 gridSample[] = { ambient[i], directed[i], direction[i] };
+				SetupEntityLighting(&s_main->sceneEntities[begin + i], isWorldScene, gridSample);
+			}
+		}
+		else
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				SetupEntityLighting(&s_main->sceneEntities[i], isWorldScene, nullptr);
+			}
+		}
+
+		for (size_t i = begin; i < end; i++)
+		{
+			Entity &entity = s_main->sceneEntities[i];
+
+			if (entity.type == EntityType::Model)
+			{
+				entity.fogIndex = entity.handle == 0 ? -1 : s_main->modelCache->getModel(entity.handle)->findFogIndex(entity);
+			}
+			else
+			{
+				entity.fogIndex = isWorldScene ? world::FindFogIndex(entity.position, entity.radius) : -1;
+			}
+		}
+	});
+}
+
 static void RenderRailCore(vec3 start, vec3 end, vec3 up, float length, float spanWidth, Material *mat, vec4 color, Entity *entity)
 {
 	const uint32_t nVertices = 4, nIndices = 6;
@@ -400,7 +485,7 @@ static void RenderRailCore(vec3 start, vec3 end, vec3 up, float length, float sp
 	DrawCall dc;
 	dc.dynamicLighting = false;
 	dc.entity = entity;
-	dc.fogIndex = s_main->isWorldCamera ? world::FindFogIndex(entity->position, entity->radius) : -1;
+	dc.fogIndex = entity->fogIndex;
 	dc.material = mat;
 	dc.vb.type = dc.ib.type = DrawCall::BufferType::Transient;
 	dc.vb.transientHandle = tvb;
@@ -505,7 +590,7 @@ static void RenderRailRingsEntity(Entity *entity)
 	DrawCall dc;
 	dc.dynamicLighting = false;
 	dc.entity = entity;
-	dc.fogIndex = s_main->isWorldCamera ? world::FindFogIndex(entity->position, entity->radius) : -1;
+	dc.fogIndex = entity->fogIndex;
 	dc.material = s_main->materialCache->getMaterial(entity->customMaterial);
 	dc.vb.type = dc.ib.type = DrawCall::BufferType::Transient;
 	dc.vb.transientHandle = tvb;
@@ -576,7 +661,7 @@ static void RenderSpriteEntity(mat3 viewRotation, Entity *entity)
 	DrawCall dc;
 	dc.dynamicLighting = false;
 	dc.entity = entity;
-	dc.fogIndex = s_main->isWorldCamera ? world::FindFogIndex(entity->position, entity->radius) : -1;
+	dc.fogIndex = entity->fogIndex;
 	dc.material = s_main->materialCache->getMaterial(entity->customMaterial);
 	dc.softSpriteDepth = entity->radius / 2.0f;
 	dc.vb.type = dc.ib.type = DrawCall::BufferType::Transient;
@@ -631,7 +716,6 @@ static void RenderEntity(vec3 viewPosition, mat3 viewRotation, Frustum cameraFru
 			if (model->isCulled(entity, cameraFrustum))
 				break;
 
-			SetupEntityLighting(entity);
 			model->render(s_main->sceneRotation, &s_main->drawCalls, entity);
 		}
 		break;
@@ -830,6 +914,46 @@ static vec2 CalculateDepthRange(VisibilityId visId, vec3 position)
 	return vec2(zMin, zMax);
 }
 
+/// @brief Calculate the part of a camera rect covered by normalized device coordinate bounds.
+static Rect CalculateScissorRect(const Rect &cameraRect, vec2 mins, vec2 maxs)
+{
+	// NDC y is up, rect y is down.
+	const int x0 = Clamped((int)std::floor((mins.x * 0.5f + 0.5f) * cameraRect.w), 0, cameraRect.w);
+	const int x1 = Clamped((int)std::ceil((maxs.x * 0.5f + 0.5f) * cameraRect.w), 0, cameraRect.w);
+	const int y0 = Clamped((int)std::floor((0.5f - maxs.y * 0.5f) * cameraRect.h), 0, cameraRect.h);
+	const int y1 = Clamped((int)std::ceil((0.5f - mins.y * 0.5f) * cameraRect.h), 0, cameraRect.h);
+	return Rect(cameraRect.x + x0, cameraRect.y + y0, x1 - x0, y1 - y0);
+}
+
+/// @brief Limit a camera to the part of its rect covered by normalized device coordinate bounds.
+static void SetupScissorRect(RenderCameraArgs *args, vec2 mins, vec2 maxs)
+{
+	assert(args);
+	const Rect scissorRect = CalculateScissorRect(args->rect, mins, maxs);
+
+	// bgfx treats an empty scissor rect as no scissor.
+	if (scissorRect.w <= 0 || scissorRect.h <= 0)
+		return;
+
+	args->flags |= RenderCameraFlags::UseScissorRect;
+	args->scissorRect = scissorRect;
+}
+
+/// @brief Calculate a clip space transform that maps a scissor rect to the whole camera rect. Used to tighten the camera frustum to the scissor rect.
+static mat4 CalculateScissorMatrix(const Rect &cameraRect, const Rect &scissorRect)
+{
+	const float minX = (scissorRect.x - cameraRect.x) / (float)cameraRect.w * 2.0f - 1.0f;
+	const float maxX = (scissorRect.x + scissorRect.w - cameraRect.x) / (float)cameraRect.w * 2.0f - 1.0f;
+	const float minY = 1.0f - (scissorRect.y + scissorRect.h - cameraRect.y) / (float)cameraRect.h * 2.0f;
+	const float maxY = 1.0f - (scissorRect.y - cameraRect.y) / (float)cameraRect.h * 2.0f;
+	mat4 m = mat4::identity;
+	m[0] = 2.0f / (maxX - minX);
+	m[5] = 2.0f / (maxY - minY);
+	m[12] = -(maxX + minX) / (maxX - minX);
+	m[13] = -(maxY + minY) / (maxY - minY);
+	return m;
+}
+
 static void RenderCamera(const RenderCameraArgs &args)
 {
 	const float polygonDepthOffset = -0.001f;
@@ -838,6 +962,9 @@ static void RenderCamera(const RenderCameraArgs &args)
 	s_main->isWorldCamera = args.visId != VisibilityId::None;
 	const bool isProbe = args.visId == VisibilityId::Probe;
 
+	// Probes and skybox portal cube faces.
+	const bool isOffscreen = args.customFrameBuffer != nullptr;
+
 	// Update visibility for this PVS position.
 	// Probes do this externally.
 	if (s_main->isWorldCamera && !isProbe)
@@ -852,7 +979,9 @@ static void RenderCamera(const RenderCameraArgs &args)
 	const mat4 viewMatrix = s_main->toOpenGlMatrix * mat4::view(args.position, args.rotation);
 	const mat4 projectionMatrix = args.customProjectionMatrix ? *args.customProjectionMatrix : mat4::perspectiveProjection(args.fov.x, args.fov.y, depthRange.x, depthRange.y);
 	const mat4 vpMatrix(projectionMatrix * viewMatrix);
-	const Frustum cameraFrustum(vpMatrix);
+
+	// Cull to the scissor rect, so only what can be seen through it is rendered.
+	const Frustum cameraFrustum((args.flags & RenderCameraFlags::UseScissorRect) ? CalculateScissorMatrix(args.rect, args.scissorRect) * vpMatrix : vpMatrix);
 
 	// The main camera can have a single portal camera and a single reflection camera. No deep recursion.
 	if (args.visId == VisibilityId::Main)
@@ -890,6 +1019,15 @@ static void RenderCamera(const RenderCameraArgs &args)
 				reflectionArgs.rect = args.rect;
 				reflectionArgs.rotation = reflectionCamera.rotation;
 				reflectionArgs.visId = VisibilityId::Reflection;
+
+				// Limit the reflection camera to the screen space bounds of the visible reflective surfaces.
+				vec2 reflectionMins, reflectionMaxs;
+
+				if (world::CalculateReflectionScreenBounds(args.visId, vpMatrix, &reflectionMins, &reflectionMaxs))
+				{
+					SetupScissorRect(&reflectionArgs, reflectionMins, reflectionMaxs);
+				}
+
 				RenderCamera(reflectionArgs);
 				s_main->isCameraMirrored = false;
 
@@ -929,6 +1067,15 @@ static void RenderCamera(const RenderCameraArgs &args)
 			portalArgs.rect = args.rect;
 			portalArgs.rotation = portalCamera.rotation;
 			portalArgs.visId = VisibilityId::Portal;
+
+			// Limit the portal camera to the screen space bounds of the visible portal surfaces.
+			vec2 portalMins, portalMaxs;
+
+			if (world::CalculatePortalScreenBounds(args.visId, vpMatrix, &portalMins, &portalMaxs))
+			{
+				SetupScissorRect(&portalArgs, portalMins, portalMaxs);
+			}
+
 			RenderCamera(portalArgs);
 			s_main->isCameraMirrored = false;
 		}
@@ -947,8 +1094,16 @@ static void RenderCamera(const RenderCameraArgs &args)
 				Sky_Render(&s_main->drawCalls, args.position, depthRange.y, world::GetSkySurface(args.visId, i));
 			}
 		}
+		else if (s_main->skyboxPortalCubemapActive)
+		{
+			// The skybox portal scene has been rendered to the faces of a cube, draw them as the sky box.
+			for (size_t i = 0; i < world::GetNumSkySurfaces(args.visId); i++)
+			{
+				Sky_RenderSkyboxPortal(&s_main->drawCalls, args.position, depthRange.y, world::GetSkySurface(args.visId, i));
+			}
+		}
 
-		world::Render(args.visId, &s_main->drawCalls, s_main->sceneRotation);
+		world::Render(args.visId, &s_main->drawCalls, s_main->sceneRotation, cameraFrustum);
 	}
 
 	for (Entity &entity : s_main->sceneEntities)
@@ -983,8 +1138,8 @@ static void RenderCamera(const RenderCameraArgs &args)
 		s_main->uniforms->portalClipEnabled.set(vec4::empty);
 	}
 
-	// Render to shadow map. Probes skip this.
-	if (s_main->sunLightEnabled && s_main->isWorldCamera && !isProbe)
+	// Render to shadow map. Offscreen cameras skip this.
+	if (s_main->sunLightEnabled && s_main->isWorldCamera && !isOffscreen)
 	{
 		Bounds bounds(world::GetBounds());
 		vec3 eye;
@@ -1037,13 +1192,18 @@ static void RenderCamera(const RenderCameraArgs &args)
 	}
 
 	// Render depth for soft sprites. MSAA is always off.
-	if (s_main->softSpritesEnabled && s_main->isWorldCamera && !isProbe)
+	if (s_main->softSpritesEnabled && s_main->isWorldCamera && !isOffscreen)
 	{
 		const bgfx::ViewId viewId = PushView(s_main->depthFb, BGFX_CLEAR_DEPTH, viewMatrix, projectionMatrix, args.rect);
 #ifdef _DEBUG
 		bgfx::setViewName(viewId, "Depth");
 #endif
 
+		if (args.flags & RenderCameraFlags::UseScissorRect)
+		{
+			bgfx::setViewScissor(viewId, uint16_t(args.scissorRect.x), uint16_t(args.scissorRect.y), uint16_t(args.scissorRect.w), uint16_t(args.scissorRect.h));
+		}
+
 		for (DrawCall &dc : s_main->drawCalls)
 		{
 			// Material remapping.
@@ -1117,12 +1277,12 @@ static void RenderCamera(const RenderCameraArgs &args)
 
 	bgfx::ViewId mainViewId;
 	
-	if (isProbe)
+	if (isOffscreen)
 	{
 		assert(bgfx::isValid(args.customFrameBuffer->handle));
 		mainViewId = PushView(*args.customFrameBuffer, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, viewMatrix, projectionMatrix, args.rect, PushViewFlags::Sequential);
 #ifdef _DEBUG
-		bgfx::setViewName(mainViewId, "Probe");
+		bgfx::setViewName(mainViewId, isProbe ? "Probe" : "SkyboxPortalCubemap");
 #endif
 	}
 	else if (s_main->isWorldCamera)
@@ -1140,6 +1300,11 @@ static void RenderCamera(const RenderCameraArgs &args)
 #endif
 	}
 
+	if (args.flags & RenderCameraFlags::UseScissorRect)
+	{
+		bgfx::setViewScissor(mainViewId, uint16_t(args.scissorRect.x), uint16_t(args.scissorRect.y), uint16_t(args.scissorRect.w), uint16_t(args.scissorRect.h));
+	}
+
 	if (!s_main->drawCalls.empty())
 	{
 		int renderMode = RENDER_MODE_NONE;
@@ -1152,6 +1317,14 @@ static void RenderCamera(const RenderCameraArgs &args)
 		s_main->uniforms->renderMode.set(vec4((float)renderMode, 0, 0, 0));
 	}
 
+	// Fog parameters only depend on the fog and the camera, so calculate them once here instead of per draw call.
+	s_main->cameraFogs.resize(world::IsLoaded() ? world::GetNumFogs() : 0);
+
+	for (size_t i = 0; i < s_main->cameraFogs.size(); i++)
+	{
+		world::CalculateFog((int)i, args.position, args.rotation, viewMatrix, &s_main->cameraFogs[i]);
+	}
+
 	for (DrawCall &dc : s_main->drawCalls)
 	{
 		assert(dc.material);
@@ -1185,7 +1358,18 @@ static void RenderCamera(const RenderCameraArgs &args)
 			s_main->matStageUniforms->lightType.set(vec4::empty);
 			s_main->matStageUniforms->vertexColor.set(vec4::black);
 			const int sky_texorder[6] = { 0, 2, 1, 3, 4, 5 };
-			bgfx::setTexture(TextureUnit::Diffuse, s_main->matStageUniforms->diffuseSampler.handle, mat->sky.outerbox[sky_texorder[dc.skyboxSide]]->getHandle());
+
+			if (dc.flags & DrawCallFlags::SkyboxPortal)
+			{
+				bgfx::setTexture(TextureUnit::Diffuse, s_main->matStageUniforms->diffuseSampler.handle, bgfx::getTexture(s_main->skyboxPortalCubemapFb[dc.skyboxSide].handle));
+			}
+			else
+			{
+				const Texture *texture = mat->sky.outerbox[sky_texorder[dc.skyboxSide]];
+				g_textureCache->markUsed(texture);
+				bgfx::setTexture(TextureUnit::Diffuse, s_main->matStageUniforms->diffuseSampler.handle, texture->getHandle());
+			}
+
 #ifdef _DEBUG
 			bgfx::setTexture(TextureUnit::Diffuse2, s_main->matStageUniforms->diffuseSampler2.handle, g_textureCache->getWhite()->getHandle());
 			bgfx::setTexture(TextureUnit::Light, s_main->matStageUniforms->lightSampler.handle, g_textureCache->getWhite()->getHandle());
@@ -1215,15 +1399,24 @@ static void RenderCamera(const RenderCameraArgs &args)
 
 		s_main->currentEntity = dc.entity;
 		s_main->matUniforms->time.set(vec4(mat->setTime(s_main->floatTime), 0, 0, 0));
-		const mat4 modelViewMatrix(viewMatrix * dc.modelMatrix);
 
-		if (s_main->isWorldCamera)
+		// Skip dynamic lighting if no dlights touch the draw call bounds.
+		// Vertex deforms can move geometry outside the bounds, so don't cull those.
+		bool useDynamicLights = s_main->isWorldCamera && dc.dynamicLighting && !(dc.flags & DrawCallFlags::Sky);
+
+		if (useDynamicLights && dc.hasBounds && mat->numDeforms == 0 && !mat->hasAutoSpriteDeform())
+		{
+			useDynamicLights = s_main->dlightManager->isTouchingBounds(dc.bounds);
+		}
+
+		if (useDynamicLights)
 		{
 			s_main->dlightManager->updateUniforms(s_main->uniforms.get());
 		}
 		else
 		{
 			// For non-world scenes, dlight contribution is added to entities in SetupEntityLighting, so write 0 to the uniform for num dlights.
+			// Same for draw calls that aren't touched by any dlights.
 			s_main->uniforms->dynamicLight_Num_Intensity.set(vec4::empty);
 		}
 
@@ -1249,15 +1442,29 @@ static void RenderCamera(const RenderCameraArgs &args)
 			s_main->entityUniforms->lightDirection.set(vec4(s_main->currentEntity->lightDir, 0));
 		}
 
-		vec4 fogColor, fogDistance, fogDepth;
-		float eyeT;
+		vec4 fogColor;
 
 		if (!dc.material->noFog && dc.fogIndex >= 0)
 		{
-			world::CalculateFog(dc.fogIndex, dc.modelMatrix, modelViewMatrix, args.position, localViewPosition, args.rotation, &fogColor, &fogDistance, &fogDepth, &eyeT);
-			s_main->uniforms->fogDistance.set(fogDistance);
-			s_main->uniforms->fogDepth.set(fogDepth);
-			s_main->uniforms->fogEyeT.set(eyeT);
+			const world::FogCameraParameters &fog = s_main->cameraFogs[dc.fogIndex];
+			fogColor = fog.color;
+
+			// World surfaces don't have a model transform, so the per camera parameters can be used as is.
+			if (!s_main->currentEntity && dc.modelMatrix.equals(mat4::identity))
+			{
+				s_main->uniforms->fogDistance.set(fog.distance);
+				s_main->uniforms->fogDepth.set(fog.depth);
+				s_main->uniforms->fogEyeT.set(fog.eyeT);
+			}
+			else
+			{
+				vec4 fogDistance, fogDepth;
+				float eyeT;
+				world::TransformFog(fog, dc.modelMatrix, localViewPosition, &fogDistance, &fogDepth, &eyeT);
+				s_main->uniforms->fogDistance.set(fogDistance);
+				s_main->uniforms->fogDepth.set(fogDepth);
+				s_main->uniforms->fogEyeT.set(eyeT);
+			}
 		}
 
 		for (const MaterialStage &stage : mat->stages)
@@ -1326,7 +1533,7 @@ static void RenderCamera(const RenderCameraArgs &args)
 				s_main->uniforms->softSprite_Depth_UseAlpha.set(vec4(dc.softSpriteDepth, useAlpha, 0, 0));
 			}
 
-			if (s_main->isWorldCamera && dc.dynamicLighting && !(dc.flags & DrawCallFlags::Sky))
+			if (useDynamicLights)
 			{
 				shaderVariant |= GenericShaderProgramVariant::DynamicLights;
 				bgfx::setTexture(TextureUnit::DynamicLightCells, s_main->matStageUniforms->dynamicLightCellsSampler.handle, s_main->dlightManager->getCellsTexture());
@@ -1334,6 +1541,12 @@ static void RenderCamera(const RenderCameraArgs &args)
 				bgfx::setTexture(TextureUnit::DynamicLights, s_main->matStageUniforms->dynamicLightsSampler.handle, s_main->dlightManager->getLightsTexture());
 			}
 
+			if (s_main->isWorldCamera && s_main->currentEntity && stage.light == MaterialLight::Vector && world::HasLightGridTextures())
+			{
+				shaderVariant |= GenericShaderProgramVariant::LightGrid;
+				world::SetLightGridUniforms(s_main->entityUniforms.get(), s_main->currentEntity->lightOffset);
+			}
+
 			if (s_main->sunLightEnabled && s_main->isWorldCamera && mat->sort == MaterialSort::Opaque && !(dc.flags & DrawCallFlags::Sky))
 			{
 				shaderVariant |= GenericShaderProgramVariant::SunLight;
@@ -1505,6 +1718,73 @@ static void RenderCamera(const RenderCameraArgs &args)
 	}
 }
 
+/// @brief Render the skybox portal scene to the faces of a cube, so the containing camera can draw them as the sky box.
+/// @remarks The faces are only rendered again at the r_skyboxPortalCubemapRate rate, instead of rendering the skybox portal scene as a camera every frame.
+static void UpdateSkyboxPortalCubemap()
+{
+	s_main->skyboxPortalCubemapActive = true;
+
+	if (!bgfx::isValid(s_main->skyboxPortalCubemapFb[0].handle))
+	{
+		const uint32_t rtClampFlags = BGFX_TEXTURE_RT | BGFX_TEXTURE_U_CLAMP | BGFX_TEXTURE_V_CLAMP;
+
+		for (int i = 0; i < 6; i++)
+		{
+			bgfx::TextureHandle textures[2];
+			textures[0] = bgfx::createTexture2D(s_main->skyboxPortalCubemapSize, s_main->skyboxPortalCubemapSize, false, 1, bgfx::TextureFormat::BGRA8, rtClampFlags);
+			textures[1] = bgfx::createTexture2D(s_main->skyboxPortalCubemapSize, s_main->skyboxPortalCubemapSize, false, 1, bgfx::TextureFormat::D24S8, BGFX_TEXTURE_RT);
+			s_main->skyboxPortalCubemapFb[i].handle = bgfx::createFrameBuffer(2, textures, true);
+		}
+
+		s_main->skyboxPortalCubemapValid = false;
+	}
+
+	// Time can go backwards, e.g. map_restart.
+	const int interval = 1000 / g_cvars.skyboxPortalCubemapRate.getInt();
+	const int elapsed = s_main->time - s_main->skyboxPortalCubemapTime;
+
+	if (s_main->skyboxPortalCubemapValid && elapsed >= 0 && elapsed < interval)
+		return;
+
+	// Match the sky box face orientations in Sky.cpp. s is right, t is up.
+	const vec3 faceAxes[6][3] =
+	{
+		// forward, s, t
+		{ vec3(1, 0, 0), vec3(0, -1, 0), vec3(0, 0, 1) },
+		{ vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1) },
+		{ vec3(0, 1, 0), vec3(1, 0, 0), vec3(0, 0, 1) },
+		{ vec3(0, -1, 0), vec3(-1, 0, 0), vec3(0, 0, 1) },
+		{ vec3(0, 0, 1), vec3(0, -1, 0), vec3(-1, 0, 0) },
+		{ vec3(0, 0, -1), vec3(0, -1, 0), vec3(1, 0, 0) }
+	};
+
+	const SceneDefinition &scene = s_main->skyboxPortalScene;
+
+	for (int i = 0; i < 6; i++)
+	{
+		// Render targets with a bottom left origin are upside down when sampled, so flip the face vertically. That mirrors the camera.
+		const vec3 up = s_main->isTextureOriginBottomLeft ? -faceAxes[i][2] : faceAxes[i][2];
+		s_main->isCameraMirrored = s_main->isTextureOriginBottomLeft;
+		s_main->sceneRotation = mat3(faceAxes[i][0], -faceAxes[i][1], up);
+
+		RenderCameraArgs args;
+		args.areaMask = scene.areaMask;
+		args.customFrameBuffer = &s_main->skyboxPortalCubemapFb[i];
+		args.flags = RenderCameraFlags::IsSkyboxPortal;
+		args.fov = vec2(90, 90);
+		args.position = scene.position;
+		args.pvsPosition = scene.position;
+		args.rect = Rect(0, 0, s_main->skyboxPortalCubemapSize, s_main->skyboxPortalCubemapSize);
+		args.rotation = s_main->sceneRotation;
+		args.visId = VisibilityId::SkyboxPortal;
+		RenderCamera(args);
+	}
+
+	s_main->isCameraMirrored = false;
+	s_main->skyboxPortalCubemapTime = s_main->time;
+	s_main->skyboxPortalCubemapValid = true;
+}
+
 void RenderScene(const SceneDefinition &scene)
 {
 	FlushStretchPics();
@@ -1551,13 +1831,22 @@ void RenderScene(const SceneDefinition &scene)
 		// Update scene dynamic lights.
 		if (isWorldScene)
 		{
-			s_main->dlightManager->updateTextures(s_main->frameNo);
+			s_main->dlightManager->updateTextures(s_main->frameNo, scene.position, scene.rotation, scene.fov);
 		}
 
+		// Lighting and fog are the same for every camera, only culling is per camera.
+		PreprocessSceneEntities(isWorldScene);
+
 		// Render camera(s).
 		s_main->sceneRotation = scene.rotation;
 
-		if (s_main->skyboxPortalEnabled)
+		if (s_main->skyboxPortalEnabled && g_cvars.skyboxPortalCubemapRate.getInt() > 0)
+		{
+			UpdateSkyboxPortalCubemap();
+			s_main->sceneRotation = scene.rotation;
+			s_main->skyboxPortalEnabled = false;
+		}
+		else if (s_main->skyboxPortalEnabled)
 		{
 			RenderCameraArgs args;
 			args.areaMask = s_main->skyboxPortalScene.areaMask;
@@ -1585,6 +1874,7 @@ void RenderScene(const SceneDefinition &scene)
 			args.flags |= RenderCameraFlags::ContainsSkyboxPortal;
 
 		RenderCamera(args);
+		s_main->skyboxPortalCubemapActive = false;
 
 		if (isWorldScene)
 		{
@@ -1746,6 +2036,10 @@ void EndFrame()
 {
 	FlushStretchPics();
 
+	// Textures loaded after registration (e.g. by the UI) are swapped in a few at a time.
+	g_textureCache->updateResidency();
+	g_textureCache->processPendingTextures((size_t)g_jobSystem->getNumThreads());
+
 #if defined(USE_LIGHT_BAKER)
 	light_baker::Update(s_main->frameNo);
 #endif
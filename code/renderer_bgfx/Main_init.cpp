@@ -48,6 +48,8 @@ static const std::array<const BackendMap, 5> s_backendMaps =
 
 void ConsoleVariables::initialize()
 {
+	asyncTextureDecode = interface::Cvar_Get("r_asyncTextureDecode", "1", ConsoleVariableFlags::Archive);
+	asyncTextureDecode.setDescription("Decode textures on worker threads. Textures use the default texture until they have been decoded.");
 	backend = interface::Cvar_Get("r_backend", "", ConsoleVariableFlags::Archive | ConsoleVariableFlags::Latch);
 
 	{
@@ -93,6 +95,10 @@ void ConsoleVariables::initialize()
 	debugDrawSize = interface::Cvar_Get("r_debugDrawSize", "256", ConsoleVariableFlags::Archive);
 	dynamicLightIntensity = interface::Cvar_Get("r_dynamicLightIntensity", "1", ConsoleVariableFlags::Archive);
 	dynamicLightScale = interface::Cvar_Get("r_dynamicLightScale", "0.7", ConsoleVariableFlags::Archive);
+	lodCurveError = interface::Cvar_Get("r_lodCurveError", "250", ConsoleVariableFlags::Archive | ConsoleVariableFlags::Cheat);
+	lodCurveError.setDescription("Curved surface level of detail. Higher values keep more detail at a distance. 0 always uses full detail.");
+	materialCache = interface::Cvar_Get("r_materialCache", "1", ConsoleVariableFlags::Archive);
+	materialCache.setDescription("Cache the combined shader file text to disk, so the renderer starts faster the next time.");
 	picmip = interface::Cvar_Get("r_picmip", "0", ConsoleVariableFlags::Archive | ConsoleVariableFlags::Latch);
 	picmip.checkRange(0, 16, true);
 	railWidth = interface::Cvar_Get("r_railWidth", "16", ConsoleVariableFlags::Archive);
@@ -102,9 +108,17 @@ void ConsoleVariables::initialize()
 	shadowDepthBias = interface::Cvar_Get("r_shadowDepthBias", "0", ConsoleVariableFlags::Archive);
 	shadowNormalBias = interface::Cvar_Get("r_shadowNormalBias", "1", ConsoleVariableFlags::Archive);
 	shadowSlopeScaleDepthBias = interface::Cvar_Get("r_shadowSlopeScaleDepthBias", "0", ConsoleVariableFlags::Archive);
+	skyboxPortalCubemapRate = interface::Cvar_Get("r_skyboxPortalCubemapRate", "0", ConsoleVariableFlags::Archive);
+	skyboxPortalCubemapRate.setDescription("Render skybox portal scenes to the faces of a cube this many times per second, and draw them as the sky box. 0 renders skybox portal scenes every frame.");
 	sunLightIntensity = interface::Cvar_Get("r_sunLightIntensity", "1", ConsoleVariableFlags::Archive);
+	textureBudget = interface::Cvar_Get("r_textureBudget", "0", ConsoleVariableFlags::Archive);
+	textureBudget.setDescription("Texture memory budget in megabytes. When exceeded, textures that haven't been used recently have their top mips dropped, then are evicted. 0 is unlimited.");
+	textureCompression = interface::Cvar_Get("r_textureCompression", "0", ConsoleVariableFlags::Archive);
+	textureCompression.setDescription("Block compress mipmapped textures to BC1/BC3. Compressed textures are cached in the cache/textures directory.");
 	textureVariation = interface::Cvar_Get("r_textureVariation", "0", ConsoleVariableFlags::Archive);
 	wireframe = interface::Cvar_Get("r_wireframe", "0", ConsoleVariableFlags::Cheat);
+	worldCache = interface::Cvar_Get("r_worldCache", "1", ConsoleVariableFlags::Archive);
+	worldCache.setDescription("Cache processed world geometry and lightmaps to disk, so maps load faster the next time.");
 
 	// Gamma
 	gamma = interface::Cvar_Get("r_gamma", "1", ConsoleVariableFlags::Archive);
@@ -212,6 +226,21 @@ static void Cmd_BakeLights()
 }
 #endif
 
+static void Cmd_BenchVisibility()
+{
+	if (!world::IsLoaded())
+		return;
+
+	int nIterations = 100;
+
+	if (interface::Cmd_Argc() > 1)
+	{
+		nIterations = std::max(1, atoi(interface::Cmd_Argv(1)));
+	}
+
+	world::BenchmarkVisibility(nIterations);
+}
+
 static void Cmd_CaptureFrame()
 {
 	s_main->captureFrame = true;
@@ -246,6 +275,12 @@ static void Cmd_ScreenshotPNG()
 	TakeScreenshot("png");
 }
 
+static void Cmd_TextureStats()
+{
+	if (g_textureCache)
+		g_textureCache->printStats();
+}
+
 struct ShaderProgramIdMap
 {
 	FragmentShaderId::Enum frag;
@@ -281,6 +316,10 @@ void Initialize()
 	s_main->sunLightEnabled = sunLight.getBool();
 	ConsoleVariable waterReflections = interface::Cvar_Get("r_waterReflections", "0", ConsoleVariableFlags::Archive | ConsoleVariableFlags::Latch);
 	s_main->waterReflectionsEnabled = waterReflections.getBool();
+	ConsoleVariable workerThreads = interface::Cvar_Get("r_workerThreads", "0", ConsoleVariableFlags::Archive | ConsoleVariableFlags::Latch);
+	workerThreads.setDescription("Number of worker threads used for loading and other CPU work. 0 means one less than the number of CPU cores.");
+	s_main->jobSystem = std::make_unique<JobSystem>(workerThreads.getInt() > 0 ? workerThreads.getInt() : std::max(SDL_GetCPUCount() - 1, 0));
+	g_jobSystem = s_main->jobSystem.get();
 
 	if (s_main->fastPathEnabled)
 	{
@@ -298,9 +337,11 @@ void Initialize()
 #if defined(USE_LIGHT_BAKER)
 	interface::Cmd_Add("r_bakeLights", Cmd_BakeLights);
 #endif
+	interface::Cmd_Add("r_benchVisibility", Cmd_BenchVisibility);
 	interface::Cmd_Add("r_captureFrame", Cmd_CaptureFrame);
 	interface::Cmd_Add("r_pickMaterial", Cmd_PickMaterial);
 	interface::Cmd_Add("r_printMaterials", Cmd_PrintMaterials);
+	interface::Cmd_Add("r_textureStats", Cmd_TextureStats);
 	interface::Cmd_Add("screenshot", Cmd_Screenshot);
 	interface::Cmd_Add("screenshotJPEG", Cmd_ScreenshotJPEG);
 	interface::Cmd_Add("screenshotPNG", Cmd_ScreenshotPNG);
@@ -416,6 +457,10 @@ void Initialize()
 	{
 		interface::Error("R16U texture format not supported");
 	}
+	if ((caps->formats[bgfx::TextureFormat::R32U] & BGFX_CAPS_FORMAT_TEXTURE_2D) == 0)
+	{
+		interface::Error("R32U texture format not supported");
+	}
 
 	s_main->debugDraw = DebugDrawFromString(g_cvars.debugDraw.getString());
 	s_main->halfTexelOffset = caps->rendererType == bgfx::RendererType::Direct3D9 ? 0.5f : 0;
@@ -637,12 +682,16 @@ void Shutdown(bool destroyWindow)
 	interface::Cmd_Remove("r_bakeLights");
 #endif
 	world::Unload();
+	Sky_Shutdown();
+	interface::Cmd_Remove("r_benchVisibility");
 	interface::Cmd_Remove("r_captureFrame");
 	interface::Cmd_Remove("r_pickMaterial");
 	interface::Cmd_Remove("r_printMaterials");
+	interface::Cmd_Remove("r_textureStats");
 	interface::Cmd_Remove("screenshot");
 	interface::Cmd_Remove("screenshotJPEG");
 	interface::Cmd_Remove("screenshotPNG");
+	g_jobSystem = nullptr;
 	g_materialCache = nullptr;
 	g_modelCache = nullptr;
 	g_textureCache = nullptr;
@@ -48,6 +48,7 @@ If you have questions concerning this license or the applicable additional terms
 */
 #include "Precompiled.h"
 #pragma hdrstop
+#include "bx/hash.h"
 
 namespace renderer {
 
@@ -55,7 +56,7 @@ namespace renderer {
 static const char *CommaParse(char **data_p)
 {
 	char *data = *data_p;
-	static char com_token[MAX_TOKEN_CHARS];
+	static thread_local char com_token[MAX_TOKEN_CHARS];
 	com_token[0] = 0;
 
 	// make sure incoming data is valid
@@ -427,6 +428,106 @@ Material *MaterialCache::findMaterial(const char *name, int lightmapIndex, bool
 	return createMaterial(m);
 }
 
+void MaterialCache::precompileMaterials(const std::vector<PrecompileRequest> &requests)
+{
+	struct Precompile
+	{
+		std::unique_ptr<Material> material;
+		char *text;
+		Material::DeferredParse deferredParse;
+		bool parsed = false;
+	};
+
+	std::vector<Precompile> precompiles;
+	std::set<std::pair<std::string, int>> requested;
+
+	for (const PrecompileRequest &request : requests)
+	{
+		char strippedName[MAX_QPATH];
+		util::StripExtension(request.name, strippedName, sizeof(strippedName));
+
+		char key[MAX_QPATH];
+		util::Strncpyz(key, strippedName, sizeof(key));
+
+		if (!requested.insert(std::make_pair(std::string(util::ToLowerCase(key)), request.lightmapIndex)).second)
+			continue;
+
+		// Same test as findMaterial.
+		size_t hash = generateHash(strippedName, hashTableSize_);
+		bool exists = false;
+
+		for (Material *m = hashTable_[hash]; m; m = m->next)
+		{
+			if ((m->lightmapIndex == request.lightmapIndex || m->defaultShader) && !util::Stricmp(m->name, strippedName))
+			{
+				exists = true;
+				break;
+			}
+		}
+
+		if (exists)
+			continue;
+
+		char *text = findShaderInShaderText(strippedName);
+
+		if (!text)
+			continue;
+
+		Precompile precompile;
+		precompile.material = std::make_unique<Material>(strippedName);
+		precompile.material->lightmapIndex = request.lightmapIndex;
+		precompile.text = text;
+		precompiles.push_back(std::move(precompile));
+	}
+
+	g_jobSystem->parallelFor(precompiles.size(), 4, [&precompiles](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			Precompile &precompile = precompiles[i];
+			precompile.material->deferredParse_ = &precompile.deferredParse;
+			precompile.parsed = precompile.material->parse(&precompile.text);
+			precompile.material->deferredParse_ = nullptr;
+		}
+	});
+
+	// Resolve textures and create the materials on the main thread, in request order.
+	size_t nCreated = 0;
+
+	for (Precompile &precompile : precompiles)
+	{
+		bool valid = !precompile.deferredParse.requiresMainThread;
+
+		for (const Material::DeferredParse::TextureLookup &lookup : precompile.deferredParse.textureLookups)
+		{
+			if (!valid)
+				break;
+
+			*lookup.slot = g_textureCache->find(lookup.name.c_str(), lookup.flags);
+			valid = *lookup.slot != nullptr;
+		}
+
+		// Missing textures and parse warnings are reported by findMaterial parsing again.
+		if (!valid)
+			continue;
+
+		for (const std::string &warning : precompile.deferredParse.warnings)
+		{
+			interface::PrintWarningf("%s", warning.c_str());
+		}
+
+		if (!precompile.parsed)
+		{
+			precompile.material->defaultShader = true;
+		}
+
+		createMaterial(*precompile.material);
+		nCreated++;
+	}
+
+	interface::PrintDeveloperf("Precompiled %u of %u materials\n", (uint32_t)nCreated, (uint32_t)precompiles.size());
+}
+
 void MaterialCache::remapMaterial(const char *oldName, const char *newName, const char *offsetTime)
 {
 	Material *materials[2];
@@ -578,6 +679,75 @@ void MaterialCache::createInternalShaders()
 	defaultMaterial_ = createMaterial(m);
 }
 
+/// @brief Bump this whenever the compiled shader text format or util::Compress output changes.
+static const uint32_t s_shaderCacheVersion = 1;
+
+static const char s_shaderCacheId[4] = { 'R', 'B', 'S', 'C' };
+
+static const char *s_shaderCacheFilename = "cache/shaders.materialcache";
+
+/// @brief Compiled shader text: the combined, compressed text of all the shader files, and the offsets of the shader names in it, grouped by text hash table bucket.
+/// @remarks Followed by bucket sizes, name offsets and text.
+struct MaterialCache::ShaderTextCacheHeader
+{
+	char id[4];
+	uint32_t version;
+
+	/// @name Key
+	/// @{
+	uint32_t hash;
+	uint32_t nFiles;
+	uint32_t filesLength;
+	/// @}
+
+	uint32_t nBuckets;
+	uint32_t nShaders;
+	uint32_t textLength;
+};
+
+/// Do a simple check on the shader structure in that file to make sure one bad shader file cannot fuck up all other shaders.
+static void CheckShaderFile(const char *filename, char *buffer)
+{
+	char *p = buffer;
+	util::Tokenizer tokenizer;
+	tokenizer.beginParseSession(filename);
+
+	while(1)
+	{
+		char *oldP = p;
+		char *token = tokenizer.parse(&p, true);
+		
+		if (!*token)
+			break;
+
+		char shaderName[MAX_QPATH];
+		util::Strncpyz(shaderName, token, sizeof(shaderName));
+		int shaderLine = tokenizer.getCurrentParseLine();
+		token = tokenizer.parse(&p, true);
+
+		if (token[0] != '{' || token[1] != '\0')
+		{
+			interface::PrintWarningf("WARNING: Shader file %s. Shader \"%s\" on line %d missing opening brace", filename, shaderName, shaderLine);
+
+			if (token[0])
+			{
+				interface::PrintWarningf(" (found \"%s\" on line %d)", token, tokenizer.getCurrentParseLine());
+			}
+
+			interface::PrintWarningf(". Ignoring rest of shader file.\n");
+			*oldP = 0;
+			break;
+		}
+
+		if (!tokenizer.skipBracedSection(&p, 1))
+		{
+			interface::PrintWarningf("WARNING: Shader file %s. Shader \"%s\" on line %d missing closing brace. Ignoring rest of shader file.\n", filename, shaderName, shaderLine);
+			*oldP = 0;
+			break;
+		}
+	}
+}
+
 void MaterialCache::scanAndLoadShaderFiles()
 {
 	// scan for shader files
@@ -592,9 +762,12 @@ void MaterialCache::scanAndLoadShaderFiles()
 
 	numShaderFiles = std::min(numShaderFiles, (int)maxShaderFiles_);
 
-	// load and parse shader files
+	// load shader files, hashing their names and contents to key the compiled shader text cache
 	char *buffers[maxShaderFiles_] = {NULL};
+	std::vector<std::string> filenames(numShaderFiles);
 	long sum = 0;
+	bx::HashMurmur2A hash;
+	hash.begin();
 
 	for (int i = 0; i < numShaderFiles; i++)
 	{
@@ -622,50 +795,34 @@ void MaterialCache::scanAndLoadShaderFiles()
 		
 		if (!buffers[i])
 			interface::Error("Couldn't load %s", filename);
-		
-		// Do a simple check on the shader structure in that file to make sure one bad shader file cannot fuck up all other shaders.
-		char *p = buffers[i];
-		util::BeginParseSession(filename);
 
-		while(1)
-		{
-			char *oldP = p;
-			char *token = util::Parse(&p, true);
-			
-			if (!*token)
-				break;
-
-			char shaderName[MAX_QPATH];
-			util::Strncpyz(shaderName, token, sizeof(shaderName));
-			int shaderLine = util::GetCurrentParseLine();
-			token = util::Parse(&p, true);
-
-			if (token[0] != '{' || token[1] != '\0')
-			{
-				interface::PrintWarningf("WARNING: Shader file %s. Shader \"%s\" on line %d missing opening brace", filename, shaderName, shaderLine);
+		filenames[i] = filename;
+		hash.add(filename, (int)strlen(filename));
+		hash.add((uint32_t)summand);
+		hash.add(buffers[i], (int)summand);
+		sum += summand;		
+	}
 
-				if (token[0])
-				{
-					interface::PrintWarningf(" (found \"%s\" on line %d)", token, util::GetCurrentParseLine());
-				}
+	// free up memory
+	interface::FS_FreeListFiles(shaderFiles);
+	ShaderTextCacheHeader key = {};
+	key.hash = hash.end();
+	key.nFiles = (uint32_t)numShaderFiles;
+	key.filesLength = (uint32_t)sum;
+	const bool useCache = g_cvars.materialCache.getBool();
 
-				interface::PrintWarningf(". Ignoring rest of shader file.\n");
-				*oldP = 0;
-				break;
-			}
+	if (useCache && readShaderTextCache(key))
+	{
+		for (int i = 0; i < numShaderFiles; i++)
+			interface::FS_FreeReadFile((uint8_t *)buffers[i]);
 
-			if (!util::SkipBracedSection(&p, 1))
-			{
-				interface::PrintWarningf("WARNING: Shader file %s. Shader \"%s\" on line %d missing closing brace. Ignoring rest of shader file.\n", filename, shaderName, shaderLine);
-				*oldP = 0;
-				break;
-			}
-		}
-			
-		if (buffers[i])
-			sum += summand;		
+		interface::PrintDeveloperf("Loaded shader text cache %s\n", s_shaderCacheFilename);
+		return;
 	}
 
+	for (int i = 0; i < numShaderFiles; i++)
+		CheckShaderFile(filenames[i].c_str(), buffers[i]);
+
 	// build single large buffer
 	shaderText_.resize(sum + numShaderFiles * 2);
 	shaderText_[0] = '\0';
@@ -685,53 +842,139 @@ void MaterialCache::scanAndLoadShaderFiles()
 
 	util::Compress(shaderText_.data());
 
-	// free up memory
-	interface::FS_FreeListFiles(shaderFiles);
-
 	// look for shader names
-	int textHashTable_Sizes[textHashTableSize_];
-	memset(textHashTable_Sizes, 0, sizeof(textHashTable_Sizes));
-	int size = 0;
+	std::vector<uint32_t> bucketSizes(textHashTableSize_);
+	std::vector<uint32_t> nameOffsets, nameBuckets;
+	util::Tokenizer tokenizer;
 	char *p = shaderText_.data();
 
 	while (1)
 	{
-		char *token = util::Parse(&p, true);
+		char *oldp = p;
+		char *token = tokenizer.parse(&p, true);
 
 		if (token[0] == 0)
 			break;
 
-		size_t hash = generateHash(token, textHashTableSize_);
-		textHashTable_Sizes[hash]++;
-		size++;
-		util::SkipBracedSection(&p, 0);
+		const size_t bucket = generateHash(token, textHashTableSize_);
+		bucketSizes[bucket]++;
+		nameOffsets.push_back(uint32_t(oldp - shaderText_.data()));
+		nameBuckets.push_back((uint32_t)bucket);
+		tokenizer.skipBracedSection(&p, 0);
 	}
 
-	size += textHashTableSize_;
-	auto hashMem = (char *)interface::Hunk_Alloc(size * sizeof(char *));
+	// group the name offsets by bucket, preserving text order within each bucket
+	std::vector<uint32_t> bucketStart(textHashTableSize_);
+
+	for (size_t i = 1; i < textHashTableSize_; i++)
+		bucketStart[i] = bucketStart[i - 1] + bucketSizes[i - 1];
 
-	for (int i = 0; i < textHashTableSize_; i++)
+	std::vector<uint32_t> sortedOffsets(nameOffsets.size());
+
+	for (size_t i = 0; i < nameOffsets.size(); i++)
+		sortedOffsets[bucketStart[nameBuckets[i]]++] = nameOffsets[i];
+
+	createTextHashTable(bucketSizes.data(), sortedOffsets.data());
+
+	if (useCache)
+		writeShaderTextCache(key, bucketSizes, sortedOffsets);
+}
+
+void MaterialCache::createTextHashTable(const uint32_t *bucketSizes, const uint32_t *nameOffsets)
+{
+	size_t size = textHashTableSize_;
+
+	for (size_t i = 0; i < textHashTableSize_; i++)
+		size += bucketSizes[i];
+
+	auto hashMem = (char **)interface::Hunk_Alloc(int(size * sizeof(char *)));
+
+	for (size_t i = 0; i < textHashTableSize_; i++)
 	{
-		textHashTable_[i] = (char **) hashMem;
-		hashMem = ((char *) hashMem) + ((textHashTable_Sizes[i] + 1) * sizeof(char *));
+		textHashTable_[i] = hashMem;
+
+		for (uint32_t j = 0; j < bucketSizes[i]; j++)
+			textHashTable_[i][j] = shaderText_.data() + *nameOffsets++;
+
+		textHashTable_[i][bucketSizes[i]] = nullptr;
+		hashMem += bucketSizes[i] + 1;
 	}
+}
 
-	// look for shader names
-	memset(textHashTable_Sizes, 0, sizeof(textHashTable_Sizes));
-	p = shaderText_.data();
+bool MaterialCache::readShaderTextCache(const ShaderTextCacheHeader &key)
+{
+	ReadOnlyFile file(s_shaderCacheFilename);
 
-	while (1)
+	if (!file.isValid() || file.getLength() < sizeof(ShaderTextCacheHeader))
+		return false;
+
+	ShaderTextCacheHeader header;
+	memcpy(&header, file.getData(), sizeof(header));
+
+	if (memcmp(header.id, s_shaderCacheId, sizeof(s_shaderCacheId)) != 0 || header.version != s_shaderCacheVersion || header.hash != key.hash || header.nFiles != key.nFiles || header.filesLength != key.filesLength || header.nBuckets != textHashTableSize_)
+		return false;
+
+	const size_t expectedLength = sizeof(header) + (header.nBuckets + header.nShaders) * sizeof(uint32_t) + header.textLength;
+
+	if (file.getLength() != expectedLength || header.textLength == 0)
 	{
-		char *oldp = p;
-		char *token = util::Parse(&p, true);
+		interface::PrintWarningf("WARNING: shader text cache %s is corrupt\n", s_shaderCacheFilename);
+		return false;
+	}
 
-		if (token[0] == 0)
-			break;
+	std::vector<uint32_t> bucketSizes(header.nBuckets), nameOffsets(header.nShaders);
+	const uint8_t *data = file.getData() + sizeof(header);
+	memcpy(bucketSizes.data(), data, bucketSizes.size() * sizeof(uint32_t));
+	data += bucketSizes.size() * sizeof(uint32_t);
+
+	if (header.nShaders > 0)
+		memcpy(nameOffsets.data(), data, nameOffsets.size() * sizeof(uint32_t));
+
+	data += nameOffsets.size() * sizeof(uint32_t);
+	size_t nShaders = 0;
 
-		size_t hash = generateHash(token, textHashTableSize_);
-		textHashTable_[hash][textHashTable_Sizes[hash]++] = oldp;
-		util::SkipBracedSection(&p, 0);
+	for (uint32_t bucketSize : bucketSizes)
+		nShaders += bucketSize;
+
+	bool valid = nShaders == header.nShaders && data[header.textLength - 1] == '\0';
+
+	for (uint32_t offset : nameOffsets)
+		valid = valid && offset < header.textLength;
+
+	if (!valid)
+	{
+		interface::PrintWarningf("WARNING: shader text cache %s is corrupt\n", s_shaderCacheFilename);
+		return false;
 	}
+
+	shaderText_.assign((const char *)data, (const char *)data + header.textLength);
+	createTextHashTable(bucketSizes.data(), nameOffsets.data());
+	return true;
+}
+
+void MaterialCache::writeShaderTextCache(const ShaderTextCacheHeader &key, const std::vector<uint32_t> &bucketSizes, const std::vector<uint32_t> &nameOffsets) const
+{
+	// Only store the compressed text, not the slack left by util::Compress.
+	ShaderTextCacheHeader header = key;
+	memcpy(header.id, s_shaderCacheId, sizeof(s_shaderCacheId));
+	header.version = s_shaderCacheVersion;
+	header.nBuckets = (uint32_t)bucketSizes.size();
+	header.nShaders = (uint32_t)nameOffsets.size();
+	header.textLength = (uint32_t)strlen(shaderText_.data()) + 1;
+	std::vector<uint8_t> buffer(sizeof(header) + (header.nBuckets + header.nShaders) * sizeof(uint32_t) + header.textLength);
+	uint8_t *data = buffer.data();
+	memcpy(data, &header, sizeof(header));
+	data += sizeof(header);
+	memcpy(data, bucketSizes.data(), bucketSizes.size() * sizeof(uint32_t));
+	data += bucketSizes.size() * sizeof(uint32_t);
+
+	if (!nameOffsets.empty())
+		memcpy(data, nameOffsets.data(), nameOffsets.size() * sizeof(uint32_t));
+
+	data += nameOffsets.size() * sizeof(uint32_t);
+	memcpy(data, shaderText_.data(), header.textLength);
+	interface::FS_WriteFile(s_shaderCacheFilename, buffer.data(), buffer.size());
+	interface::PrintDeveloperf("Wrote shader text cache %s\n", s_shaderCacheFilename);
 }
 
 void MaterialCache::createExternalShaders()
@@ -741,13 +984,14 @@ void MaterialCache::createExternalShaders()
 char *MaterialCache::findShaderInShaderText(const char *name)
 {
 	size_t hash = generateHash(name, textHashTableSize_);
+	util::Tokenizer tokenizer;
 
 	if (textHashTable_[hash])
 	{
 		for (size_t i = 0; textHashTable_[hash][i]; i++)
 		{
 			char *p = textHashTable_[hash][i];
-			char *token = util::Parse(&p, true);
+			char *token = tokenizer.parse(&p, true);
 		
 			if (!util::Stricmp(token, name))
 				return p;
@@ -762,7 +1006,7 @@ char *MaterialCache::findShaderInShaderText(const char *name)
 	// look for label
 	for (;;)
 	{
-		char *token = util::Parse(&p, true);
+		char *token = tokenizer.parse(&p, true);
 
 		if (token[0] == 0)
 			break;
@@ -771,7 +1015,7 @@ char *MaterialCache::findShaderInShaderText(const char *name)
 			return p;
 		
 		// skip the definition
-		util::SkipBracedSection(&p, 0);
+		tokenizer.skipBracedSection(&p, 0);
 	}
 
 	return NULL;
@@ -165,6 +165,7 @@ void MaterialStage::setTextureSamplers(Uniforms_MaterialStage *uniforms) const
 
 	if (diffuseBundle.numImageAnimations <= 1)
 	{
+		g_textureCache->markUsed(diffuseBundle.textures[0]);
 		bgfx::setTexture(TextureUnit::Diffuse, uniforms->diffuseSampler.handle, diffuseBundle.textures[0]->getHandle());
 
 #ifdef _DEBUG
@@ -175,10 +176,12 @@ void MaterialStage::setTextureSamplers(Uniforms_MaterialStage *uniforms) const
 	{
 		int frame, nextFrame;
 		calculateTextureAnimation(&frame, &nextFrame, nullptr);
+		g_textureCache->markUsed(diffuseBundle.textures[frame]);
 		bgfx::setTexture(TextureUnit::Diffuse, uniforms->diffuseSampler.handle, diffuseBundle.textures[frame]->getHandle());
 
 		if (shouldLerpTextureAnimation())
 		{
+			g_textureCache->markUsed(diffuseBundle.textures[nextFrame]);
 			bgfx::setTexture(TextureUnit::Diffuse2, uniforms->diffuseSampler2.handle, diffuseBundle.textures[nextFrame]->getHandle());
 		}
 #ifdef _DEBUG
@@ -194,6 +197,7 @@ void MaterialStage::setTextureSamplers(Uniforms_MaterialStage *uniforms) const
 
 	if (lightmap)
 	{
+		g_textureCache->markUsed(lightmap);
 		bgfx::setTexture(TextureUnit::Light, uniforms->lightSampler.handle, lightmap->getHandle());
 	}
 #ifdef _DEBUG
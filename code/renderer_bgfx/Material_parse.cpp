@@ -137,11 +137,12 @@ static infoParm_t infoParms[] =
 
 bool Material::parse(char **text)
 {
-	char *token = util::Parse(text, true);
+	util::Tokenizer tokenizer;
+	char *token = tokenizer.parse(text, true);
 
 	if (token[0] != '{')
 	{
-		interface::PrintWarningf("'%s': expecting '{', found '%s' instead\n", name, token);
+		printWarningf("'%s': expecting '{', found '%s' instead\n", name, token);
 		return false;
 	}
 
@@ -149,11 +150,11 @@ bool Material::parse(char **text)
 
 	for (;;)
 	{
-		token = util::Parse(text, true);
+		token = tokenizer.parse(text, true);
 
 		if (!token[0])
 		{
-			interface::PrintWarningf("'%s': no concluding '}'\n", name);
+			printWarningf("'%s': no concluding '}'\n", name);
 			return false;
 		}
 
@@ -167,11 +168,11 @@ bool Material::parse(char **text)
 		{
 			if (stageIndex >= maxStages)
 			{
-				interface::PrintWarningf("'%s': too many stages (max is %i)\n", name, (int)maxStages);
+				printWarningf("'%s': too many stages (max is %i)\n", name, (int)maxStages);
 				return false;
 			}
 
-			if (!parseStage(&stages[stageIndex], text))
+			if (!parseStage(tokenizer, &stages[stageIndex], text))
 				return false;
 
 			stages[stageIndex].active = true;
@@ -180,11 +181,14 @@ bool Material::parse(char **text)
 		// skip stuff that only the QuakeEdRadient needs
 		else if (!util::Stricmpn(token, "qer", 3))
 		{
-			util::SkipRestOfLine(text);
+			tokenizer.skipRestOfLine(text);
 		}
 		// sun parms
 		else if (!util::Stricmp(token, "q3map_sun") || !util::Stricmp(token, "q3map_sunExt") || !util::Stricmp(token, "q3gl2_sun"))
 		{
+			if (!requireMainThread())
+				return false;
+
 			SunLight sun;
 
 			if (!util::Stricmp(token, "q3gl2_sun"))
@@ -192,21 +196,21 @@ bool Material::parse(char **text)
 				sun.shadows = true;
 			}
 
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 			sun.light[0] = (float)atof(token);
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 			sun.light[1] = (float)atof(token);
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 			sun.light[2] = (float)atof(token);
 			
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 			sun.light.normalize();
 			sun.light = sun.light * (float)atof(token) * g_overbrightFactor / 255.0f;
 
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 			float a = (float)atof(token) / 180 * (float)M_PI;
 
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 			float b = (float)atof(token) / 180 * (float)M_PI;
 
 			sun.direction[0] = cos(a) * cos(b);
@@ -216,15 +220,15 @@ bool Material::parse(char **text)
 
 			if (sun.shadows)
 			{
-				token = util::Parse(text, false);
+				token = tokenizer.parse(text, false);
 				sun.lightScale = (float)atof(token);
 
-				token = util::Parse(text, false);
+				token = tokenizer.parse(text, false);
 				sun.shadowScale = (float)atof(token);
 			}
 
 			main::SetSunLight(sun);
-			util::SkipRestOfLine(text);
+			tokenizer.skipRestOfLine(text);
 		}
 		// tonemap parms
 		else if (!util::Stricmp(token, "q3gl2_tonemap"))
@@ -232,38 +236,38 @@ bool Material::parse(char **text)
 			vec2 autoExposureMinMax = { -2, 2 };
 			vec3 toneMinAvgMaxLevel = { -8, -2, 0 };
 
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 			toneMinAvgMaxLevel[0] = (float)atof(token);
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 			toneMinAvgMaxLevel[1] = (float)atof(token);
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 			toneMinAvgMaxLevel[2] = (float)atof(token);
 
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 			autoExposureMinMax[0] = (float)atof(token);
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 			autoExposureMinMax[1] = (float)atof(token);
 
-			util::SkipRestOfLine(text);
+			tokenizer.skipRestOfLine(text);
 		}
 		else if (!util::Stricmp(token, "deformVertexes"))
 		{
 			if (numDeforms == maxDeforms)
 			{
-				interface::PrintWarningf("'%s': max deforms\n", name);
+				printWarningf("'%s': max deforms\n", name);
 				continue;
 			}
 
-			deforms[numDeforms] = parseDeform(text);
+			deforms[numDeforms] = parseDeform(tokenizer, text);
 			numDeforms++;
 		}
 		else if (!util::Stricmp(token, "tesssize"))
 		{
-			util::SkipRestOfLine(text);
+			tokenizer.skipRestOfLine(text);
 		}
 		else if (!util::Stricmp(token, "clampTime")) 
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0])
 			{
@@ -272,19 +276,19 @@ bool Material::parse(char **text)
 		}
 		else if (!util::Stricmp(token, "q3map_surfacelight"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 			surfaceLight = (float)atof(token);
 		}
 		// skip stuff that only the q3map needs
 		else if (!util::Stricmpn(token, "q3map", 5))
 		{
-			util::SkipRestOfLine(text);
+			tokenizer.skipRestOfLine(text);
 		}
 		// skip stuff that only q3map or the server needs
 		else if (!util::Stricmp(token, "surfaceParm"))
 		{
 			const size_t nInfoParms = BX_COUNTOF(infoParms);
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			for (size_t i = 0; i < nInfoParms; i++)
 			{
@@ -328,23 +332,23 @@ bool Material::parse(char **text)
 		else if (!util::Stricmp(token, "fogParms"))
 		{
 			bool parsedColor;
-			fogParms.color = parseVector(text, &parsedColor);
+			fogParms.color = parseVector(tokenizer, text, &parsedColor);
 
 			if (!parsedColor)
 				return false;
 
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (!token[0]) 
 			{
-				interface::PrintWarningf("'%s': missing fogParms 'distance to opaque'\n", name);
+				printWarningf("'%s': missing fogParms 'distance to opaque'\n", name);
 				continue;
 			}
 
 			fogParms.depthForOpaque = (float)atof(token);
 
 			// skip any old gradient directions
-			util::SkipRestOfLine(text);
+			tokenizer.skipRestOfLine(text);
 		}
 		// portal
 		else if (!util::Stricmp(token, "portal"))
@@ -355,7 +359,10 @@ bool Material::parse(char **text)
 		// skyparms <cloudheight> <outerbox> <innerbox>
 		else if (!util::Stricmp(token, "skyparms"))
 		{
-			parseSkyParms(text);
+			if (!requireMainThread())
+				return false;
+
+			parseSkyParms(tokenizer, text);
 		}
 		// This is fixed fog for the skybox/clouds determined solely by the shader
 		// it will not change in a level and will not be necessary
@@ -364,22 +371,22 @@ bool Material::parse(char **text)
 		else if (!util::Stricmp(token, "skyfogvars"))
 		{
 			bool parsedFogColor;
-			vec3 fogColor = parseVector(text, &parsedFogColor);
+			vec3 fogColor = parseVector(tokenizer, text, &parsedFogColor);
 
 			if (!parsedFogColor)
 				return false;
 
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (!token[0])
 			{
-				interface::PrintWarningf("'%s': missing density value for sky fog\n", name);
+				printWarningf("'%s': missing density value for sky fog\n", name);
 				continue;
 			}
 
 			if (atof(token) > 1)
 			{
-				interface::PrintWarningf("'%s': last value for skyfogvars is 'density' which needs to be 0.0-1.0\n", name);
+				printWarningf("'%s': last value for skyfogvars is 'density' which needs to be 0.0-1.0\n", name);
 				continue;
 			}
 
@@ -388,11 +395,11 @@ bool Material::parse(char **text)
 		}
 		else if (!util::Stricmp(token, "sunshader"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (!token[0])
 			{
-				interface::PrintWarningf("'%s': missing shader name for 'sunshader'\n", name);
+				printWarningf("'%s': missing shader name for 'sunshader'\n", name);
 				continue;
 			}
 
@@ -402,11 +409,11 @@ bool Material::parse(char **text)
 		// ambient multiplier for lightgrid
 		else if (!util::Stricmp(token, "lightgridmulamb"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (!token[0])
 			{
-				interface::PrintWarningf("'%s': missing value for 'lightgrid ambient multiplier'\n", name);
+				printWarningf("'%s': missing value for 'lightgrid ambient multiplier'\n", name);
 				continue;
 			}
 
@@ -418,11 +425,11 @@ bool Material::parse(char **text)
 		// directional multiplier for lightgrid
 		else if (!util::Stricmp(token, "lightgridmuldir"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (!token[0])
 			{
-				interface::PrintWarningf("'%s': missing value for 'lightgrid directional multiplier'\n", name);
+				printWarningf("'%s': missing value for 'lightgrid directional multiplier'\n", name);
 				continue;
 			}
 
@@ -434,17 +441,20 @@ bool Material::parse(char **text)
 		//----(SA)	end
 		else if (!util::Stricmp(token, "waterfogvars"))
 		{
+			if (!requireMainThread())
+				return false;
+
 			bool waterParsed;
-			vec3 waterColor = parseVector(text, &waterParsed);
+			vec3 waterColor = parseVector(tokenizer, text, &waterParsed);
 
 			if (!waterParsed)
 				return false;
 
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (!token[0])
 			{
-				interface::PrintWarningf("'%s': missing density/distance value for water fog\n", name);
+				printWarningf("'%s': missing density/distance value for water fog\n", name);
 				continue;
 			}
 
@@ -481,17 +491,20 @@ bool Material::parse(char **text)
 		// fogvars
 		else if (!util::Stricmp(token, "fogvars"))
 		{
+			if (!requireMainThread())
+				return false;
+
 			bool parsedFogColor;
-			vec3 fogColor = parseVector(text, &parsedFogColor);
+			vec3 fogColor = parseVector(tokenizer, text, &parsedFogColor);
 
 			if (!parsedFogColor)
 				return false;
 
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (!token[0])
 			{
-				interface::PrintWarningf("'%s': missing density value for the fog\n", name);
+				printWarningf("'%s': missing density value for the fog\n", name);
 				continue;
 			}
 
@@ -528,16 +541,16 @@ bool Material::parse(char **text)
 		// light <value> determines flaring in q3map, not needed here
 		else if (!util::Stricmp(token, "light")) 
 		{
-			util::Parse(text, false);
+			tokenizer.parse(text, false);
 		}
 		// cull <face>
 		else if (!util::Stricmp(token, "cull")) 
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing cull parms\n", name);
+				printWarningf("'%s': missing cull parms\n", name);
 			}
 			else if (!util::Stricmp(token, "none") || !util::Stricmp(token, "twosided") || !util::Stricmp(token, "disable"))
 			{
@@ -549,17 +562,17 @@ bool Material::parse(char **text)
 			}
 			else
 			{
-				interface::PrintWarningf("'%s': invalid cull parm '%s'\n", name, token);
+				printWarningf("'%s': invalid cull parm '%s'\n", name, token);
 			}
 		}
 		// sort
 		else if (!util::Stricmp(token, "sort"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing sort parameter\n", name);
+				printWarningf("'%s': missing sort parameter\n", name);
 				continue;
 			}
 
@@ -567,7 +580,7 @@ bool Material::parse(char **text)
 		}
 		else
 		{
-			interface::PrintWarningf("'%s': unknown general shader parameter '%s'\n", name, token);
+			printWarningf("'%s': unknown general shader parameter '%s'\n", name, token);
 			return false;
 		}
 	}
@@ -582,16 +595,60 @@ bool Material::parse(char **text)
 	return true;
 }
 
-vec3 Material::parseVector(char **text, bool *result) const
+const Texture *Material::findTexture(const Texture **slot, const char *textureName, int flags)
+{
+	if (!deferredParse_)
+	{
+		*slot = g_textureCache->find(textureName, flags);
+		return *slot;
+	}
+
+	DeferredParse::TextureLookup lookup;
+	lookup.slot = slot;
+	lookup.name = textureName;
+	lookup.flags = flags;
+	deferredParse_->textureLookups.push_back(lookup);
+	*slot = g_textureCache->getDefault();
+	return *slot;
+}
+
+bool Material::requireMainThread()
+{
+	if (!deferredParse_)
+		return true;
+
+	deferredParse_->requiresMainThread = true;
+	return false;
+}
+
+void Material::printWarningf(const char *format, ...) const
+{
+	char text[1024];
+	va_list args;
+	va_start(args, format);
+	util::Vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	if (deferredParse_)
+	{
+		deferredParse_->warnings.push_back(text);
+	}
+	else
+	{
+		interface::PrintWarningf("%s", text);
+	}
+}
+
+vec3 Material::parseVector(util::Tokenizer &tokenizer, char **text, bool *result) const
 {
 	vec3 v;
 
 	// FIXME: spaces are currently required after parens, should change parseext...
-	char *token = util::Parse(text, false);
+	char *token = tokenizer.parse(text, false);
 
 	if (strcmp(token, "("))
 	{
-		interface::PrintWarningf("'%s': missing opening parenthesis\n", name);
+		printWarningf("'%s': missing opening parenthesis\n", name);
 
 		if (result)
 			*result = false;
@@ -601,11 +658,11 @@ vec3 Material::parseVector(char **text, bool *result) const
 
 	for (size_t i = 0; i < 3; i++)
 	{
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (!token[0])
 		{
-			interface::PrintWarningf("'%s': missing vector element\n", name);
+			printWarningf("'%s': missing vector element\n", name);
 
 			if (result)
 				*result = false;
@@ -616,11 +673,11 @@ vec3 Material::parseVector(char **text, bool *result) const
 		v[i] = (float)atof(token);
 	}
 
-	token = util::Parse(text, false);
+	token = tokenizer.parse(text, false);
 
 	if (strcmp(token, ")"))
 	{
-		interface::PrintWarningf("'%s': missing closing parenthesis\n", name);
+		printWarningf("'%s': missing closing parenthesis\n", name);
 
 		if (result)
 			*result = false;
@@ -634,18 +691,18 @@ vec3 Material::parseVector(char **text, bool *result) const
 	return v;
 }
 
-bool Material::parseStage(MaterialStage *stage, char **text)
+bool Material::parseStage(util::Tokenizer &tokenizer, MaterialStage *stage, char **text)
 {
 	bool depthWriteExplicit = false;
 	stage->active = true;
 
 	for (;;)
 	{
-		const char *token = util::Parse(text, true);
+		const char *token = tokenizer.parse(text, true);
 
 		if (!token[0])
 		{
-			interface::PrintWarningf("'%s': no matching '}' found\n", name);
+			printWarningf("'%s': no matching '}' found\n", name);
 			return false;
 		}
 
@@ -656,7 +713,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		// only use this texture if 16 bit color depth
 		if (!util::Stricmp(token, "map16"))
 		{
-			util::Parse(text, false); // ignore the map
+			tokenizer.parse(text, false); // ignore the map
 			continue;
 		}
 		else if (!util::Stricmp(token, "map32"))
@@ -672,7 +729,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			}
 			else*/
 			{
-				util::Parse(text, false);   // ignore the map
+				tokenizer.parse(text, false);   // ignore the map
 				continue;
 			}
 		}
@@ -685,7 +742,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			}
 			/*else
 			{
-				util::Parse(text, false);   // ignore the map
+				tokenizer.parse(text, false);   // ignore the map
 				continue;
 			}*/
 		}
@@ -699,7 +756,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			else*/
 			{
 				while (token[0])
-					util::Parse(text, false);   // ignore the map
+					tokenizer.parse(text, false);   // ignore the map
 
 				continue;
 			}
@@ -714,7 +771,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			/*else
 			{
 				while (token[0])
-					util::Parse(text, false);   // ignore the map
+					tokenizer.parse(text, false);   // ignore the map
 
 				continue;
 			}*/
@@ -723,11 +780,11 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		// map <name>
 		if (!util::Stricmp(token, "map"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (!token[0])
 			{
-				interface::PrintWarningf("'%s': missing parameter for 'map' keyword\n", name);
+				printWarningf("'%s': missing parameter for 'map' keyword\n", name);
 				return false;
 			}
 
@@ -751,7 +808,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			{
 				/*if (!tr.worldDeluxeMapping)
 				{
-					interface::PrintWarningf("'%s': wants a deluxe map in a map compiled without them\n", name);
+					printWarningf("'%s': wants a deluxe map in a map compiled without them\n", name);
 					return false;
 				}*/
 
@@ -777,11 +834,11 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 				if (!noPicMip)
 					flags |= TextureFlags::Picmip;
 
-				stage->bundles[0].textures[0] = g_textureCache->find(token, flags);
+				findTexture(&stage->bundles[0].textures[0], token, flags);
 
 				if (!stage->bundles[0].textures[0])
 				{
-					interface::PrintWarningf("'%s': could not find texture '%s'\n", name, token);
+					printWarningf("'%s': could not find texture '%s'\n", name, token);
 					return false;
 				}
 			}
@@ -791,10 +848,10 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		{
 			int flags = TextureFlags::ClampToEdge;
 
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 			if (!token[0])
 			{
-				interface::PrintWarningf("'%s': missing parameter for 'clampmap' keyword\n", name);
+				printWarningf("'%s': missing parameter for 'clampmap' keyword\n", name);
 				return false;
 			}
 
@@ -804,22 +861,22 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			if (!noPicMip)
 				flags |= TextureFlags::Picmip;
 
-			stage->bundles[0].textures[0] = g_textureCache->find(token, flags);
+			findTexture(&stage->bundles[0].textures[0], token, flags);
 
 			if (!stage->bundles[0].textures[0])
 			{
-				interface::PrintWarningf("'%s': could not find texture '%s'\n", name, token);
+				printWarningf("'%s': could not find texture '%s'\n", name, token);
 				return false;
 			}
 		}
 		// animMap <frequency> <image1> .... <imageN>
 		else if (!util::Stricmp(token, "animMap"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (!token[0])
 			{
-				interface::PrintWarningf("'%s': missing parameter for 'animMap' keyword\n", name);
+				printWarningf("'%s': missing parameter for 'animMap' keyword\n", name);
 				return false;
 			}
 
@@ -828,7 +885,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			// parse up to MaterialTextureBundle::maxImageAnimations animations
 			for (;;)
 			{
-				token = util::Parse(text, false);
+				token = tokenizer.parse(text, false);
 
 				if (!token[0])
 					break;
@@ -845,11 +902,11 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 					if (!noPicMip)
 						flags |= TextureFlags::Picmip;
 
-					stage->bundles[0].textures[num] = g_textureCache->find(token, flags);
+					findTexture(&stage->bundles[0].textures[num], token, flags);
 
 					if (!stage->bundles[0].textures[num])
 					{
-						interface::PrintWarningf("'%s': could not find texture '%s'\n", name, token);
+						printWarningf("'%s': could not find texture '%s'\n", name, token);
 						return false;
 					}
 
@@ -859,11 +916,14 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		}
 		else if (!util::Stricmp(token, "videoMap"))
 		{
-			token = util::Parse(text, false);
+			if (!requireMainThread())
+				return false;
+
+			token = tokenizer.parse(text, false);
 
 			if (!token[0])
 			{
-				interface::PrintWarningf("'%s': missing parameter for 'videoMap' keyword\n", name);
+				printWarningf("'%s': missing parameter for 'videoMap' keyword\n", name);
 				return false;
 			}
 
@@ -878,11 +938,11 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		// alphafunc <func>
 		else if (!util::Stricmp(token, "alphaFunc"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (!token[0])
 			{
-				interface::PrintWarningf("'%s': missing parameter for 'alphaFunc' keyword\n", name);
+				printWarningf("'%s': missing parameter for 'alphaFunc' keyword\n", name);
 				return false;
 			}
 
@@ -891,11 +951,11 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		// depthFunc <func>
 		else if (!util::Stricmp(token, "depthfunc"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (!token[0])
 			{
-				interface::PrintWarningf("'%s': missing parameter for 'depthfunc' keyword\n", name);
+				printWarningf("'%s': missing parameter for 'depthfunc' keyword\n", name);
 				return false;
 			}
 
@@ -909,7 +969,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			}
 			else
 			{
-				interface::PrintWarningf("'%s': unknown depthfunc '%s'\n", name, token);
+				printWarningf("'%s': unknown depthfunc '%s'\n", name, token);
 			}
 		}
 		// detail
@@ -920,11 +980,11 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		// blendfunc <srcFactor> <dstFactor> or blendfunc <add|filter|blend>
 		else if (!util::Stricmp(token, "blendfunc"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing parm for blendFunc\n", name);
+				printWarningf("'%s': missing parm for blendFunc\n", name);
 				continue;
 			}
 
@@ -949,11 +1009,11 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 				// complex double blends
 				stage->blendSrc = srcBlendModeFromName(token);
 
-				token = util::Parse(text, false);
+				token = tokenizer.parse(text, false);
 
 				if (token[0] == 0)
 				{
-					interface::PrintWarningf("'%s': missing parm for blendFunc\n", name);
+					printWarningf("'%s': missing parm for blendFunc\n", name);
 					continue;
 				}
 
@@ -969,11 +1029,11 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		// stage <type>
 		else if (!util::Stricmp(token, "stage"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing parameters for stage\n", name);
+				printWarningf("'%s': missing parameters for stage\n", name);
 			}
 			else if (!util::Stricmp(token, "diffuseMap"))
 			{
@@ -1000,17 +1060,17 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			}
 			else
 			{
-				interface::PrintWarningf("'%s': unknown stage parameter '%s'\n", name, token);
+				printWarningf("'%s': unknown stage parameter '%s'\n", name, token);
 			}
 		}
 		// specularReflectance <value>
 		else if (!util::Stricmp(token, "specularreflectance"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing parameter for specular reflectance\n", name);
+				printWarningf("'%s': missing parameter for specular reflectance\n", name);
 				continue;
 			}
 
@@ -1019,11 +1079,11 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		// specularExponent <value>
 		else if (!util::Stricmp(token, "specularexponent"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing parameter for specular exponent\n", name);
+				printWarningf("'%s': missing parameter for specular exponent\n", name);
 				continue;
 			}
 
@@ -1035,11 +1095,11 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		// gloss <value>
 		else if (!util::Stricmp(token, "gloss"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing parameter for gloss\n", name);
+				printWarningf("'%s': missing parameter for gloss\n", name);
 				continue;
 			}
 
@@ -1048,11 +1108,11 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		// parallaxDepth <value>
 		else if (!util::Stricmp(token, "parallaxdepth"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing parameter for parallaxDepth\n", name);
+				printWarningf("'%s': missing parameter for parallaxDepth\n", name);
 				continue;
 			}
 
@@ -1063,16 +1123,16 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		// or normalScale <x> <y> <height>
 		else if (!util::Stricmp(token, "normalscale"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing parameter for normalScale\n", name);
+				printWarningf("'%s': missing parameter for normalScale\n", name);
 				continue;
 			}
 
 			stage->normalScale.x = (float)atof(token);
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
@@ -1082,7 +1142,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			}
 
 			stage->normalScale.y = (float)atof(token);
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 				continue; // two values, no height
@@ -1094,25 +1154,25 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		// or specularScale <r> <g> <b> <gloss>
 		else if (!util::Stricmp(token, "specularscale"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing parameter for specularScale\n", name);
+				printWarningf("'%s': missing parameter for specularScale\n", name);
 				continue;
 			}
 
 			stage->specularScale.r = (float)atof(token);
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing parameter for specularScale\n", name);
+				printWarningf("'%s': missing parameter for specularScale\n", name);
 				continue;
 			}
 
 			stage->specularScale.g = (float)atof(token);
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
@@ -1124,7 +1184,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			}
 
 			stage->specularScale.b = (float)atof(token);
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
@@ -1138,20 +1198,20 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		// rgbGen
 		else if (!util::Stricmp(token, "rgbGen"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing parameters for rgbGen\n", name);
+				printWarningf("'%s': missing parameters for rgbGen\n", name);
 			}
 			else if (!util::Stricmp(token, "wave"))
 			{
-				stage->rgbWave = parseWaveForm(text);
+				stage->rgbWave = parseWaveForm(tokenizer, text);
 				stage->rgbGen = MaterialColorGen::Waveform;
 			}
 			else if (!util::Stricmp(token, "const"))
 			{
-				stage->constantColor = vec4(parseVector(text), stage->constantColor.a);
+				stage->constantColor = vec4(parseVector(tokenizer, text), stage->constantColor.a);
 				stage->rgbGen = MaterialColorGen::Const;
 			}
 			else if (!util::Stricmp(token, "identity"))
@@ -1202,26 +1262,26 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			}
 			else
 			{
-				interface::PrintWarningf("'%s': unknown rgbGen parameter '%s'\n", name, token);
+				printWarningf("'%s': unknown rgbGen parameter '%s'\n", name, token);
 			}
 		}
 		// alphaGen 
 		else if (!util::Stricmp(token, "alphaGen"))
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing parameters for alphaGen\n", name);
+				printWarningf("'%s': missing parameters for alphaGen\n", name);
 			}
 			else if (!util::Stricmp(token, "wave"))
 			{
-				stage->alphaWave = parseWaveForm(text);
+				stage->alphaWave = parseWaveForm(tokenizer, text);
 				stage->alphaGen = MaterialAlphaGen::Waveform;
 			}
 			else if (!util::Stricmp(token, "const"))
 			{
-				token = util::Parse(text, false);
+				token = tokenizer.parse(text, false);
 				stage->constantColor.a = (float)atof(token);
 				stage->alphaGen = MaterialAlphaGen::Const;
 			}
@@ -1241,7 +1301,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			else if (!util::Stricmp(token, "normalzfade"))
 			{
 				stage->alphaGen = MaterialAlphaGen::NormalZFade;
-				token = util::Parse(text, false);
+				token = tokenizer.parse(text, false);
 
 				if (token[0])
 				{
@@ -1252,12 +1312,12 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 					stage->constantColor[3] = 255;
 				}
 
-				token = util::Parse(text, false);
+				token = tokenizer.parse(text, false);
 
 				if (token[0])
 				{
 					stage->zFadeBounds[0] = (float)atof(token); // lower range
-					token = util::Parse(text, false);
+					token = tokenizer.parse(text, false);
 					stage->zFadeBounds[1] = (float)atof(token); // upper range
 				}
 				else
@@ -1283,11 +1343,11 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			else if (!util::Stricmp(token, "portal"))
 			{
 				stage->alphaGen = MaterialAlphaGen::Portal;
-				token = util::Parse(text, false);
+				token = tokenizer.parse(text, false);
 
 				if (token[0] == 0)
 				{
-					interface::PrintWarningf("'%s': missing range parameter for alphaGen portal, defaulting to %g\n", name, portalRange);
+					printWarningf("'%s': missing range parameter for alphaGen portal, defaulting to %g\n", name, portalRange);
 				}
 				else
 				{
@@ -1296,18 +1356,18 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			}
 			else
 			{
-				interface::PrintWarningf("'%s': unknown alphaGen parameter '%s'\n", name, token);
+				printWarningf("'%s': unknown alphaGen parameter '%s'\n", name, token);
 				continue;
 			}
 		}
 		// tcGen <function>
 		else if (!util::Stricmp(token, "texgen") || !util::Stricmp(token, "tcGen")) 
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing texgen parm\n", name);
+				printWarningf("'%s': missing texgen parm\n", name);
 			}
 			else if (!util::Stricmp(token, "environment"))
 			{
@@ -1323,13 +1383,13 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 			}
 			else if (!util::Stricmp(token, "vector"))
 			{
-				stage->bundles[0].tcGenVectors[0] = parseVector(text);
-				stage->bundles[0].tcGenVectors[1] = parseVector(text);
+				stage->bundles[0].tcGenVectors[0] = parseVector(tokenizer, text);
+				stage->bundles[0].tcGenVectors[1] = parseVector(tokenizer, text);
 				stage->bundles[0].tcGen = MaterialTexCoordGen::Vector;
 			}
 			else 
 			{
-				interface::PrintWarningf("'%s': unknown texgen parm\n", name);
+				printWarningf("'%s': unknown texgen parm\n", name);
 			}
 		}
 		// tcMod <type> <...>
@@ -1337,7 +1397,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		{
 			if (stage->bundles[0].numTexMods == MaterialTextureBundle::maxTexMods)
 			{
-				interface::PrintWarningf("'%s': too many tcMod stages", name);
+				printWarningf("'%s': too many tcMod stages", name);
 				continue;
 			}
 
@@ -1345,7 +1405,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 
 			while (1)
 			{
-				token = util::Parse(text, false);
+				token = tokenizer.parse(text, false);
 
 				if (token[0] == 0)
 					break;
@@ -1354,7 +1414,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 				util::Strcat(buffer, sizeof (buffer), " ");
 			}
 
-			stage->bundles[0].texMods[stage->bundles[0].numTexMods] = parseTexMod(buffer);
+			stage->bundles[0].texMods[stage->bundles[0].numTexMods] = parseTexMod(tokenizer, buffer);
 			stage->bundles[0].numTexMods++;
 		}
 		// depthmask
@@ -1365,7 +1425,7 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 		}
 		else
 		{
-			interface::PrintWarningf("'%s': unknown parameter '%s'\n", name, token);
+			printWarningf("'%s': unknown parameter '%s'\n", name, token);
 			return false;
 		}
 	}
@@ -1402,52 +1462,52 @@ bool Material::parseStage(MaterialStage *stage, char **text)
 	return true;
 }
 
-MaterialWaveForm Material::parseWaveForm(char **text) const
+MaterialWaveForm Material::parseWaveForm(util::Tokenizer &tokenizer, char **text) const
 {
 	MaterialWaveForm wave;
-	char *token = util::Parse(text, false);
+	char *token = tokenizer.parse(text, false);
 
 	if (token[0] == 0)
 	{
-		interface::PrintWarningf("'%s': missing waveform parm\n", name);
+		printWarningf("'%s': missing waveform parm\n", name);
 		return wave;
 	}
 
 	wave.func = genFuncFromName(token);
 
 	// BASE, AMP, PHASE, FREQ
-	token = util::Parse(text, false);
+	token = tokenizer.parse(text, false);
 
 	if (token[0] == 0)
 	{
-		interface::PrintWarningf("'%s': missing waveform parm\n", name);
+		printWarningf("'%s': missing waveform parm\n", name);
 		return wave;
 	}
 
 	wave.base = (float)atof(token);
-	token = util::Parse(text, false);
+	token = tokenizer.parse(text, false);
 
 	if (token[0] == 0)
 	{
-		interface::PrintWarningf("'%s': missing waveform parm\n", name);
+		printWarningf("'%s': missing waveform parm\n", name);
 		return wave;
 	}
 
 	wave.amplitude = (float)atof(token);
-	token = util::Parse(text, false);
+	token = tokenizer.parse(text, false);
 
 	if (token[0] == 0)
 	{
-		interface::PrintWarningf("'%s': missing waveform parm\n", name);
+		printWarningf("'%s': missing waveform parm\n", name);
 		return wave;
 	}
 
 	wave.phase = (float)atof(token);
-	token = util::Parse(text, false);
+	token = tokenizer.parse(text, false);
 
 	if (token[0] == 0)
 	{
-		interface::PrintWarningf("'%s': missing waveform parm\n", name);
+		printWarningf("'%s': missing waveform parm\n", name);
 		return wave;
 	}
 
@@ -1455,46 +1515,46 @@ MaterialWaveForm Material::parseWaveForm(char **text) const
 	return wave;
 }
 
-MaterialTexModInfo Material::parseTexMod(char *buffer) const
+MaterialTexModInfo Material::parseTexMod(util::Tokenizer &tokenizer, char *buffer) const
 {
 	MaterialTexModInfo tmi;
 	char **text = &buffer;
-	char *token = util::Parse(text, false);
+	char *token = tokenizer.parse(text, false);
 
 	if (!util::Stricmp(token, "turb"))
 	{
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing tcMod turb parms\n", name);
+			printWarningf("'%s': missing tcMod turb parms\n", name);
 			return tmi;
 		}
 
 		tmi.wave.base = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing tcMod turb\n", name);
+			printWarningf("'%s': missing tcMod turb\n", name);
 			return tmi;
 		}
 
 		tmi.wave.amplitude = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing tcMod turb\n", name);
+			printWarningf("'%s': missing tcMod turb\n", name);
 			return tmi;
 		}
 
 		tmi.wave.phase = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing tcMod turb\n", name);
+			printWarningf("'%s': missing tcMod turb\n", name);
 			return tmi;
 		}
 
@@ -1503,20 +1563,20 @@ MaterialTexModInfo Material::parseTexMod(char *buffer) const
 	}
 	else if (!util::Stricmp(token, "scale"))
 	{
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing scale parms\n", name);
+			printWarningf("'%s': missing scale parms\n", name);
 			return tmi;
 		}
 
 		tmi.scale[0] = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing scale parms\n", name);
+			printWarningf("'%s': missing scale parms\n", name);
 			return tmi;
 		}
 
@@ -1525,20 +1585,20 @@ MaterialTexModInfo Material::parseTexMod(char *buffer) const
 	}
 	else if (!util::Stricmp(token, "scroll"))
 	{
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing scale scroll parms\n", name);
+			printWarningf("'%s': missing scale scroll parms\n", name);
 			return tmi;
 		}
 
 		tmi.scroll[0] = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing scale scroll parms\n", name);
+			printWarningf("'%s': missing scale scroll parms\n", name);
 			return tmi;
 		}
 
@@ -1547,47 +1607,47 @@ MaterialTexModInfo Material::parseTexMod(char *buffer) const
 	}
 	else if (!util::Stricmp(token, "stretch"))
 	{
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing stretch parms\n", name);
+			printWarningf("'%s': missing stretch parms\n", name);
 			return tmi;
 		}
 
 		tmi.wave.func = genFuncFromName(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing stretch parms\n", name);
+			printWarningf("'%s': missing stretch parms\n", name);
 			return tmi;
 		}
 
 		tmi.wave.base = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing stretch parms\n", name);
+			printWarningf("'%s': missing stretch parms\n", name);
 			return tmi;
 		}
 
 		tmi.wave.amplitude = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing stretch parms\n", name);
+			printWarningf("'%s': missing stretch parms\n", name);
 			return tmi;
 		}
 
 		tmi.wave.phase = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing stretch parms\n", name);
+			printWarningf("'%s': missing stretch parms\n", name);
 			return tmi;
 		}
 
@@ -1596,56 +1656,56 @@ MaterialTexModInfo Material::parseTexMod(char *buffer) const
 	}
 	else if (!util::Stricmp(token, "transform"))
 	{
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing transform parms\n", name);
+			printWarningf("'%s': missing transform parms\n", name);
 			return tmi;
 		}
 
 		tmi.matrix[0][0] = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing transform parms\n", name);
+			printWarningf("'%s': missing transform parms\n", name);
 			return tmi;
 		}
 
 		tmi.matrix[0][1] = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing transform parms\n", name);
+			printWarningf("'%s': missing transform parms\n", name);
 			return tmi;
 		}
 
 		tmi.matrix[1][0] = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing transform parms\n", name);
+			printWarningf("'%s': missing transform parms\n", name);
 			return tmi;
 		}
 
 		tmi.matrix[1][1] = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing transform parms\n", name);
+			printWarningf("'%s': missing transform parms\n", name);
 			return tmi;
 		}
 
 		tmi.translate[0] = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing transform parms\n", name);
+			printWarningf("'%s': missing transform parms\n", name);
 			return tmi;
 		}
 
@@ -1654,11 +1714,11 @@ MaterialTexModInfo Material::parseTexMod(char *buffer) const
 	}
 	else if (!util::Stricmp(token, "rotate"))
 	{
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing tcMod rotate parms\n", name);
+			printWarningf("'%s': missing tcMod rotate parms\n", name);
 			return tmi;
 		}
 
@@ -1671,7 +1731,7 @@ MaterialTexModInfo Material::parseTexMod(char *buffer) const
 	}
 	else
 	{
-		interface::PrintWarningf("'%s': unknown tcMod '%s'\n", name, token);
+		printWarningf("'%s': unknown tcMod '%s'\n", name, token);
 	}
 
 	return tmi;
@@ -1687,14 +1747,14 @@ deformVertexes autoSprite
 deformVertexes autoSprite2
 deformVertexes text[0-7]
 */
-MaterialDeformStage Material::parseDeform(char **text) const
+MaterialDeformStage Material::parseDeform(util::Tokenizer &tokenizer, char **text) const
 {
 	MaterialDeformStage ds;
-	char *token = util::Parse(text, false);
+	char *token = tokenizer.parse(text, false);
 
 	if (token[0] == 0)
 	{
-		interface::PrintWarningf("'%s': missing deform parm\n", name);
+		printWarningf("'%s': missing deform parm\n", name);
 	}
 	else if (!util::Stricmp(token, "projectionShadow"))
 	{
@@ -1719,29 +1779,29 @@ MaterialDeformStage Material::parseDeform(char **text) const
 	}
 	else if (!util::Stricmp(token, "bulge"))
 	{
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing deformVertexes bulge parm\n", name);
+			printWarningf("'%s': missing deformVertexes bulge parm\n", name);
 			return ds;
 		}
 
 		ds.bulgeWidth = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing deformVertexes bulge parm\n", name);
+			printWarningf("'%s': missing deformVertexes bulge parm\n", name);
 			return ds;
 		}
 
 		ds.bulgeHeight = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing deformVertexes bulge parm\n", name);
+			printWarningf("'%s': missing deformVertexes bulge parm\n", name);
 			return ds;
 		}
 
@@ -1750,11 +1810,11 @@ MaterialDeformStage Material::parseDeform(char **text) const
 	}
 	else if (!util::Stricmp(token, "wave"))
 	{
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing deformVertexes parm\n", name);
+			printWarningf("'%s': missing deformVertexes parm\n", name);
 			return ds;
 		}
 
@@ -1765,28 +1825,28 @@ MaterialDeformStage Material::parseDeform(char **text) const
 		else
 		{
 			ds.deformationSpread = 100.0f;
-			interface::PrintWarningf("'%s': illegal div value of 0 in deformVertexes command\n", name);
+			printWarningf("'%s': illegal div value of 0 in deformVertexes command\n", name);
 		}
 
-		ds.deformationWave = parseWaveForm(text);
+		ds.deformationWave = parseWaveForm(tokenizer, text);
 		ds.deformation = MaterialDeform::Wave;
 	}
 	else if (!util::Stricmp(token, "normal"))
 	{
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing deformVertexes parm\n", name);
+			printWarningf("'%s': missing deformVertexes parm\n", name);
 			return ds;
 		}
 
 		ds.deformationWave.amplitude = (float)atof(token);
-		token = util::Parse(text, false);
+		token = tokenizer.parse(text, false);
 
 		if (token[0] == 0)
 		{
-			interface::PrintWarningf("'%s': missing deformVertexes parm\n", name);
+			printWarningf("'%s': missing deformVertexes parm\n", name);
 			return ds;
 		}
 
@@ -1797,40 +1857,40 @@ MaterialDeformStage Material::parseDeform(char **text) const
 	{
 		for (size_t i = 0; i < 3; i++)
 		{
-			token = util::Parse(text, false);
+			token = tokenizer.parse(text, false);
 
 			if (token[0] == 0)
 			{
-				interface::PrintWarningf("'%s': missing deformVertexes parm\n", name);
+				printWarningf("'%s': missing deformVertexes parm\n", name);
 				return ds;
 			}
 
 			ds.moveVector[i] = (float)atof(token);
 		}
 
-		ds.deformationWave = parseWaveForm(text);
+		ds.deformationWave = parseWaveForm(tokenizer, text);
 		ds.deformation = MaterialDeform::Move;
 	}
 	else
 	{
-		interface::PrintWarningf("'%s': unknown deformVertexes subtype '%s' found\n", name, token);
+		printWarningf("'%s': unknown deformVertexes subtype '%s' found\n", name, token);
 	}
 
 	return ds;
 }
 
 // skyParms <outerbox> <cloudheight> <innerbox>
-void Material::parseSkyParms(char **text)
+void Material::parseSkyParms(util::Tokenizer &tokenizer, char **text)
 {
 	const char * const suf[6] = { "rt", "bk", "lf", "ft", "up", "dn" };
 	const int imgFlags = TextureFlags::Mipmap | TextureFlags::Picmip;
 
 	// outerbox
-	char *token = util::Parse(text, false);
+	char *token = tokenizer.parse(text, false);
 
 	if (token[0] == 0)
 	{
-		interface::PrintWarningf("'%s': 'skyParms' missing parameter\n", name);
+		printWarningf("'%s': 'skyParms' missing parameter\n", name);
 		return;
 	}
 
@@ -1850,11 +1910,11 @@ void Material::parseSkyParms(char **text)
 	}
 
 	// cloudheight
-	token = util::Parse(text, false);
+	token = tokenizer.parse(text, false);
 
 	if (token[0] == 0)
 	{
-		interface::PrintWarningf("'%s': 'skyParms' missing parameter\n", name);
+		printWarningf("'%s': 'skyParms' missing parameter\n", name);
 		return;
 	}
 
@@ -1868,11 +1928,11 @@ void Material::parseSkyParms(char **text)
 	Sky_InitializeTexCoords(sky.cloudHeight);
 
 	// innerbox
-	token = util::Parse(text, false);
+	token = tokenizer.parse(text, false);
 
 	if (token[0] == 0) 
 	{
-		interface::PrintWarningf("'%s': 'skyParms' missing parameter\n", name);
+		printWarningf("'%s': 'skyParms' missing parameter\n", name);
 		return;
 	}
 
@@ -1906,7 +1966,7 @@ MaterialAlphaTest Material::alphaTestFromName(const char *name) const
 		{ "GE128", MaterialAlphaTest::GE_128 }
 	}))
 	{
-		interface::PrintWarningf("'%s': invalid alphaFunc name '%s'\n", this->name, name);
+		printWarningf("'%s': invalid alphaFunc name '%s'\n", this->name, name);
 	}
 	
 	return value;
@@ -1930,7 +1990,7 @@ uint64_t Material::srcBlendModeFromName(const char *name) const
 		{ "GL_SRC_ALPHA_SATURATE", BGFX_STATE_BLEND_SRC_ALPHA_SAT }
 	}))
 	{
-		interface::PrintWarningf("'%s': unknown blend mode '%s', substituting GL_ONE\n", this->name, name);
+		printWarningf("'%s': unknown blend mode '%s', substituting GL_ONE\n", this->name, name);
 	}
 	
 	return value;
@@ -1953,7 +2013,7 @@ uint64_t Material::dstBlendModeFromName(const char *name) const
 		{ "GL_ONE_MINUS_SRC_COLOR", BGFX_STATE_BLEND_INV_SRC_COLOR }
 	}))
 	{
-		interface::PrintWarningf("'%s': unknown blend mode '%s', substituting GL_ONE\n", this->name, name);
+		printWarningf("'%s': unknown blend mode '%s', substituting GL_ONE\n", this->name, name);
 	}
 
 	return value;
@@ -1974,7 +2034,7 @@ MaterialWaveformGenFunc Material::genFuncFromName(const char *name) const
 		{ "noise", MaterialWaveformGenFunc::Noise }
 	}))
 	{
-		interface::PrintWarningf("'%s': invalid genfunc name '%s'\n", this->name, name);
+		printWarningf("'%s': invalid genfunc name '%s'\n", this->name, name);
 	}
 
 	return value;
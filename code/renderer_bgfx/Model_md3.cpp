@@ -315,6 +315,7 @@ public:
 	bool load(const ReadOnlyFile &file) override;
 	Bounds getBounds() const override;
 	Material *getMaterial(size_t surfaceNo) const override { return nullptr; }
+	int findFogIndex(const Entity &entity) const override;
 	bool isCulled(Entity *entity, const Frustum &cameraFrustum) const override;
 	int lerpTag(const char *name, const Entity &entity, int startIndex, Transform *transform) const override;
 	void render(const mat3 &sceneRotation, DrawCallList *drawCallList, Entity *entity) override;
@@ -770,6 +771,21 @@ Bounds Model_md3::getBounds() const
 	return frames_[0].bounds;
 }
 
+int Model_md3::findFogIndex(const Entity &entity) const
+{
+	if (!world::IsLoaded())
+		return -1;
+
+	if (frames_.size() > 1)
+	{
+		// It is possible to have a bad frame while changing models.
+		const Frame &frame = frames_[Clamped(entity.oldFrame, 0, (int)frames_.size() - 1)];
+		return world::FindFogIndex(vec3(entity.position) + frame.position, frame.radius);
+	}
+
+	return world::FindFogIndex(entity.position, frames_[0].radius);
+}
+
 bool Model_md3::isCulled(Entity *entity, const Frustum &cameraFrustum) const
 {
 	assert(entity);
@@ -872,20 +888,7 @@ void Model_md3::render(const mat3 &sceneRotation, DrawCallList *drawCallList, En
 		}
 	}
 
-	int fogIndex = -1;
-
-	if (world::IsLoaded())
-	{
-		if (isAnimated)
-		{
-			const Frame &frame = frames_[oldFrameIndex];
-			fogIndex = world::FindFogIndex(vec3(entity->position) + frame.position, frame.radius);
-		}
-		else
-		{
-			fogIndex = world::FindFogIndex(entity->position, frames_[0].radius);
-		}
-	}
+	const Bounds bounds = modelMatrix.transform(Bounds::merge(frames_[oldFrameIndex].bounds, frames_[frameIndex].bounds));
 
 	for (Surface &surface : surfaces_)
 	{
@@ -905,8 +908,10 @@ void Model_md3::render(const mat3 &sceneRotation, DrawCallList *drawCallList, En
 		}
 
 		DrawCall dc;
+		dc.bounds = bounds;
+		dc.hasBounds = true;
 		dc.entity = entity;
-		dc.fogIndex = fogIndex;
+		dc.fogIndex = entity->fogIndex;
 		dc.material = mat;
 		dc.modelMatrix = modelMatrix;
 
@@ -190,6 +190,7 @@ public:
 	bool load(const ReadOnlyFile &file) override;
 	Bounds getBounds() const override;
 	Material *getMaterial(size_t surfaceNo) const override { return nullptr; }
+	int findFogIndex(const Entity &entity) const override { return -1; }
 	bool isCulled(Entity *entity, const Frustum &cameraFrustum) const override;
 	int lerpTag(const char *name, const Entity &entity, int startIndex, Transform *transform) const override;
 	void render(const mat3 &sceneRotation, DrawCallList *drawCallList, Entity *entity) override;
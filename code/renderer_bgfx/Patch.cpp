@@ -212,14 +212,11 @@ static	int	neighbors[8][2] = {
 	}
 }
 
-static int MakeMeshIndexes(int width, int height, Vertex ctrl[MAX_GRID_SIZE][MAX_GRID_SIZE],
-							 uint16_t indexes[(MAX_GRID_SIZE-1)*(MAX_GRID_SIZE-1)*2*3])
+static int MakeMeshIndexes(int width, int height, uint16_t indexes[(MAX_GRID_SIZE-1)*(MAX_GRID_SIZE-1)*2*3])
 {
 	int             i, j;
 	int             numIndexes;
 	int             w, h;
-	Vertex      *dv;
-	static Vertex       ctrl2[MAX_GRID_SIZE * MAX_GRID_SIZE];
 
 	h = height - 1;
 	w = width - 1;
@@ -246,16 +243,6 @@ static int MakeMeshIndexes(int width, int height, Vertex ctrl[MAX_GRID_SIZE][MAX
 		}
 	}
 
-	// FIXME: use more elegant way
-	for(i = 0; i < width; i++)
-	{
-		for(j = 0; j < height; j++)
-		{
-			dv = &ctrl2[j * width + i];
-			*dv = ctrl[j][i];
-		}
-	}
-
 	return numIndexes;
 }
 
@@ -411,6 +398,217 @@ void Patch_Free( Patch *grid ) {
 	free(grid);
 }
 
+/*
+=================
+Patch_MakeLodIndexes
+
+Triangulates the rows and columns of the full detail grid whose lod error is
+at or below maxError. The first and last rows and columns are always used, so
+edges shared with a neighbouring patch only depend on the shared lod errors.
+=================
+*/
+int Patch_MakeLodIndexes( const Patch *grid, float maxError, uint16_t *indexes ) {
+	int		widthTable[MAX_GRID_SIZE];
+	int		heightTable[MAX_GRID_SIZE];
+	int		lodWidth, lodHeight;
+	int		i, j;
+	int		numIndexes;
+
+	widthTable[0] = 0;
+	lodWidth = 1;
+	for ( i = 1 ; i < grid->width-1 ; i++ ) {
+		if ( grid->widthLodError[i] <= maxError ) {
+			widthTable[lodWidth++] = i;
+		}
+	}
+	widthTable[lodWidth++] = grid->width-1;
+
+	heightTable[0] = 0;
+	lodHeight = 1;
+	for ( i = 1 ; i < grid->height-1 ; i++ ) {
+		if ( grid->heightLodError[i] <= maxError ) {
+			heightTable[lodHeight++] = i;
+		}
+	}
+	heightTable[lodHeight++] = grid->height-1;
+
+	// same vertex order as MakeMeshIndexes
+	numIndexes = 0;
+	for ( i = 0 ; i < lodHeight - 1 ; i++ ) {
+		for ( j = 0 ; j < lodWidth - 1 ; j++ ) {
+			const int v2 = heightTable[i] * grid->width + widthTable[j];
+			const int v1 = heightTable[i] * grid->width + widthTable[j+1];
+			const int v3 = heightTable[i+1] * grid->width + widthTable[j];
+			const int v4 = heightTable[i+1] * grid->width + widthTable[j+1];
+
+			indexes[numIndexes++] = v2;
+			indexes[numIndexes++] = v3;
+			indexes[numIndexes++] = v1;
+
+			indexes[numIndexes++] = v1;
+			indexes[numIndexes++] = v3;
+			indexes[numIndexes++] = v4;
+		}
+	}
+
+	return numIndexes;
+}
+
+static bool PointsEqual( const vec3 &a, const vec3 &b ) {
+	return fabs( a.x - b.x ) <= .1f && fabs( a.y - b.y ) <= .1f && fabs( a.z - b.z ) <= .1f;
+}
+
+/*
+=================
+MergedWidthPoints
+
+returns true if there are grid points merged on a width edge
+=================
+*/
+static bool MergedWidthPoints( const Patch *grid, int offset ) {
+	for ( int i = 1; i < grid->width-1; i++ ) {
+		for ( int j = i + 1; j < grid->width-1; j++ ) {
+			if ( PointsEqual( grid->verts[i + offset].pos, grid->verts[j + offset].pos ) )
+				return true;
+		}
+	}
+	return false;
+}
+
+/*
+=================
+MergedHeightPoints
+
+returns true if there are grid points merged on a height edge
+=================
+*/
+static bool MergedHeightPoints( const Patch *grid, int offset ) {
+	for ( int i = 1; i < grid->height-1; i++ ) {
+		for ( int j = i + 1; j < grid->height-1; j++ ) {
+			if ( PointsEqual( grid->verts[grid->width * i + offset].pos, grid->verts[grid->width * j + offset].pos ) )
+				return true;
+		}
+	}
+	return false;
+}
+
+/*
+=================
+FixSharedVertexLodError_r
+
+Copies the lod error of every edge point of grid1 to the matching edge points
+of the grids after start in the same lod group.
+=================
+*/
+static void FixSharedVertexLodError_r( Patch **patches, size_t nPatches, size_t start, Patch *grid1 ) {
+	int k, l, m, n, offset1, offset2;
+	bool touch;
+
+	for ( size_t j = start; j < nPatches; j++ ) {
+		Patch *grid2 = patches[j];
+		// if the grid was already checked
+		if ( grid2->lodFixed == 2 ) {
+			continue;
+		}
+		// grids in the same LOD group should have the exact same lod radius
+		if ( grid1->lodRadius != grid2->lodRadius ) {
+			continue;
+		}
+		// grids in the same LOD group should have the exact same lod origin
+		if ( grid1->lodOrigin.x != grid2->lodOrigin.x || grid1->lodOrigin.y != grid2->lodOrigin.y || grid1->lodOrigin.z != grid2->lodOrigin.z ) {
+			continue;
+		}
+		//
+		touch = false;
+		for (n = 0; n < 2; n++) {
+			offset1 = n ? (grid1->height-1) * grid1->width : 0;
+			if (MergedWidthPoints(grid1, offset1))
+				continue;
+			for (k = 1; k < grid1->width-1; k++) {
+				for (m = 0; m < 2; m++) {
+					offset2 = m ? (grid2->height-1) * grid2->width : 0;
+					if (MergedWidthPoints(grid2, offset2))
+						continue;
+					for ( l = 1; l < grid2->width-1; l++) {
+						if ( !PointsEqual( grid1->verts[k + offset1].pos, grid2->verts[l + offset2].pos ) )
+							continue;
+						// ok the points are equal and should have the same lod error
+						grid2->widthLodError[l] = grid1->widthLodError[k];
+						touch = true;
+					}
+				}
+				for (m = 0; m < 2; m++) {
+					offset2 = m ? grid2->width-1 : 0;
+					if (MergedHeightPoints(grid2, offset2))
+						continue;
+					for ( l = 1; l < grid2->height-1; l++) {
+						if ( !PointsEqual( grid1->verts[k + offset1].pos, grid2->verts[grid2->width * l + offset2].pos ) )
+							continue;
+						// ok the points are equal and should have the same lod error
+						grid2->heightLodError[l] = grid1->widthLodError[k];
+						touch = true;
+					}
+				}
+			}
+		}
+		for (n = 0; n < 2; n++) {
+			offset1 = n ? grid1->width-1 : 0;
+			if (MergedHeightPoints(grid1, offset1))
+				continue;
+			for (k = 1; k < grid1->height-1; k++) {
+				for (m = 0; m < 2; m++) {
+					offset2 = m ? (grid2->height-1) * grid2->width : 0;
+					if (MergedWidthPoints(grid2, offset2))
+						continue;
+					for ( l = 1; l < grid2->width-1; l++) {
+						if ( !PointsEqual( grid1->verts[grid1->width * k + offset1].pos, grid2->verts[l + offset2].pos ) )
+							continue;
+						// ok the points are equal and should have the same lod error
+						grid2->widthLodError[l] = grid1->heightLodError[k];
+						touch = true;
+					}
+				}
+				for (m = 0; m < 2; m++) {
+					offset2 = m ? grid2->width-1 : 0;
+					if (MergedHeightPoints(grid2, offset2))
+						continue;
+					for ( l = 1; l < grid2->height-1; l++) {
+						if ( !PointsEqual( grid1->verts[grid1->width * k + offset1].pos, grid2->verts[grid2->width * l + offset2].pos ) )
+							continue;
+						// ok the points are equal and should have the same lod error
+						grid2->heightLodError[l] = grid1->heightLodError[k];
+						touch = true;
+					}
+				}
+			}
+		}
+		if (touch) {
+			grid2->lodFixed = 2;
+			FixSharedVertexLodError_r ( patches, nPatches, start, grid2 );
+		}
+	}
+}
+
+/*
+=================
+Patch_FixSharedVertexLodError
+
+This function assumes that all patches in one group are nicely stitched together for the highest LoD.
+If this is not the case this function will still do its job but won't fix the highest LoD cracks.
+=================
+*/
+void Patch_FixSharedVertexLodError( Patch **patches, size_t nPatches ) {
+	for ( size_t i = 0; i < nPatches; i++ ) {
+		Patch *grid1 = patches[i];
+		if ( grid1->lodFixed )
+			continue;
+		//
+		grid1->lodFixed = 2;
+		// recursively fix other patches in the same LOD group
+		FixSharedVertexLodError_r( patches, nPatches, i + 1, grid1 );
+	}
+}
+
 /*
 =================
 Patch_Subdivide
@@ -427,7 +625,7 @@ Patch *Patch_Subdivide( int width, int height, const Vertex *points) {
 	Vertex	ctrl[MAX_GRID_SIZE][MAX_GRID_SIZE];
 	float		errorTable[2][MAX_GRID_SIZE];
 	int			numIndexes;
-	static uint16_t indexes[(MAX_GRID_SIZE-1)*(MAX_GRID_SIZE-1)*2*3];
+	uint16_t indexes[(MAX_GRID_SIZE-1)*(MAX_GRID_SIZE-1)*2*3]; // Not static: patches may be subdivided on worker threads.
 	int consecutiveComplete;
 
 	for ( i = 0 ; i < width ; i++ ) {
@@ -578,7 +776,7 @@ Patch *Patch_Subdivide( int width, int height, const Vertex *points) {
 #endif
 
 	// calculate indexes
-	numIndexes = MakeMeshIndexes(width, height, ctrl, indexes);
+	numIndexes = MakeMeshIndexes(width, height, indexes);
 
 	// calculate normals
 	MakeMeshNormals( width, height, ctrl );
@@ -50,8 +50,10 @@ If you have questions concerning this license or the applicable additional terms
 
 #include <algorithm>
 #include <cmath>
+#include <functional>
 #include <map>
 #include <memory>
+#include <set>
 #include <vector>
 #include "float.h"
 
@@ -83,6 +85,7 @@ extern "C"
 #include "bgfx/platform.h"
 #include "bx/debug.h"
 #include "bx/math.h"
+#include "bx/simd_t.h"
 #include "bx/string.h"
 #include "bx/timer.h"
 
@@ -114,10 +117,13 @@ struct Uniforms_Material;
 struct Uniforms_MaterialStage;
 struct Vertex;
 
+namespace util { class Tokenizer; }
+
 struct ConsoleVariables
 {
 	void initialize();
 
+	ConsoleVariable asyncTextureDecode;
 	ConsoleVariable backend;
 	ConsoleVariable bgfx_stats;
 	ConsoleVariable bloomScale;
@@ -126,6 +132,8 @@ struct ConsoleVariables
 	ConsoleVariable debugDrawSize;
 	ConsoleVariable dynamicLightIntensity;
 	ConsoleVariable dynamicLightScale;
+	ConsoleVariable lodCurveError;
+	ConsoleVariable materialCache;
 	ConsoleVariable picmip;
 	ConsoleVariable railWidth;
 	ConsoleVariable railCoreWidth;
@@ -134,9 +142,13 @@ struct ConsoleVariables
 	ConsoleVariable shadowDepthBias;
 	ConsoleVariable shadowNormalBias;
 	ConsoleVariable shadowSlopeScaleDepthBias;
+	ConsoleVariable skyboxPortalCubemapRate;
 	ConsoleVariable sunLightIntensity;
+	ConsoleVariable textureBudget;
+	ConsoleVariable textureCompression;
 	ConsoleVariable textureVariation;
 	ConsoleVariable wireframe;
+	ConsoleVariable worldCache;
 
 	/// @name Gamma
 	/// @{
@@ -166,7 +178,10 @@ struct DrawCallFlags
 		/// @brief Either world surfaceFlags SURF_SKY (e.g. space maps with no material skyparms) or Material::isSky (everything else)
 		Sky    = 1<<0,
 
-		Skybox = 1<<1
+		Skybox = 1<<1,
+
+		/// @brief A skybox face textured with the skybox portal scene instead of the material sky box.
+		SkyboxPortal = 1<<2
 	};
 };
 
@@ -201,10 +216,15 @@ struct DrawCall
 		uint32_t nIndices = 0;
 	};
 
+	/// @brief World space bounds. Used to skip dynamic lighting when no dlights touch the draw call.
+	/// @remarks Only valid if hasBounds is true. Draw calls without bounds are assumed to be touched by every dlight.
+	Bounds bounds;
+
 	bool dynamicLighting = true;
 	const Entity *entity = nullptr;
 	int flags = DrawCallFlags::None;
 	int fogIndex = -1;
+	bool hasBounds = false;
 	IndexBuffer ib;
 	Material *material = nullptr;
 	mat4 modelMatrix = mat4::identity;
@@ -245,12 +265,16 @@ struct DynamicLight
 };
 
 /*
+The grid is a camera relative froxel grid: x and y are screen space tiles, z is exponentially distributed depth slices.
+
 Cells texture:
-uint16_t offset into indices texture
+uint32_t offset into indices texture
 
 Indices texture:
-uint8_t num lights
-uint8_t light index (0...n) into lights texture
+uint16_t num lights
+uint16_t light index (0...n) into lights texture
+
+The last indices list contains every light. Positions outside the froxel grid (portal and reflection cameras, behind the near plane) use it.
 
 Lights texture:
 DynamicLight struct (0...n)
@@ -267,34 +291,95 @@ public:
 	bgfx::TextureHandle getIndicesTexture() const { return indicesTexture_; }
 	bgfx::TextureHandle getLightsTexture() const { return lightsTexture_; }
 	void initializeGrid();
-	void updateTextures(uint32_t frameNo);
+
+	/// @brief Whether any of this frame's dlights touch the bounds.
+	/// @remarks Only valid after updateTextures.
+	bool isTouchingBounds(const Bounds &bounds) const;
+
+	/// @brief Build the froxel grid from the scene camera and assign the lights to it.
+	/// @param fov Field of view in degrees.
+	void updateTextures(uint32_t frameNo, vec3 cameraPosition, const mat3 &cameraRotation, vec2 fov);
+
 	void updateUniforms(Uniforms *uniforms);
 
-	static const size_t maxLights = 256;
+	static const size_t maxLights = 1024;
 
 private:
-	void decodeAssignedLight(uint32_t value, vec3b *cellPosition, uint8_t *lightIndex) const;
-	uint32_t encodeAssignedLight(vec3b cellPosition, uint8_t lightIndex) const;
+	struct Froxel
+	{
+		vec3 center;
+		float radius;
+	};
+
+	/// @brief Light segments in SoA layout for SIMD culling. Point lights have a zero length segment.
+	/// @remarks Padded to a multiple of 4 lights with lights that never touch anything.
+	struct LightCullData
+	{
+		alignas(16) float startX[maxLights];
+		alignas(16) float startY[maxLights];
+		alignas(16) float startZ[maxLights];
+		alignas(16) float dirX[maxLights];
+		alignas(16) float dirY[maxLights];
+		alignas(16) float dirZ[maxLights];
+		alignas(16) float inverseLengthSquared[maxLights];
+		alignas(16) float radius[maxLights];
+	};
+
+	static const size_t nLightGroups = maxLights / 4;
+	static const size_t nLightGroupMaskWords = nLightGroups / 64;
 
-	size_t cellIndexFromCellPosition(vec3b position) const;
+	/// @return Bitmask of the lights in the group of 4 that touch the froxel.
+	uint32_t cullLightGroup(const Froxel &froxel, size_t group) const;
 
-	/// @remarks Result is clamped.
-	vec3b cellPositionFromWorldspacePosition(vec3 position) const;
+	/// @brief Count (indices == nullptr) or write the indices of the lights touching a cell.
+	uint32_t cullLights(uint32_t cellIndex, uint16_t *indices) const;
+
+	uint32_t cellIndexFromCellPosition(vec3i position) const;
+
+	/// @brief Unclamped, continuous froxel grid position.
+	/// @return false if the position is behind the camera.
+	bool froxelPositionFromWorldspacePosition(vec3 position, vec3 *froxelPosition) const;
+
+	/// @brief World space position of a froxel grid corner.
+	vec3 worldspacePositionFromFroxelCorner(int x, int y, int z) const;
 
 	bgfx::TextureHandle cellsTexture_;
-	std::vector<uint16_t> cellsTextureData_[BGFX_NUM_BUFFER_FRAMES];
+	std::vector<uint32_t> cellsTextureData_[BGFX_NUM_BUFFER_FRAMES];
 	uint16_t cellsTextureSize_;
 
 	bgfx::TextureHandle indicesTexture_;
-	std::vector<uint8_t> indicesTextureData_[BGFX_NUM_BUFFER_FRAMES];
+	std::vector<uint16_t> indicesTextureData_[BGFX_NUM_BUFFER_FRAMES];
 	uint16_t indicesTextureSize_;
 
-	std::vector<uint32_t> assignedLights_;
-	vec3i cellSize_;
-	vec3 gridOffset_;
-	vec3b gridSize_;
+	/// @brief Offset of the indices list containing every light.
+	uint32_t allLightsOffset_ = 0;
+
+	std::vector<uint32_t> cellCounts_;
+	std::vector<Froxel> froxels_;
+	LightCullData lightCullData_;
+
+	/// @brief AABB of each light for per draw call culling. Capsules include both ends.
+	Bounds lightBounds_[maxLights];
+
+	/// @brief Number of lights in lightCullData_ and lightBounds_.
+	uint16_t nCulledLights_ = 0;
+
+	/// @brief For each depth slice, a bitmask of the light groups that may touch it.
+	std::vector<uint64_t> sliceLightGroups_;
+
+	vec3i gridSize_;
+
+	/// @name Froxel grid camera
+	/// @{
+	vec3 froxelPosition_;
+	mat3 froxelRotation_;
+	vec2 froxelTanHalfFov_;
+	float zNear_, zFar_;
+	float sliceScale_; ///< Slices per log depth unit.
+	/// @}
+
 	DynamicLight lights_[BGFX_NUM_BUFFER_FRAMES][maxLights];
-	uint8_t nLights_;
+	uint16_t nLights_;
 	bgfx::TextureHandle lightsTexture_;
 	uint16_t lightsTextureSize_;
 };
@@ -370,6 +455,13 @@ struct Entity
 
 	vec3 directedLight;
 
+	/// @brief Lighting position relative to the entity position.
+	/// @remarks Used when sampling the light grid in the generic shader.
+	vec3 lightOffset;
+
+	/// @brief World fog index. -1 if not fogged.
+	int fogIndex = -1;
+
 	/// @}
 };
 
@@ -412,6 +504,28 @@ struct CreateImageFlags
 Image CreateImage(int width, int height, int nComponents, uint8_t *data, int flags = 0);
 Image LoadImage(const char *filename, int flags = 0);
 
+/// @brief Read an image file without decoding it. Tries the other supported extensions the same way as LoadImage.
+/// @param resolvedFilename The filename that was read. The extension may be different from filename.
+/// @return nullptr if no file exists.
+std::unique_ptr<ReadOnlyFile> ReadImageFile(const char *filename, char *resolvedFilename, size_t resolvedFilenameSize);
+
+/// @brief Decode an image file read by ReadImageFile, and generate mips if flags has CreateImageFlags::GenerateMipmaps.
+/// @remarks Doesn't use the engine interface, so it can run on a worker thread.
+/// @return An image with no data if decoding failed.
+Image DecodeImage(const char *filename, const uint8_t *fileBuffer, size_t fileLength, int flags = 0);
+
+/// @brief Block compress an RGBA8 image and its mips. BC1 is used if the image is opaque, otherwise BC3.
+/// @remarks Doesn't use the engine interface, so it can run on a worker thread.
+/// @return An image with no data if the width or height aren't multiples of 4.
+Image CompressImage(const Image &image, bgfx::TextureFormat::Enum *format);
+
+/// @brief Write a block compressed image to a KTX file in memory.
+void WriteCompressedImage(const Image &image, bgfx::TextureFormat::Enum format, std::vector<uint8_t> *data);
+
+/// @brief Read a KTX file written by WriteCompressedImage.
+/// @return An image with no data if the file isn't valid.
+Image ReadCompressedImage(const uint8_t *fileBuffer, size_t fileLength, bgfx::TextureFormat::Enum *format);
+
 struct IndexBuffer
 {
 	IndexBuffer() { handle.idx = bgfx::kInvalidHandle; }
@@ -419,6 +533,38 @@ struct IndexBuffer
 	bgfx::IndexBufferHandle handle;
 };
 
+/// @brief A pool of worker threads for splitting CPU work into independent ranges.
+/// @remarks The calling thread participates in the work. Nested calls, and calls made while another thread is using the pool, run serially on the calling thread.
+class JobSystem
+{
+public:
+	/// @param nWorkers Number of worker threads to create. 0 means the pool only runs work on the calling thread.
+	explicit JobSystem(int nWorkers);
+	~JobSystem();
+
+	/// @brief Number of threads that can run work at the same time, including the calling thread.
+	int getNumThreads() const { return (int)threads_.size() + 1; }
+
+	/// @brief Split [0, count) into ranges of at most granularity elements and call fn on each range. Blocks until all ranges have completed.
+	/// @remarks fn may be called from any thread in any order, so it must only write to data owned by its range.
+	void parallelFor(size_t count, size_t granularity, const std::function<void(size_t begin, size_t end)> &fn);
+
+private:
+	struct Batch;
+	static int WorkerThread(void *data);
+	void runBatch(Batch *batch);
+
+	std::vector<SDL_Thread *> threads_;
+	SDL_mutex *submitMutex_ = nullptr;
+	SDL_mutex *mutex_ = nullptr;
+	SDL_cond *wakeCondition_ = nullptr;
+	SDL_cond *doneCondition_ = nullptr;
+	Batch *batch_ = nullptr;
+	uint32_t batchId_ = 0;
+	int nActiveWorkers_ = 0;
+	bool quit_ = false;
+};
+
 #if defined(USE_LIGHT_BAKER)
 namespace light_baker
 {
@@ -444,6 +590,10 @@ namespace main
 	void DrawStretchPicGradient(float x, float y, float w, float h, float s1, float t1, float s2, float t2, int materialIndex, vec4 gradientColor);
 	void DrawStretchRaw(int x, int y, int w, int h, int cols, int rows, const uint8_t *data, int client, bool dirty);
 	void EndFrame();
+
+	/// @brief Called when the engine has finished registering models, materials and textures.
+	void EndRegistration();
+
 	const Entity *GetCurrentEntity();
 	float GetFloatTime();
 	Transform GetMainCameraTransform();
@@ -459,7 +609,11 @@ namespace main
 	void SetColor(vec4 c);
 	const SunLight &GetSunLight();
 	void SetSunLight(const SunLight &sunLight); 
+
+	/// @brief Destroys the material, model and texture caches and the world, including their GPU resources.
+	/// @remarks The engine calls this with destroyWindow false on every map change, then calls Initialize from RE_BeginRegistration, so cached assets only live for one map.
 	void Shutdown(bool destroyWindow);
+
 	void UploadCinematic(int w, int h, int cols, int rows, const uint8_t *data, int client, bool dirty);
 }
 
@@ -932,14 +1086,15 @@ private:
 	/// @{
 
 	/// @param text The text pointer at the explicit text definition of the
+	/// @remarks Uses its own util::Tokenizer, so materials can be parsed on any thread.
 	bool parse(char **text);
 
-	vec3 parseVector(char **text, bool *result = nullptr) const;
-	bool parseStage(MaterialStage *stage, char **text);
-	MaterialWaveForm parseWaveForm(char **text) const;
-	MaterialTexModInfo parseTexMod(char *buffer) const;
-	MaterialDeformStage parseDeform(char **text) const;
-	void parseSkyParms(char **text);
+	vec3 parseVector(util::Tokenizer &tokenizer, char **text, bool *result = nullptr) const;
+	bool parseStage(util::Tokenizer &tokenizer, MaterialStage *stage, char **text);
+	MaterialWaveForm parseWaveForm(util::Tokenizer &tokenizer, char **text) const;
+	MaterialTexModInfo parseTexMod(util::Tokenizer &tokenizer, char *buffer) const;
+	MaterialDeformStage parseDeform(util::Tokenizer &tokenizer, char **text) const;
+	void parseSkyParms(util::Tokenizer &tokenizer, char **text);
 
 	MaterialAlphaTest alphaTestFromName(const char *name) const;
 	uint64_t srcBlendModeFromName(const char *name) const;
@@ -949,6 +1104,42 @@ private:
 
 	/// @}
 
+	/// @name Deferred parsing
+	/// @brief Lets MaterialCache::precompileMaterials parse on worker threads. Anything with side effects is recorded or refused, and handled on the main thread.
+	/// @{
+
+	struct DeferredParse
+	{
+		struct TextureLookup
+		{
+			const Texture **slot;
+			std::string name;
+			int flags;
+		};
+
+		std::vector<TextureLookup> textureLookups;
+
+		/// @brief Parse warnings, printed on the main thread if the material is created.
+		std::vector<std::string> warnings;
+
+		/// @brief Set if the definition uses a keyword that can only be parsed on the main thread.
+		bool requiresMainThread = false;
+	};
+
+	/// @brief Set the texture slot to the named texture. When deferred, the lookup is recorded and the slot is set to a placeholder.
+	const Texture *findTexture(const Texture **slot, const char *textureName, int flags);
+
+	/// @brief Call before parsing keywords with global side effects, e.g. setting cvars.
+	/// @return false if deferred parsing, which should then stop.
+	bool requireMainThread();
+
+	/// @brief Print a parse warning. When deferred, the warning is recorded instead, since printing isn't thread safe.
+	void printWarningf(const char *format, ...) const __attribute__((format(printf, 2, 3)));
+
+	DeferredParse *deferredParse_ = nullptr;
+
+	/// @}
+
 	/// @name State
 	/// @{
 
@@ -979,9 +1170,20 @@ private:
 class MaterialCache
 {
 public:
+	struct PrecompileRequest
+	{
+		const char *name;
+		int lightmapIndex;
+	};
+
 	MaterialCache();
 	Material *createMaterial(const Material &base);
 	Material *findMaterial(const char *name, int lightmapIndex = MaterialLightmapId::StretchPic, bool mipRawImage = true);
+
+	/// @brief Parse the explicitly defined materials in requests in parallel, then create them in request order, so later findMaterial calls with the same name and lightmap index return them.
+	/// @remarks Materials that already exist, are defined only by an image, or need the main thread to parse are left for findMaterial.
+	void precompileMaterials(const std::vector<PrecompileRequest> &requests);
+
 	void remapMaterial(const char *oldName, const char *newName, const char *offsetTime);
 	Material *getMaterial(int handle) { return materials_[handle].get(); }
 	Material *getDefaultMaterial() { return defaultMaterial_; }
@@ -995,9 +1197,19 @@ private:
 
 	void createInternalShaders();
 
+	struct ShaderTextCacheHeader;
+
 	/// Finds and loads all .shader files, combining them into a single large text block that can be scanned for shader names.
+	/// @remarks The combined text and shader name offsets are cached to disk, keyed by the shader file names and contents.
 	void scanAndLoadShaderFiles();
 
+	/// @param bucketSizes The number of shader names in each text hash table bucket.
+	/// @param nameOffsets Offsets of shader names into shaderText_, grouped by bucket.
+	void createTextHashTable(const uint32_t *bucketSizes, const uint32_t *nameOffsets);
+
+	bool readShaderTextCache(const ShaderTextCacheHeader &key);
+	void writeShaderTextCache(const ShaderTextCacheHeader &key, const std::vector<uint32_t> &bucketSizes, const std::vector<uint32_t> &nameOffsets) const;
+
 	void createExternalShaders();
 
 	/// Scans the combined text description of all the shader files for the given shader name.
@@ -1039,6 +1251,11 @@ public:
 	virtual bool load(const ReadOnlyFile &file) = 0;
 	virtual Bounds getBounds() const = 0;
 	virtual Material *getMaterial(size_t surfaceNo) const = 0;
+
+	/// @brief Find the world fog index for an entity using this model. Doesn't depend on the camera, so it's only called once per scene.
+	/// @return -1 if the model isn't fogged.
+	virtual int findFogIndex(const Entity &entity) const = 0;
+
 	virtual bool isCulled(Entity *entity, const Frustum &cameraFrustum) const = 0;
 	virtual void render(const mat3 &sceneRotation, DrawCallList *drawCallList, Entity *entity) = 0;
 
@@ -1126,6 +1343,14 @@ struct Patch
 Patch *Patch_Subdivide(int width, int height, const Vertex *points);
 void Patch_Free(Patch *grid);
 
+/// @brief Make lod errors match on edges shared by patches in the same lod group, so they pick the same rows and columns and don't crack.
+void Patch_FixSharedVertexLodError(Patch **patches, size_t nPatches);
+
+/// @brief Create indices for a reduced level of detail, using only the rows and columns with a lod error of maxError or less.
+/// @param indexes Must have room for patch->numIndexes indices.
+/// @return The number of indices.
+int Patch_MakeLodIndexes(const Patch *grid, float maxError, uint16_t *indexes);
+
 #ifdef USE_PROFILER
 namespace profiler
 {
@@ -1254,6 +1479,15 @@ struct SkySurface
 {
 	Material *material;
 	std::vector<Vertex> vertices;
+
+	/// @brief Sky box face extents from the last time the sky polygons were clipped, and the camera position they were clipped from.
+	/// @remarks Sky_Render only clips again if the camera has moved. Visibility changes rebuild the surface, which resets these.
+	/// @{
+	mutable bool hasClippedExtents = false;
+	mutable vec3 clippedCameraPosition;
+	mutable float clippedMins[2][6];
+	mutable float clippedMaxs[2][6];
+	/// @}
 };
 
 /// @remarks Called when a sky material is parsed.
@@ -1261,6 +1495,12 @@ void Sky_InitializeTexCoords(float heightCloud);
 
 void Sky_Render(DrawCallList *drawCallList, vec3 cameraPosition, float zMax, const SkySurface &surface);
 
+/// @brief Render the visible part of the sky box, using the skybox portal scene faces instead of the material sky box.
+void Sky_RenderSkyboxPortal(DrawCallList *drawCallList, vec3 cameraPosition, float zMax, const SkySurface &surface);
+
+/// @brief Destroy the cached sky box and cloud box geometry.
+void Sky_Shutdown();
+
 struct StaticLightFlags
 {
 	enum
@@ -1314,7 +1554,7 @@ public:
 	void resize(int width, int height);
 	void update(const bgfx::Memory *mem, int x, int y, int width, int height);
 	int getFlags() const { return flags_; }
-	bgfx::TextureHandle getHandle() const { return handle_; }
+	bgfx::TextureHandle getHandle() const { return aliasOf_ ? aliasOf_->getHandle() : handle_; }
 	const char *getName() const { return name_; }
 	int getWidth() const { return width_; }
 	int getHeight() const { return height_; }
@@ -1322,6 +1562,10 @@ public:
 private:
 	void initialize(const char *name, const Image &image, int flags, bgfx::TextureFormat::Enum format);
 	void initialize(const char *name, bgfx::TextureHandle handle);
+
+	/// @brief Replace the handle with one created from a file loaded by TextureCache, skipping the top droppedMips mips.
+	void reload(const Image &image, bgfx::TextureFormat::Enum format, int droppedMips);
+
 	uint32_t calculateBgfxFlags() const;
 
 	char name_[MAX_QPATH];
@@ -1332,6 +1576,22 @@ private:
 	bgfx::TextureHandle handle_;
 	Texture *next_;
 
+	/// @brief The handle belongs to another texture, e.g. the default texture while this one is still being decoded.
+	bool sharesHandle_ = false;
+
+	/// @brief Use another texture's handle, e.g. because it has identical contents. See TextureCache::alias.
+	const Texture *aliasOf_ = nullptr;
+
+	/// @name Residency
+	/// @{
+	bool reloadable_ = false; ///< Loaded from a file, so it can be evicted or have mips dropped and be reloaded later.
+	bool reloading_ = false; ///< Waiting in TextureCache::pendingTextures_.
+	bool evicted_ = false; ///< Uses the default texture handle until it's used again.
+	int droppedMips_ = 0; ///< The number of top mips that aren't resident.
+	uint32_t memorySize_ = 0;
+	mutable uint32_t lastUsedFrame_ = 0;
+	/// @}
+
 	friend class TextureCache;
 };
 
@@ -1353,15 +1613,92 @@ public:
 	const Texture *getNoise() const { return noiseTexture_; }
 	const Texture *getWhite() const { return whiteTexture_; }
 	Texture *getScratch(size_t index) { return scratchTextures_[index]; }
+
+	/// @brief Make from use the handle of to. nullptr removes the alias.
 	void alias(Texture *from, Texture *to);
 
+	void printStats() const;
+
+	/// @brief Decode up to maxTextures of the textures queued by find, and swap them in for their placeholders.
+	/// @remarks Decoding runs on the job system. Textures are created on the calling thread.
+	void processPendingTextures(size_t maxTextures = SIZE_MAX);
+
+	/// @brief Record that a texture is used by the current frame. Evicted textures and textures with dropped mips are reloaded when they're used.
+	void markUsed(const Texture *texture) const
+	{
+		texture->lastUsedFrame_ = frameNo_;
+
+		if (texture->aliasOf_)
+			markUsed(texture->aliasOf_);
+	}
+
+	/// @brief Reload used textures that aren't fully resident. When over the r_textureBudget VRAM budget, drop the top mips of unused textures, then evict them.
+	/// @remarks Call once per frame, before processPendingTextures.
+	void updateResidency();
+
 private:
+	/// @brief A texture that has been read, but not yet decoded.
+	/// @remarks The texture uses the default texture handle as a placeholder until the image is decoded.
+	struct PendingTexture
+	{
+		Texture *texture;
+		std::unique_ptr<ReadOnlyFile> file;
+		char filename[MAX_QPATH];
+		int imageFlags;
+		Image image;
+		bgfx::TextureFormat::Enum format = bgfx::TextureFormat::RGBA8;
+		int droppedMips = 0;
+		uint32_t contentHash[2]; ///< Calculated from the decoded image data.
+
+		/// @name Compressed texture cache
+		/// @{
+		bool compress = false;
+		char cacheFilename[MAX_QPATH];
+		std::unique_ptr<ReadOnlyFile> cacheFile;
+		std::vector<uint8_t> cacheData; ///< Written to cacheFilename when the texture has been compressed.
+		/// @}
+	};
+
 	void hashTexture(Texture *texture);
 	size_t generateHash(const char *name) const;
 
-	static const size_t maxTextures_ = 2048;
-	Texture textures_[maxTextures_];
-	size_t nTextures_ = 0;
+	/// @brief Create a texture slot, evicting the least recently used texture if there are too many resident textures.
+	Texture *allocateTexture(const char *name);
+
+	/// @return nullptr if the file doesn't exist.
+	std::unique_ptr<PendingTexture> readPendingTexture(const char *name, int flags) const;
+
+	/// @brief Identifies textures with identical decoded contents.
+	struct ContentKey
+	{
+		uint32_t hash[2];
+		uint32_t dataSize;
+		int width, height;
+		int flags;
+		bgfx::TextureFormat::Enum format;
+
+		bool operator<(const ContentKey &other) const { return memcmp(this, &other, sizeof(*this)) < 0; }
+	};
+
+	bool queueReload(Texture *texture, int droppedMips);
+	void evict(Texture *texture);
+	bool evictLeastRecentlyUsed();
+	int calculateMaxDroppedMips(int width, int height, int nMips, bgfx::TextureFormat::Enum format) const;
+
+	/// @brief Block compression is supported, see r_textureCompression.
+	bool compressionSupported_;
+
+	/// @brief Max textures with their own handle. When exceeded, the least recently used texture is evicted.
+	static const size_t maxResidentTextures_ = 2048;
+
+	/// @brief Textures must be unused for this many frames before mips are dropped.
+	static const uint32_t minUnusedFrames_ = 120;
+
+	/// @brief Don't drop mips below this size.
+	static const int minDroppedMipSize_ = 64;
+
+	std::vector<std::unique_ptr<Texture>> textures_;
+	uint32_t frameNo_ = 1;
 	static const size_t hashTableSize_ = 1024;
 	Texture *hashTable_[hashTableSize_];
 	static const int defaultImageSize_ = 16;
@@ -1377,7 +1714,10 @@ private:
 	static const size_t nScratchTextures_ = 32;
 	uint8_t scratchImageData_[nScratchTextures_][defaultImageDataSize_];
 	std::array<Texture *, nScratchTextures_> scratchTextures_;
-	std::map<Texture *, Texture *> aliases_;
+	std::map<ContentKey, Texture *> contentTextures_;
+	size_t nDuplicateTextures_ = 0;
+	size_t duplicateMemorySize_ = 0;
+	std::vector<std::unique_ptr<PendingTexture>> pendingTextures_;
 };
 
 /// Texture units used by the generic shader(s).
@@ -1393,7 +1733,10 @@ struct TextureUnit
 		DynamicLightIndices = TU_DYNAMIC_LIGHT_INDICES,
 		DynamicLights       = TU_DYNAMIC_LIGHTS,
 		ShadowMap           = TU_SHADOWMAP,
-		Noise               = TU_NOISE
+		Noise               = TU_NOISE,
+		LightGridAmbient    = TU_LIGHT_GRID_AMBIENT,
+		LightGridDirected   = TU_LIGHT_GRID_DIRECTED,
+		LightGridDirection  = TU_LIGHT_GRID_DIRECTION
 	};
 };
 
@@ -1463,13 +1806,19 @@ struct Uniforms
 	/// @name Dynamic lights
 	/// @{
 
-	/// @remarks xyz is cell size in world coordinates, w is the texture size.
-	Uniform_vec4 dynamicLightCellSize = "u_DynamicLightCellSize";
+	/// @remarks xyz is the froxel grid camera position, w is the near plane distance.
+	Uniform_vec4 dynamicLightFroxelPosition = "u_DynamicLightFroxelPosition";
 
-	/// @remarks w not used.
-	Uniform_vec4 dynamicLightGridOffset = "u_DynamicLightGridOffset";
+	/// @remarks xyz is the froxel grid camera forward vector, w is the number of depth slices per log depth unit.
+	Uniform_vec4 dynamicLightFroxelForward = "u_DynamicLightFroxelForward";
 
-	/// @remarks w not used.
+	/// @remarks xyz is the froxel grid camera left vector, w is 1 / tan(fovX / 2).
+	Uniform_vec4 dynamicLightFroxelLeft = "u_DynamicLightFroxelLeft";
+
+	/// @remarks xyz is the froxel grid camera up vector, w is 1 / tan(fovY / 2).
+	Uniform_vec4 dynamicLightFroxelUp = "u_DynamicLightFroxelUp";
+
+	/// @remarks w is the offset of the indices list containing every light.
 	Uniform_vec4 dynamicLightGridSize = "u_DynamicLightGridSize";
 
 	/// @remarks x is the number of dynamic lights, y is the intensity scale.
@@ -1533,6 +1882,21 @@ struct Uniforms_Entity
 	Uniform_vec4 ambientLight = "u_AmbientLight";
 	Uniform_vec4 directedLight = "u_DirectedLight";
 	Uniform_vec4 lightDirection = "u_LightDirection";
+
+	/// @name Light grid
+	/// @{
+
+	Uniform_int lightGridAmbientSampler = "u_LightGridAmbientSampler";
+	Uniform_int lightGridDirectedSampler = "u_LightGridDirectedSampler";
+	Uniform_int lightGridDirectionSampler = "u_LightGridDirectionSampler";
+
+	/// @remarks xyz is the world space position to texture coordinate scale, w not used.
+	Uniform_vec4 lightGridScale = "u_LightGridScale";
+
+	/// @remarks xyz is the texture coordinate bias, w is the minimum light added to ambient light.
+	Uniform_vec4 lightGrid_Bias_MinLight = "u_LightGrid_Bias_MinLight";
+
+	/// @}
 };
 
 /// @brief Uniforms derived from material state.
@@ -1616,7 +1980,34 @@ struct Uniforms_MaterialStage
 
 namespace util
 {
+	/// @brief Reentrant tokenizer. Holds the current token and line counting state, so separate instances can parse on different threads.
+	class Tokenizer
+	{
+	public:
+		void beginParseSession(const char *name);
+		int getCurrentParseLine() const;
+
+		/// @brief Parse a token out of a string.
+		/// @return Never NULL, just an empty string at the end of the data. If allowLineBreaks is false, an empty string is returned if the next token is on a new line.
+		/// @remarks The returned token is only valid until the next call.
+		char *parse(char **data_p, bool allowLineBreaks = true);
+
+		/// @brief The next token should be an open brace or set depth to 1 if already parsed it. Skips until a matching close brace is found.
+		bool skipBracedSection(char **program, int depth);
+
+		void skipRestOfLine(char **data);
+
+	private:
+		char *skipWhitespace(char *data, bool *hasNewLines);
+
+		char token_[MAX_TOKEN_CHARS];
+		char parseName_[MAX_TOKEN_CHARS];
+		int lines_ = 1;
+		int tokenLine_ = 0;
+	};
+
 	/// @name Parsing
+	/// @brief Wrappers around a thread local Tokenizer.
 	/// @{
 
 	void BeginParseSession(const char *name);
@@ -1649,8 +2040,13 @@ namespace util
 	/// @brief Given a triangulated quad, extract the unique corner vertices.
 	std::array<Vertex *, 4> ExtractQuadCorners(Vertex *vertices, const uint16_t *indices);
 
-	bool IsGeometryOffscreen(const mat4 &mvp, const uint16_t *indices, size_t nIndices, const Vertex *vertices);
-	bool IsGeometryBackfacing(vec3 cameraPosition, const uint16_t *indices, size_t nIndices, const Vertex *vertices, float *shortestVertexDistanceSquared = nullptr);
+	bool IsGeometryOffscreen(const mat4 &mvp, const uint32_t *indices, size_t nIndices, const Vertex *vertices);
+
+	/// @brief Expand mins and maxs by the normalized device coordinates of the geometry.
+	/// @return false if any vertex is behind the camera. mins and maxs are invalid in that case.
+	bool CalculateGeometryScreenBounds(const mat4 &mvp, const uint32_t *indices, size_t nIndices, const Vertex *vertices, vec2 *mins, vec2 *maxs);
+
+	bool IsGeometryBackfacing(vec3 cameraPosition, const uint32_t *indices, size_t nIndices, const Vertex *vertices, float *shortestVertexDistanceSquared = nullptr);
 
 	vec3 MirroredPoint(const vec3 in, const Transform &surface, const Transform &camera);
 	vec3 MirroredVector(const vec3 in, const Transform &surface, const Transform &camera);
@@ -1818,6 +2214,26 @@ namespace window
 
 namespace world
 {
+	/// @brief Fog parameters that only depend on the fog and the camera. Calculated once per camera.
+	struct FogCameraParameters
+	{
+		vec4 color;
+
+		/// @brief Fog distance vector for an identity model matrix.
+		vec4 distance;
+
+		/// @brief Camera forward, scaled by the fog thickness. Used to offset the fog distance by the model position.
+		vec3 distanceForward;
+
+		/// @brief Fog surface plane for an identity model matrix.
+		vec4 depth;
+
+		/// @brief eyeT for an identity model matrix.
+		float eyeT;
+
+		bool hasSurface;
+	};
+
 	void Load(const char *name);
 	void Unload();
 	bool IsLoaded();
@@ -1826,12 +2242,30 @@ namespace world
 	Texture *GetLightmap(int index);
 	bool GetEntityToken(char *buffer, int size);
 	bool HasLightGrid();
+
+	/// @brief Whether the light grid has been uploaded as volume textures so it can be sampled in the generic shader.
+	/// @remarks false if the map has no light grid or 3D textures aren't supported.
+	bool HasLightGridTextures();
+
+	/// @brief Bind the light grid volume textures and set the uniforms used to sample them.
+	/// @param lightOffset Added to positions before sampling. For entities with a separate lighting position.
+	void SetLightGridUniforms(Uniforms_Entity *uniforms, vec3 lightOffset);
+
 	void SampleLightGrid(vec3 position, vec3 *ambientLight, vec3 *directedLight, vec3 *lightDir);
+
+	/// @brief Sample the light grid at n positions, writing n values to each of the output arrays.
+	void SampleLightGrid(const vec3 *positions, size_t n, vec3 *ambientLight, vec3 *directedLight, vec3 *lightDir);
 	bool InPvs(vec3 position);
 	bool InPvs(vec3 position1, vec3 position2);
 	int FindFogIndex(vec3 position, float radius);
 	int FindFogIndex(const Bounds &bounds);
-	void CalculateFog(int fogIndex, const mat4 &modelMatrix, const mat4 &modelViewMatrix, vec3 cameraPosition, vec3 localViewPosition, const mat3 &cameraRotation, vec4 *fogColor, vec4 *fogDistance, vec4 *fogDepth, float *eyeT);
+	size_t GetNumFogs();
+
+	/// @brief Calculate the per camera parameters of a fog.
+	void CalculateFog(int fogIndex, vec3 cameraPosition, const mat3 &cameraRotation, const mat4 &viewMatrix, FogCameraParameters *parameters);
+
+	/// @brief Apply a model matrix to per camera fog parameters.
+	void TransformFog(const FogCameraParameters &parameters, const mat4 &modelMatrix, vec3 localViewPosition, vec4 *fogDistance, vec4 *fogDepth, float *eyeT);
 	int MarkFragments(int numPoints, const vec3 *points, vec3 projection, int maxPoints, vec3 *pointBuffer, int maxFragments, markFragment_t *fragmentBuffer);
 	Bounds GetBounds();
 	Bounds GetBounds(VisibilityId visId);
@@ -1839,10 +2273,19 @@ namespace world
 	const SkySurface &GetSkySurface(VisibilityId visId, size_t index);
 	bool CalculatePortalCamera(VisibilityId visId, vec3 mainCameraPosition, mat3 mainCameraRotation, const mat4 &mvp, const std::vector<renderer::Entity> &entities, vec3 *pvsPosition, Transform *portalCamera, bool *isMirror, Plane *portalPlane);
 	bool CalculateReflectionCamera(VisibilityId visId, vec3 mainCameraPosition, mat3 mainCameraRotation, const mat4 &mvp, Transform *camera, Plane *plane);
+
+	/// @brief Calculate the normalized device coordinate bounds of the portal surfaces found by CalculatePortalCamera.
+	/// @return false if the bounds can't be calculated, e.g. a surface crosses the camera plane.
+	bool CalculatePortalScreenBounds(VisibilityId visId, const mat4 &mvp, vec2 *mins, vec2 *maxs);
+
+	/// @brief Calculate the normalized device coordinate bounds of the reflective surfaces found by CalculateReflectionCamera.
+	/// @return false if the bounds can't be calculated, e.g. a surface crosses the camera plane.
+	bool CalculateReflectionScreenBounds(VisibilityId visId, const mat4 &mvp, vec2 *mins, vec2 *maxs);
 	void RenderPortal(VisibilityId visId, DrawCallList *drawCallList);
 	void RenderReflective(VisibilityId visId, DrawCallList *drawCallList);
 	void UpdateVisibility(VisibilityId visId, vec3 cameraPosition, const uint8_t *areaMask);
-	void Render(VisibilityId visId, DrawCallList *drawCallList, const mat3 &sceneRotation);
+	void Render(VisibilityId visId, DrawCallList *drawCallList, const mat3 &sceneRotation, const Frustum &cameraFrustum);
+	void BenchmarkVisibility(int nIterations);
 	void PickMaterial();
 }
 
@@ -1857,6 +2300,7 @@ extern uint8_t g_gammaTable[g_gammaTableSize];
 extern bool g_hardwareGammaEnabled;
 extern ConsoleVariables g_cvars;
 extern const uint8_t *g_externalVisData;
+extern JobSystem *g_jobSystem;
 extern MaterialCache *g_materialCache;
 extern ModelCache *g_modelCache;
 extern TextureCache *g_textureCache;
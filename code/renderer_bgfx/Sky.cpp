@@ -46,9 +46,6 @@ static vec3 sky_clip[6] =
 static float	sky_mins[2][6], sky_maxs[2][6];
 static float	sky_min, sky_max;
 
-static vec3	s_skyPoints[SKY_SUBDIVISIONS+1][SKY_SUBDIVISIONS+1];
-static float	s_skyTexCoords[SKY_SUBDIVISIONS+1][SKY_SUBDIVISIONS+1][2];
-
 static float s_cloudTexCoords[6][SKY_SUBDIVISIONS+1][SKY_SUBDIVISIONS+1][2];
 static float s_cloudTexP[6][SKY_SUBDIVISIONS+1][SKY_SUBDIVISIONS+1];
 
@@ -304,236 +301,156 @@ static void MakeSkyVec(float zMax, float s, float t, int axis, float outSt[2], v
 	}
 }
 
-/// Either tessellate, or do a dry run to calculate the total number of vertices and indices to use.
-static bool TessellateSkyBoxSide(int i, Vertex *vertices, uint16_t *indices, uint32_t *nVertices, uint32_t *nIndices, vec3 cameraPosition, float zMax)
+/// @brief Calculate the visible grid extents of a sky box face from the clipped sky polygon extents.
+/// @param extents Output: min s, min t, max s and max t, in the range [0, SKY_SUBDIVISIONS].
+/// @return false if no part of the face is visible.
+static bool CalculateFaceExtents(const float mins[2][6], const float maxs[2][6], int face, int extents[4])
 {
-	assert((vertices && indices) || (nVertices && nIndices));
-	
-	uint32_t currentVertex = 0, currentIndex = 0;
-
-	sky_mins[0][i] = floor( sky_mins[0][i] * HALF_SKY_SUBDIVISIONS ) / HALF_SKY_SUBDIVISIONS;
-	sky_mins[1][i] = floor( sky_mins[1][i] * HALF_SKY_SUBDIVISIONS ) / HALF_SKY_SUBDIVISIONS;
-	sky_maxs[0][i] = ceil( sky_maxs[0][i] * HALF_SKY_SUBDIVISIONS ) / HALF_SKY_SUBDIVISIONS;
-	sky_maxs[1][i] = ceil( sky_maxs[1][i] * HALF_SKY_SUBDIVISIONS ) / HALF_SKY_SUBDIVISIONS;
+	const float faceMins[2] = { floor(mins[0][face] * HALF_SKY_SUBDIVISIONS) / HALF_SKY_SUBDIVISIONS, floor(mins[1][face] * HALF_SKY_SUBDIVISIONS) / HALF_SKY_SUBDIVISIONS };
+	const float faceMaxs[2] = { ceil(maxs[0][face] * HALF_SKY_SUBDIVISIONS) / HALF_SKY_SUBDIVISIONS, ceil(maxs[1][face] * HALF_SKY_SUBDIVISIONS) / HALF_SKY_SUBDIVISIONS };
 
-	if (sky_mins[0][i] >= sky_maxs[0][i] || sky_mins[1][i] >= sky_maxs[1][i])
+	if (faceMins[0] >= faceMaxs[0] || faceMins[1] >= faceMaxs[1])
 		return false;
 
-	int sky_mins_subd[2], sky_maxs_subd[2];;
-	sky_mins_subd[0] = int(sky_mins[0][i] * HALF_SKY_SUBDIVISIONS);
-	sky_mins_subd[1] = int(sky_mins[1][i] * HALF_SKY_SUBDIVISIONS);
-	sky_maxs_subd[0] = int(sky_maxs[0][i] * HALF_SKY_SUBDIVISIONS);
-	sky_maxs_subd[1] = int(sky_maxs[1][i] * HALF_SKY_SUBDIVISIONS);
-
-	if ( sky_mins_subd[0] < -HALF_SKY_SUBDIVISIONS ) 
-		sky_mins_subd[0] = -HALF_SKY_SUBDIVISIONS;
-	else if ( sky_mins_subd[0] > HALF_SKY_SUBDIVISIONS ) 
-		sky_mins_subd[0] = HALF_SKY_SUBDIVISIONS;
-	if ( sky_mins_subd[1] < -HALF_SKY_SUBDIVISIONS )
-		sky_mins_subd[1] = -HALF_SKY_SUBDIVISIONS;
-	else if ( sky_mins_subd[1] > HALF_SKY_SUBDIVISIONS ) 
-		sky_mins_subd[1] = HALF_SKY_SUBDIVISIONS;
-
-	if ( sky_maxs_subd[0] < -HALF_SKY_SUBDIVISIONS ) 
-		sky_maxs_subd[0] = -HALF_SKY_SUBDIVISIONS;
-	else if ( sky_maxs_subd[0] > HALF_SKY_SUBDIVISIONS ) 
-		sky_maxs_subd[0] = HALF_SKY_SUBDIVISIONS;
-	if ( sky_maxs_subd[1] < -HALF_SKY_SUBDIVISIONS ) 
-		sky_maxs_subd[1] = -HALF_SKY_SUBDIVISIONS;
-	else if ( sky_maxs_subd[1] > HALF_SKY_SUBDIVISIONS ) 
-		sky_maxs_subd[1] = HALF_SKY_SUBDIVISIONS;
-
-	//
-	// iterate through the subdivisions
-	//
-	for (int t = sky_mins_subd[1]+HALF_SKY_SUBDIVISIONS; t <= sky_maxs_subd[1]+HALF_SKY_SUBDIVISIONS; t++ )
+	extents[0] = std::lrintf(faceMins[0] * HALF_SKY_SUBDIVISIONS);
+	extents[1] = std::lrintf(faceMins[1] * HALF_SKY_SUBDIVISIONS);
+	extents[2] = std::lrintf(faceMaxs[0] * HALF_SKY_SUBDIVISIONS);
+	extents[3] = std::lrintf(faceMaxs[1] * HALF_SKY_SUBDIVISIONS);
+
+	for (int i = 0; i < 4; i++)
 	{
-		for (int s = sky_mins_subd[0]+HALF_SKY_SUBDIVISIONS; s <= sky_maxs_subd[0]+HALF_SKY_SUBDIVISIONS; s++ )
-		{
-			MakeSkyVec(zMax, ( s - HALF_SKY_SUBDIVISIONS ) / ( float ) HALF_SKY_SUBDIVISIONS, 
-						( t - HALF_SKY_SUBDIVISIONS ) / ( float ) HALF_SKY_SUBDIVISIONS, 
-						i, 
-						s_skyTexCoords[t][s], 
-						&s_skyPoints[t][s]);
-		}
+		extents[i] = std::min(std::max(extents[i], -HALF_SKY_SUBDIVISIONS), HALF_SKY_SUBDIVISIONS) + HALF_SKY_SUBDIVISIONS;
 	}
 
-	const uint32_t startVertex = currentVertex;
+	return extents[0] < extents[2] && extents[1] < extents[3];
+}
 
-	for (int t = sky_mins_subd[1]+HALF_SKY_SUBDIVISIONS; t <= sky_maxs_subd[1]+HALF_SKY_SUBDIVISIONS; t++ )
-	{
-		for (int s = sky_mins_subd[0]+HALF_SKY_SUBDIVISIONS; s <= sky_maxs_subd[0]+HALF_SKY_SUBDIVISIONS; s++ )
-		{
-			if (vertices)
-			{
-				vertices[currentVertex].pos = s_skyPoints[t][s] + cameraPosition;
-				vertices[currentVertex].setTexCoord(s_skyTexCoords[t][s][0], s_skyTexCoords[t][s][1]);
-			}
+static const int s_nFaceVertices = (SKY_SUBDIVISIONS + 1) * (SKY_SUBDIVISIONS + 1);
 
-			currentVertex++;
-		}
-	}
+/// @brief Sky box and cloud box geometry is the same for every camera and frame. Only the visible part of each face changes, so it's drawn with an index buffer for that part of the face grid.
+/// @remarks Vertices are relative to the camera, with a box size of 1. The camera position and zMax are applied with the model matrix.
+/// @{
+static VertexBuffer s_skyBoxVertexBuffer;
+
+struct CloudBoxVertexBuffer
+{
+	float cloudHeight;
+	VertexBuffer vertexBuffer;
+};
+
+static std::vector<std::unique_ptr<CloudBoxVertexBuffer>> s_cloudBoxVertexBuffers;
 
-	int tHeight = sky_maxs_subd[1] - sky_mins_subd[1] + 1;
-	int sWidth = sky_maxs_subd[0] - sky_mins_subd[0] + 1;
+/// @brief Face grid index buffers, keyed by the visible face extents.
+static std::map<uint32_t, std::unique_ptr<IndexBuffer>> s_faceIndexBuffers;
+/// @}
+
+static void CreateFaceVertices(int face, const float texCoords[SKY_SUBDIVISIONS+1][SKY_SUBDIVISIONS+1][2], Vertex *vertices)
+{
+	// Box size is zMax / 1.75.
+	const float zMax = 1.75f;
 
-	for (int t = 0; t < tHeight-1; t++ )
+	for (int t = 0; t <= SKY_SUBDIVISIONS; t++)
 	{
-		for (int s = 0; s < sWidth-1; s++ )
+		for (int s = 0; s <= SKY_SUBDIVISIONS; s++)
 		{
-			if (indices)
+			float st[2];
+			Vertex &v = vertices[s + t * (SKY_SUBDIVISIONS + 1)];
+			MakeSkyVec(zMax, (s - HALF_SKY_SUBDIVISIONS) / (float)HALF_SKY_SUBDIVISIONS, (t - HALF_SKY_SUBDIVISIONS) / (float)HALF_SKY_SUBDIVISIONS, face, st, &v.pos);
+
+			if (texCoords)
 			{
-				indices[currentIndex + 0] = startVertex + s + t * sWidth;
-				indices[currentIndex + 1] = startVertex + s + (t + 1) * sWidth;
-				indices[currentIndex + 2] = startVertex + s + 1 + t * sWidth;
-				indices[currentIndex + 3] = startVertex + s + (t + 1) * sWidth;
-				indices[currentIndex + 4] = startVertex + s + 1 + (t + 1) * sWidth;
-				indices[currentIndex + 5] = startVertex + s + 1 + t * sWidth;
+				v.setTexCoord(texCoords[t][s][0], texCoords[t][s][1]);
+			}
+			else
+			{
+				v.setTexCoord(st[0], st[1]);
 			}
-
-			currentIndex += 6;
 		}
 	}
-
-	if (nVertices && nIndices)
-	{
-		*nVertices = currentVertex;
-		*nIndices = currentIndex;
-	}
-
-	return true;
 }
 
-/// Either tessellate, or do a dry run to calculate the total number of vertices and indices to use.
-static void TessellateCloudBox(Vertex *vertices, uint16_t *indices, uint32_t *nVertices, uint32_t *nIndices, vec3 cameraPosition, float zMax)
+static bgfx::VertexBufferHandle GetSkyBoxVertexBuffer()
 {
-	assert((vertices && indices) || (nVertices && nIndices));
-	sky_min = 1.0 / 256.0f;		// FIXME: not correct?
-	sky_max = 255.0 / 256.0f;
-	uint32_t currentVertex = 0, currentIndex = 0;
-
-	for (int sideIndex = 0; sideIndex < 6; sideIndex++)
+	if (!bgfx::isValid(s_skyBoxVertexBuffer.handle))
 	{
-		int sky_mins_subd[2], sky_maxs_subd[2];
-		float MIN_T;
+		const bgfx::Memory *mem = bgfx::alloc(sizeof(Vertex) * s_nFaceVertices * 6);
+		auto vertices = (Vertex *)mem->data;
+		sky_min = 0;
+		sky_max = 1;
 
-		if (1) // FIXME? shader->sky.fullClouds)
-		{
-			MIN_T = -HALF_SKY_SUBDIVISIONS;
-
-			// still don't want to draw the bottom, even if fullClouds
-			if (sideIndex == 5)
-				continue;
-		}
-		else
+		for (int i = 0; i < 6; i++)
 		{
-			switch(sideIndex)
-			{
-			case 0:
-			case 1:
-			case 2:
-			case 3:
-				MIN_T = -1;
-				break;
-			case 5:
-				// don't draw clouds beneath you
-				continue;
-			case 4:		// top
-			default:
-				MIN_T = -HALF_SKY_SUBDIVISIONS;
-				break;
-			}
+			std::fill(&vertices[i * s_nFaceVertices], &vertices[(i + 1) * s_nFaceVertices], Vertex());
+			CreateFaceVertices(i, nullptr, &vertices[i * s_nFaceVertices]);
 		}
 
-		sky_mins[0][sideIndex] = floor(sky_mins[0][sideIndex] * HALF_SKY_SUBDIVISIONS) / HALF_SKY_SUBDIVISIONS;
-		sky_mins[1][sideIndex] = floor(sky_mins[1][sideIndex] * HALF_SKY_SUBDIVISIONS) / HALF_SKY_SUBDIVISIONS;
-		sky_maxs[0][sideIndex] = ceil(sky_maxs[0][sideIndex] * HALF_SKY_SUBDIVISIONS) / HALF_SKY_SUBDIVISIONS;
-		sky_maxs[1][sideIndex] = ceil(sky_maxs[1][sideIndex] * HALF_SKY_SUBDIVISIONS) / HALF_SKY_SUBDIVISIONS;
+		s_skyBoxVertexBuffer.handle = bgfx::createVertexBuffer(mem, Vertex::decl);
+	}
 
-		if ((sky_mins[0][sideIndex] >= sky_maxs[0][sideIndex]) || (sky_mins[1][sideIndex] >= sky_maxs[1][sideIndex]))
-			continue;
+	return s_skyBoxVertexBuffer.handle;
+}
 
-		sky_mins_subd[0] = std::lrintf(sky_mins[0][sideIndex] * HALF_SKY_SUBDIVISIONS);
-		sky_mins_subd[1] = std::lrintf(sky_mins[1][sideIndex] * HALF_SKY_SUBDIVISIONS);
-		sky_maxs_subd[0] = std::lrintf(sky_maxs[0][sideIndex] * HALF_SKY_SUBDIVISIONS);
-		sky_maxs_subd[1] = std::lrintf(sky_maxs[1][sideIndex] * HALF_SKY_SUBDIVISIONS);
-
-		if (sky_mins_subd[0] < -HALF_SKY_SUBDIVISIONS) 
-			sky_mins_subd[0] = -HALF_SKY_SUBDIVISIONS;
-		else if (sky_mins_subd[0] > HALF_SKY_SUBDIVISIONS) 
-			sky_mins_subd[0] = HALF_SKY_SUBDIVISIONS;
-		if (sky_mins_subd[1] < MIN_T)
-			sky_mins_subd[1] = (int)MIN_T;
-		else if (sky_mins_subd[1] > HALF_SKY_SUBDIVISIONS) 
-			sky_mins_subd[1] = HALF_SKY_SUBDIVISIONS;
-
-		if (sky_maxs_subd[0] < -HALF_SKY_SUBDIVISIONS) 
-			sky_maxs_subd[0] = -HALF_SKY_SUBDIVISIONS;
-		else if (sky_maxs_subd[0] > HALF_SKY_SUBDIVISIONS) 
-			sky_maxs_subd[0] = HALF_SKY_SUBDIVISIONS;
-		if (sky_maxs_subd[1] < MIN_T)
-			sky_maxs_subd[1] = (int)MIN_T;
-		else if (sky_maxs_subd[1] > HALF_SKY_SUBDIVISIONS) 
-			sky_maxs_subd[1] = HALF_SKY_SUBDIVISIONS;
-
-		// iterate through the subdivisions
-		for (int t = sky_mins_subd[1]+HALF_SKY_SUBDIVISIONS; t <= sky_maxs_subd[1]+HALF_SKY_SUBDIVISIONS; t++)
-		{
-			for (int s = sky_mins_subd[0]+HALF_SKY_SUBDIVISIONS; s <= sky_maxs_subd[0]+HALF_SKY_SUBDIVISIONS; s++)
-			{
-				MakeSkyVec(zMax, (s - HALF_SKY_SUBDIVISIONS) / (float) HALF_SKY_SUBDIVISIONS, 
-							(t - HALF_SKY_SUBDIVISIONS) / (float) HALF_SKY_SUBDIVISIONS, 
-							sideIndex, 
-							NULL,
-							&s_skyPoints[t][s]);
+static bgfx::VertexBufferHandle GetCloudBoxVertexBuffer(float cloudHeight)
+{
+	for (const std::unique_ptr<CloudBoxVertexBuffer> &cloudBox : s_cloudBoxVertexBuffers)
+	{
+		if (cloudBox->cloudHeight == cloudHeight)
+			return cloudBox->vertexBuffer.handle;
+	}
 
-				s_skyTexCoords[t][s][0] = s_cloudTexCoords[sideIndex][t][s][0];
-				s_skyTexCoords[t][s][1] = s_cloudTexCoords[sideIndex][t][s][1];
-			}
-		}
+	// Cloud texture coordinates depend on the cloud height, which differs between sky materials.
+	Sky_InitializeTexCoords(cloudHeight);
+	const bgfx::Memory *mem = bgfx::alloc(sizeof(Vertex) * s_nFaceVertices * 6);
+	auto vertices = (Vertex *)mem->data;
 
-		int tHeight = sky_maxs_subd[1] - sky_mins_subd[1] + 1;
-		int sWidth = sky_maxs_subd[0] - sky_mins_subd[0] + 1;
-		const uint32_t startVertex = currentVertex;
+	for (int i = 0; i < 6; i++)
+	{
+		std::fill(&vertices[i * s_nFaceVertices], &vertices[(i + 1) * s_nFaceVertices], Vertex());
+		CreateFaceVertices(i, s_cloudTexCoords[i], &vertices[i * s_nFaceVertices]);
+	}
 
-		for (int t = sky_mins_subd[1]+HALF_SKY_SUBDIVISIONS; t <= sky_maxs_subd[1]+HALF_SKY_SUBDIVISIONS; t++)
-		{
-			for (int s = sky_mins_subd[0]+HALF_SKY_SUBDIVISIONS; s <= sky_maxs_subd[0]+HALF_SKY_SUBDIVISIONS; s++)
-			{
-				if (vertices)
-				{
-					vertices[currentVertex].pos = s_skyPoints[t][s] + cameraPosition;
-					vertices[currentVertex].setTexCoord(s_skyTexCoords[t][s][0], s_skyTexCoords[t][s][1]);
-				}
+	auto cloudBox = std::make_unique<CloudBoxVertexBuffer>();
+	cloudBox->cloudHeight = cloudHeight;
+	cloudBox->vertexBuffer.handle = bgfx::createVertexBuffer(mem, Vertex::decl);
+	s_cloudBoxVertexBuffers.push_back(std::move(cloudBox));
+	return s_cloudBoxVertexBuffers.back()->vertexBuffer.handle;
+}
 
-				currentVertex++;
-			}
-		}
+static bgfx::IndexBufferHandle GetFaceIndexBuffer(const int extents[4], uint32_t *nIndices)
+{
+	assert(nIndices);
+	const int sWidth = extents[2] - extents[0] + 1;
+	const int tHeight = extents[3] - extents[1] + 1;
+	*nIndices = uint32_t((sWidth - 1) * (tHeight - 1) * 6);
+	const uint32_t key = extents[0] | (extents[1] << 8) | (extents[2] << 16) | (extents[3] << 24);
+	std::unique_ptr<IndexBuffer> &ib = s_faceIndexBuffers[key];
+
+	if (!ib)
+	{
+		const bgfx::Memory *mem = bgfx::alloc(sizeof(uint16_t) * *nIndices);
+		auto indices = (uint16_t *)mem->data;
+		uint32_t currentIndex = 0;
 
-		for (int t = 0; t < tHeight-1; t++)
-		{	
-			for (int s = 0; s < sWidth-1; s++)
+		for (int t = extents[1]; t < extents[3]; t++)
+		{
+			for (int s = extents[0]; s < extents[2]; s++)
 			{
-				if (indices)
-				{
-					indices[currentIndex + 0] = startVertex + s + t * sWidth;
-					indices[currentIndex + 1] = startVertex + s + (t + 1) * sWidth;
-					indices[currentIndex + 2] = startVertex + s + 1 + t * sWidth;
-					indices[currentIndex + 3] = startVertex + s + (t + 1) * sWidth;
-					indices[currentIndex + 4] = startVertex + s + 1 + (t + 1) * sWidth;
-					indices[currentIndex + 5] = startVertex + s + 1 + t * sWidth;
-				}
-				
+				const uint16_t stride = SKY_SUBDIVISIONS + 1;
+				indices[currentIndex + 0] = uint16_t(s + t * stride);
+				indices[currentIndex + 1] = uint16_t(s + (t + 1) * stride);
+				indices[currentIndex + 2] = uint16_t(s + 1 + t * stride);
+				indices[currentIndex + 3] = uint16_t(s + (t + 1) * stride);
+				indices[currentIndex + 4] = uint16_t(s + 1 + (t + 1) * stride);
+				indices[currentIndex + 5] = uint16_t(s + 1 + t * stride);
 				currentIndex += 6;
 			}
 		}
-	}
 
-	if (nVertices && nIndices)
-	{
-		*nVertices = currentVertex;
-		*nIndices = currentIndex;
+		ib = std::make_unique<IndexBuffer>();
+		ib->handle = bgfx::createIndexBuffer(mem);
 	}
+
+	return ib->handle;
 }
 
 void Sky_InitializeTexCoords(float heightCloud)
@@ -587,24 +504,19 @@ void Sky_InitializeTexCoords(float heightCloud)
 	}
 }
 
-void Sky_Render(DrawCallList *drawCallList, vec3 cameraPosition, float zMax, const SkySurface &surface)
+/// @brief Clip the sky polygons to the sky box faces to find the visible part of each face.
+/// @remarks The clipped extents only change when the camera moves, or when visibility changes and the sky surface is rebuilt.
+static void ClipSkySurface(const SkySurface &surface, vec3 cameraPosition)
 {
-	assert(drawCallList);
-
-	const bool shouldDrawSkyBox = surface.material->sky.outerbox[0] && surface.material->sky.outerbox[0] != g_textureCache->getDefault();
-	const bool shouldDrawCloudBox = surface.material->sky.cloudHeight > 0 && surface.material->stages[0].active;
-
-	if (!shouldDrawSkyBox && !shouldDrawCloudBox)
+	if (surface.hasClippedExtents && surface.clippedCameraPosition == cameraPosition)
 		return;
 
-	// Clear sky box.
 	for (size_t i = 0; i < 6; i++)
 	{
 		sky_mins[0][i] = sky_mins[1][i] = 9999;
 		sky_maxs[0][i] = sky_maxs[1][i] = -9999;
 	}
 
-	// Clip sky polygons.
 	for (size_t i = 0; i < surface.vertices.size(); i += 3)
 	{
 		vec3 p[5]; // need one extra point for clipping
@@ -617,71 +529,88 @@ void Sky_Render(DrawCallList *drawCallList, vec3 cameraPosition, float zMax, con
 		ClipSkyPolygon(3, p, 0);
 	}
 
-	// Draw the skybox.
-	if (shouldDrawSkyBox)
+	memcpy(surface.clippedMins, sky_mins, sizeof(sky_mins));
+	memcpy(surface.clippedMaxs, sky_maxs, sizeof(sky_maxs));
+	surface.clippedCameraPosition = cameraPosition;
+	surface.hasClippedExtents = true;
+}
+
+static void RenderSkySurface(DrawCallList *drawCallList, vec3 cameraPosition, float zMax, const SkySurface &surface, bool drawSkyBox, bool drawCloudBox, int skyBoxFlags)
+{
+	ClipSkySurface(surface, cameraPosition);
+
+	// Only the camera translation and zMax change per frame.
+	const mat4 modelMatrix = mat4::translate(cameraPosition) * mat4::scale(vec3(zMax / 1.75f));
+
+	for (int i = 0; i < 6; i++)
 	{
-		for (int i = 0; i < 6; i++)
-		{
-			uint32_t nVertices, nIndices;
-			sky_min = 0;
-			sky_max = 1;
-			memset( s_skyTexCoords, 0, sizeof( s_skyTexCoords ) );
+		int extents[4];
 
-			if (!TessellateSkyBoxSide(i, nullptr, nullptr, &nVertices, &nIndices, cameraPosition, zMax))
-				continue;
+		if (!CalculateFaceExtents(surface.clippedMins, surface.clippedMaxs, i, extents))
+			continue;
 
-			DrawCall dc;
+		DrawCall dc;
+		dc.vb.type = dc.ib.type = DrawCall::BufferType::Static;
+		dc.vb.firstVertex = uint32_t(i * s_nFaceVertices);
+		dc.vb.nVertices = s_nFaceVertices;
+		dc.ib.staticHandle = GetFaceIndexBuffer(extents, &dc.ib.nIndices);
+		dc.material = surface.material;
+		dc.modelMatrix = modelMatrix;
 
-			if (!bgfx::allocTransientBuffers(&dc.vb.transientHandle, Vertex::decl, nVertices, &dc.ib.transientHandle, nIndices)) 
-			{
-				WarnOnce(WarnOnceId::TransientBuffer);
-				return;
-			}
+		// Write depth as 1.
+		dc.zOffset = 1.0f;
+		dc.zScale = 0.0f;
 
-			sky_min = 0;
-			sky_max = 1;
-			memset( s_skyTexCoords, 0, sizeof( s_skyTexCoords ) );
-			TessellateSkyBoxSide(i, (Vertex *)dc.vb.transientHandle.data, (uint16_t *)dc.ib.transientHandle.data, nullptr, nullptr, cameraPosition, zMax);
-			dc.vb.type = dc.ib.type = DrawCall::BufferType::Transient;
-			dc.vb.nVertices = nVertices;
-			dc.ib.nIndices = nIndices;
-			dc.flags = DrawCallFlags::Sky | DrawCallFlags::Skybox;
-			dc.material = surface.material;
-			dc.skyboxSide = i;
-			dc.state |= BGFX_STATE_DEPTH_TEST_LEQUAL;
-
-			// Write depth as 1.
-			dc.zOffset = 1.0f;
-			dc.zScale = 0.0f;
+		// Draw the skybox.
+		if (drawSkyBox)
+		{
+			DrawCall skyBoxDc = dc;
+			skyBoxDc.vb.staticHandle = GetSkyBoxVertexBuffer();
+			skyBoxDc.flags = DrawCallFlags::Sky | DrawCallFlags::Skybox | skyBoxFlags;
+			skyBoxDc.skyboxSide = i;
+			skyBoxDc.state |= BGFX_STATE_DEPTH_TEST_LEQUAL;
+			drawCallList->push_back(skyBoxDc);
+		}
+
+		// Draw the clouds. Still don't want to draw the bottom, even if fullClouds.
+		if (drawCloudBox && i != 5)
+		{
+			dc.vb.staticHandle = GetCloudBoxVertexBuffer(surface.material->sky.cloudHeight);
+			dc.flags = DrawCallFlags::Sky;
+			dc.sort = 1; // Render after the skybox.
 			drawCallList->push_back(dc);
 		}
 	}
+}
 
-	// Draw the clouds.
-	if (shouldDrawCloudBox)
-	{
-		uint32_t nVertices, nIndices;
-		TessellateCloudBox(nullptr, nullptr, &nVertices, &nIndices, cameraPosition, zMax);
-		DrawCall dc;
+void Sky_Render(DrawCallList *drawCallList, vec3 cameraPosition, float zMax, const SkySurface &surface)
+{
+	assert(drawCallList);
 
-		if (!bgfx::allocTransientBuffers(&dc.vb.transientHandle, Vertex::decl, nVertices, &dc.ib.transientHandle, nIndices)) 
-		{
-			WarnOnce(WarnOnceId::TransientBuffer);
-			return;
-		}
+	const bool shouldDrawSkyBox = surface.material->sky.outerbox[0] && surface.material->sky.outerbox[0] != g_textureCache->getDefault();
+	const bool shouldDrawCloudBox = surface.material->sky.cloudHeight > 0 && surface.material->stages[0].active;
 
-		TessellateCloudBox((Vertex *)dc.vb.transientHandle.data, (uint16_t *)dc.ib.transientHandle.data, nullptr, nullptr, cameraPosition, zMax);
-		dc.vb.type = dc.ib.type = DrawCall::BufferType::Transient;
-		dc.vb.nVertices = nVertices;
-		dc.ib.nIndices = nIndices;
-		dc.flags = DrawCallFlags::Sky;
-		dc.material = surface.material;
-		dc.sort = 1; // Render after the skybox.
+	if (!shouldDrawSkyBox && !shouldDrawCloudBox)
+		return;
 
-		// Write depth as 1.
-		dc.zOffset = 1.0f;
-		dc.zScale = 0.0f;
-		drawCallList->push_back(dc);
+	RenderSkySurface(drawCallList, cameraPosition, zMax, surface, shouldDrawSkyBox, shouldDrawCloudBox, DrawCallFlags::None);
+}
+
+void Sky_RenderSkyboxPortal(DrawCallList *drawCallList, vec3 cameraPosition, float zMax, const SkySurface &surface)
+{
+	assert(drawCallList);
+	RenderSkySurface(drawCallList, cameraPosition, zMax, surface, true, false, DrawCallFlags::SkyboxPortal);
+}
+
+void Sky_Shutdown()
+{
+	s_cloudBoxVertexBuffers.clear();
+	s_faceIndexBuffers.clear();
+
+	if (bgfx::isValid(s_skyBoxVertexBuffer.handle))
+	{
+		bgfx::destroy(s_skyBoxVertexBuffer.handle);
+		s_skyBoxVertexBuffer.handle.idx = bgfx::kInvalidHandle;
 	}
 }
 
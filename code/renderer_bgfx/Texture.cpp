@@ -21,9 +21,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "Precompiled.h"
 #pragma hdrstop
+#include "bimg/bimg.h"
+#include "bx/hash.h"
 
 namespace renderer {
 
+/// @brief Bump this whenever the compressed texture data changes, e.g. the block compressor.
+static const uint32_t s_compressedTextureCacheVersion = 1;
+
 void Texture::initialize(const char *name, const Image &image, int flags, bgfx::TextureFormat::Enum format)
 {
 	strcpy(name_, name);
@@ -46,6 +51,7 @@ void Texture::initialize(const char *name, const Image &image, int flags, bgfx::
 
 	// Create with data: immutable. Create without data: mutable, update whenever.
 	handle_ = bgfx::createTexture2D(width_, height_, nMips_ > 1, 1, format_, calculateBgfxFlags(), (flags_ & TextureFlags::Mutable) ? nullptr : mem);
+	memorySize_ = mem ? mem->size : uint32_t(width_ * height_ * 4);
 
 #ifdef _DEBUG
 	bgfx::setName(handle_, name_);
@@ -57,6 +63,49 @@ void Texture::initialize(const char *name, const Image &image, int flags, bgfx::
 	}
 }
 
+void Texture::reload(const Image &image, bgfx::TextureFormat::Enum format, int droppedMips)
+{
+	assert(image.data);
+	assert(droppedMips < image.nMips);
+
+	if (!sharesHandle_)
+		bgfx::destroy(handle_);
+
+	width_ = image.width;
+	height_ = image.height;
+	nMips_ = image.nMips;
+	format_ = format;
+	const bgfx::Memory *mem;
+
+	if (droppedMips > 0)
+	{
+		// The remaining mips are at the end of the image data.
+		const int mipWidth = std::max(1, width_ >> droppedMips), mipHeight = std::max(1, height_ >> droppedMips);
+		bgfx::TextureInfo info;
+		bgfx::calcTextureSize(info, (uint16_t)mipWidth, (uint16_t)mipHeight, 1, false, true, 1, format_);
+		mem = bgfx::copy(&image.data[image.dataSize - info.storageSize], info.storageSize);
+
+		if (image.release)
+			image.release(image.data, nullptr);
+
+		handle_ = bgfx::createTexture2D((uint16_t)mipWidth, (uint16_t)mipHeight, true, 1, format_, calculateBgfxFlags(), mem);
+	}
+	else
+	{
+		mem = bgfx::makeRef(image.data, image.dataSize, image.release);
+		handle_ = bgfx::createTexture2D(width_, height_, nMips_ > 1, 1, format_, calculateBgfxFlags(), mem);
+	}
+
+#ifdef _DEBUG
+	bgfx::setName(handle_, name_);
+#endif
+
+	sharesHandle_ = false;
+	evicted_ = false;
+	droppedMips_ = droppedMips;
+	memorySize_ = mem->size;
+}
+
 void Texture::initialize(const char *name, bgfx::TextureHandle handle)
 {
 	strcpy(name_, name);
@@ -103,6 +152,9 @@ uint32_t Texture::calculateBgfxFlags() const
 
 TextureCache::TextureCache() : hashTable_()
 {
+	const bgfx::Caps *caps = bgfx::getCaps();
+	compressionSupported_ = (caps->formats[bgfx::TextureFormat::BC1] & BGFX_CAPS_FORMAT_TEXTURE_2D) && (caps->formats[bgfx::TextureFormat::BC3] & BGFX_CAPS_FORMAT_TEXTURE_2D);
+
 	// Default texture (black box with white border).
 	memset(defaultImageData_, 32, defaultImageDataSize_);
 
@@ -150,26 +202,22 @@ TextureCache::TextureCache() : hashTable_()
 
 TextureCache::~TextureCache()
 {
-	for (size_t i = 0; i < nTextures_; i++)
+	for (const std::unique_ptr<Texture> &texture : textures_)
 	{
-		bgfx::destroy(textures_[i].handle_);
+		if (!texture->sharesHandle_)
+			bgfx::destroy(texture->handle_);
 	}
-}
 
-Texture *TextureCache::create(const char *name, const Image &image, int flags, bgfx::TextureFormat::Enum format)
-{
-	if (strlen(name) >= MAX_QPATH)
+	for (const std::unique_ptr<PendingTexture> &pending : pendingTextures_)
 	{
-		interface::Error("Texture name \"%s\" is too long", name);
-	}
-
-	if (nTextures_ == maxTextures_)
-	{
-		interface::Error("Exceeded max textures");
+		if (pending->image.data && pending->image.release)
+			pending->image.release(pending->image.data, nullptr);
 	}
+}
 
-	Texture *texture = &textures_[nTextures_];
-	nTextures_++;
+Texture *TextureCache::create(const char *name, const Image &image, int flags, bgfx::TextureFormat::Enum format)
+{
+	Texture *texture = allocateTexture(name);
 	texture->initialize(name, image, flags, format);
 	hashTexture(texture);
 	return texture;
@@ -177,21 +225,27 @@ Texture *TextureCache::create(const char *name, const Image &image, int flags, b
 
 Texture *TextureCache::create(const char *name, bgfx::TextureHandle handle)
 {
-	if (strlen(name) >= MAX_QPATH)
+	Texture *texture = allocateTexture(name);
+	texture->initialize(name, handle);
+	hashTexture(texture);
+	return texture;
+}
+
+static int CalculateImageFlags(int textureFlags)
+{
+	int imageFlags = 0;
+
+	if (textureFlags & (TextureFlags::Mipmap | TextureFlags::Picmip))
 	{
-		interface::Error("Texture name \"%s\" is too long", name);
+		imageFlags |= CreateImageFlags::GenerateMipmaps;
 	}
 
-	if (nTextures_ == maxTextures_)
+	if (textureFlags & TextureFlags::Picmip)
 	{
-		interface::Error("Exceeded max textures");
-}
+		imageFlags |= CreateImageFlags::Picmip;
+	}
 
-	Texture *texture = &textures_[nTextures_];
-	nTextures_++;
-	texture->initialize(name, handle);
-	hashTexture(texture);
-	return texture;
+	return imageFlags;
 }
 
 Texture *TextureCache::find(const char *name, int flags)
@@ -220,24 +274,354 @@ Texture *TextureCache::find(const char *name, int flags)
 	}
 
 	// Load it from a file.
-	int imageFlags = 0;
+	if (flags & TextureFlags::Mutable)
+	{
+		Image image = LoadImage(name, CalculateImageFlags(flags));
+
+		if (!image.data)
+			return nullptr;
+
+		return create(name, image, flags, bgfx::TextureFormat::RGBA8);
+	}
+
+	// Read the file now, so callers still get nullptr if it doesn't exist. Decoding is deferred until processPendingTextures.
+	std::unique_ptr<PendingTexture> pending = readPendingTexture(name, flags);
+
+	if (!pending)
+		return nullptr;
+
+	// Use the default texture as a placeholder.
+	Texture *texture = allocateTexture(name);
+	strcpy(texture->name_, name);
+	texture->flags_ = flags;
+	texture->width_ = defaultTexture_->width_;
+	texture->height_ = defaultTexture_->height_;
+	texture->nMips_ = defaultTexture_->nMips_;
+	texture->format_ = defaultTexture_->format_;
+	texture->handle_ = defaultTexture_->handle_;
+	texture->sharesHandle_ = true;
+	texture->reloadable_ = true;
+	texture->reloading_ = true;
+	hashTexture(texture);
+	pending->texture = texture;
+	pendingTextures_.push_back(std::move(pending));
 
-	if (flags & (TextureFlags::Mipmap | TextureFlags::Picmip))
+	// Compressing is also done by processPendingTextures, so it's used even if async decoding is disabled.
+	if (!g_cvars.asyncTextureDecode.getBool())
 	{
-		imageFlags |= CreateImageFlags::GenerateMipmaps;
+		processPendingTextures();
 	}
 
-	if (flags & TextureFlags::Picmip)
+	return texture;
+}
+
+void TextureCache::processPendingTextures(size_t maxTextures)
+{
+	const size_t nPending = std::min(pendingTextures_.size(), maxTextures);
+
+	if (nPending == 0)
+		return;
+
+	g_jobSystem->parallelFor(nPending, 1, [this](size_t begin, size_t end)
 	{
-		imageFlags |= CreateImageFlags::Picmip;
+		for (size_t i = begin; i < end; i++)
+		{
+			PendingTexture *pending = pendingTextures_[i].get();
+
+			if (pending->cacheFile)
+			{
+				pending->image = ReadCompressedImage(pending->cacheFile->getData(), pending->cacheFile->getLength(), &pending->format);
+			}
+
+			if (!pending->image.data)
+			{
+				pending->format = bgfx::TextureFormat::RGBA8;
+				pending->image = DecodeImage(pending->filename, pending->file->getData(), pending->file->getLength(), pending->imageFlags);
+			}
+
+			if (pending->compress && pending->image.data && pending->format == bgfx::TextureFormat::RGBA8)
+			{
+				Image compressed = CompressImage(pending->image, &pending->format);
+
+				if (compressed.data)
+				{
+					if (pending->image.release)
+						pending->image.release(pending->image.data, nullptr);
+
+					pending->image = compressed;
+					WriteCompressedImage(pending->image, pending->format, &pending->cacheData);
+				}
+				else
+				{
+					pending->format = bgfx::TextureFormat::RGBA8;
+				}
+			}
+
+			if (pending->image.data)
+			{
+				for (uint32_t j = 0; j < 2; j++)
+				{
+					bx::HashMurmur2A hash;
+					hash.begin(j);
+					hash.add(pending->image.data, (int)pending->image.dataSize);
+					pending->contentHash[j] = hash.end();
+				}
+			}
+		}
+	});
+
+	for (size_t i = 0; i < nPending; i++)
+	{
+		PendingTexture *pending = pendingTextures_[i].get();
+		pending->file.reset();
+		pending->cacheFile.reset();
+		pending->texture->reloading_ = false;
+
+		if (!pending->cacheData.empty())
+		{
+			interface::FS_WriteFile(pending->cacheFilename, pending->cacheData.data(), pending->cacheData.size());
+		}
+
+		if (!pending->image.data)
+		{
+			// Keep using the default texture, or whatever mips are already resident.
+			interface::Printf("Error loading image \"%s\"\n", pending->filename);
+			pending->texture->reloadable_ = false;
+			continue;
+		}
+
+		// Textures loading for the first time use the handle of any texture with identical contents. Reloads are never aliased.
+		Texture *texture = pending->texture;
+
+		if (texture->sharesHandle_ && !texture->evicted_ && !texture->aliasOf_)
+		{
+			ContentKey key;
+			memset(&key, 0, sizeof(key));
+			key.hash[0] = pending->contentHash[0];
+			key.hash[1] = pending->contentHash[1];
+			key.dataSize = pending->image.dataSize;
+			key.width = pending->image.width;
+			key.height = pending->image.height;
+			key.flags = texture->flags_;
+			key.format = pending->format;
+			auto it = contentTextures_.find(key);
+
+			if (it != contentTextures_.end())
+			{
+				texture->aliasOf_ = it->second;
+				texture->reloadable_ = false;
+				nDuplicateTextures_++;
+				duplicateMemorySize_ += pending->image.dataSize;
+
+				if (pending->image.release)
+					pending->image.release(pending->image.data, nullptr);
+
+				pending->image = Image();
+				continue;
+			}
+
+			contentTextures_[key] = texture;
+		}
+
+		const Image &image = pending->image;
+		pending->texture->reload(image, pending->format, std::min(pending->droppedMips, calculateMaxDroppedMips(image.width, image.height, image.nMips, pending->format)));
+		pending->image = Image();
+	}
+
+	pendingTextures_.erase(pendingTextures_.begin(), pendingTextures_.begin() + nPending);
+}
+
+void TextureCache::updateResidency()
+{
+	const uint32_t frameNo = frameNo_++;
+	const size_t maxReloads = (size_t)g_jobSystem->getNumThreads();
+	size_t nReloads = 0;
+	size_t memorySize = 0;
+
+	// Restore textures that were used this frame.
+	for (const std::unique_ptr<Texture> &texture : textures_)
+	{
+		if (nReloads < maxReloads && texture->reloadable_ && !texture->reloading_ && (texture->evicted_ || texture->droppedMips_ > 0) && texture->lastUsedFrame_ == frameNo)
+		{
+			if (queueReload(texture.get(), 0))
+				nReloads++;
+		}
+
+		memorySize += texture->memorySize_;
+	}
+
+	const size_t budget = (size_t)std::max(0, g_cvars.textureBudget.getInt()) * 1024 * 1024;
+
+	if (budget == 0 || memorySize <= budget)
+		return;
+
+	// Over budget. Drop the top mips of the least recently used textures, then evict them entirely.
+	std::vector<Texture *> candidates;
+
+	for (const std::unique_ptr<Texture> &texture : textures_)
+	{
+		if (texture->reloadable_ && !texture->reloading_ && !texture->evicted_ && frameNo - texture->lastUsedFrame_ >= minUnusedFrames_)
+			candidates.push_back(texture.get());
 	}
 
-	Image image = LoadImage(name, imageFlags);
+	std::sort(candidates.begin(), candidates.end(), [](const Texture *a, const Texture *b) { return a->lastUsedFrame_ < b->lastUsedFrame_; });
 
-	if (!image.data)
+	for (Texture *texture : candidates)
+	{
+		if (memorySize <= budget)
+			break;
+
+		const int maxDroppedMips = calculateMaxDroppedMips(texture->width_, texture->height_, texture->nMips_, texture->format_);
+
+		if (texture->droppedMips_ < maxDroppedMips)
+		{
+			if (nReloads >= maxReloads)
+				continue;
+
+			// Each mip dropped saves roughly 3/4 of the memory.
+			if (queueReload(texture, maxDroppedMips))
+			{
+				memorySize -= texture->memorySize_ - (texture->memorySize_ >> (2 * (maxDroppedMips - texture->droppedMips_)));
+				nReloads++;
+			}
+		}
+		else
+		{
+			memorySize -= texture->memorySize_;
+			evict(texture);
+		}
+	}
+}
+
+Texture *TextureCache::allocateTexture(const char *name)
+{
+	if (strlen(name) >= MAX_QPATH)
+	{
+		interface::Error("Texture name \"%s\" is too long", name);
+	}
+
+	// Pending textures will have their own handle once they're decoded.
+	size_t nResidentTextures = 0;
+
+	for (const std::unique_ptr<Texture> &texture : textures_)
+	{
+		if (!texture->sharesHandle_ || texture->reloading_)
+			nResidentTextures++;
+	}
+
+	if (nResidentTextures >= maxResidentTextures_ && !evictLeastRecentlyUsed())
+	{
+		interface::Error("Exceeded max textures");
+	}
+
+	textures_.push_back(std::make_unique<Texture>());
+	return textures_.back().get();
+}
+
+std::unique_ptr<TextureCache::PendingTexture> TextureCache::readPendingTexture(const char *name, int flags) const
+{
+	auto pending = std::make_unique<PendingTexture>();
+	pending->file = ReadImageFile(name, pending->filename, sizeof(pending->filename));
+
+	if (!pending->file)
 		return nullptr;
 
-	return create(name, image, flags, bgfx::TextureFormat::RGBA8);
+	pending->imageFlags = CalculateImageFlags(flags);
+
+	// UI images aren't mipmapped, and don't compress well.
+	if (compressionSupported_ && g_cvars.textureCompression.getBool() && (pending->imageFlags & CreateImageFlags::GenerateMipmaps))
+	{
+		// Compressed textures are keyed by the source image contents and anything else that changes the image data.
+		bx::HashMurmur2A hash;
+		hash.begin();
+		hash.add(pending->file->getData(), (int)pending->file->getLength());
+		hash.add(s_compressedTextureCacheVersion);
+		hash.add(pending->imageFlags);
+		hash.add((pending->imageFlags & CreateImageFlags::Picmip) ? g_cvars.picmip.getInt() : 0);
+		util::Sprintf(pending->cacheFilename, (int)sizeof(pending->cacheFilename), "cache/textures/%08x_%u.ktx", hash.end(), (uint32_t)pending->file->getLength());
+		pending->compress = true;
+		pending->cacheFile = std::make_unique<ReadOnlyFile>(pending->cacheFilename);
+
+		if (!pending->cacheFile->isValid())
+		{
+			pending->cacheFile.reset();
+		}
+	}
+
+	return pending;
+}
+
+bool TextureCache::queueReload(Texture *texture, int droppedMips)
+{
+	assert(texture->reloadable_);
+	std::unique_ptr<PendingTexture> pending = readPendingTexture(texture->name_, texture->flags_);
+
+	if (!pending)
+	{
+		texture->reloadable_ = false;
+		return false;
+	}
+
+	pending->texture = texture;
+	pending->droppedMips = droppedMips;
+	texture->reloading_ = true;
+	pendingTextures_.push_back(std::move(pending));
+	return true;
+}
+
+void TextureCache::evict(Texture *texture)
+{
+	assert(texture->reloadable_);
+
+	if (!texture->sharesHandle_)
+		bgfx::destroy(texture->handle_);
+
+	texture->handle_ = defaultTexture_->handle_;
+	texture->sharesHandle_ = true;
+	texture->evicted_ = true;
+	texture->droppedMips_ = 0;
+	texture->memorySize_ = 0;
+}
+
+bool TextureCache::evictLeastRecentlyUsed()
+{
+	Texture *leastRecentlyUsed = nullptr;
+
+	for (const std::unique_ptr<Texture> &texture : textures_)
+	{
+		if (!texture->reloadable_ || texture->reloading_ || texture->sharesHandle_ || texture->lastUsedFrame_ == frameNo_)
+			continue;
+
+		if (!leastRecentlyUsed || texture->lastUsedFrame_ < leastRecentlyUsed->lastUsedFrame_)
+			leastRecentlyUsed = texture.get();
+	}
+
+	if (!leastRecentlyUsed)
+		return false;
+
+	evict(leastRecentlyUsed);
+	return true;
+}
+
+int TextureCache::calculateMaxDroppedMips(int width, int height, int nMips, bgfx::TextureFormat::Enum format) const
+{
+	int droppedMips = 0;
+
+	while (droppedMips + 1 < nMips)
+	{
+		const int mipWidth = width >> (droppedMips + 1), mipHeight = height >> (droppedMips + 1);
+
+		if (std::max(mipWidth, mipHeight) < minDroppedMipSize_)
+			break;
+
+		// Block compressed textures need the top mip to be a multiple of the block size.
+		if (bimg::isCompressed(bimg::TextureFormat::Enum(format)) && ((mipWidth & 3) || (mipHeight & 3)))
+			break;
+
+		droppedMips++;
+	}
+
+	return droppedMips;
 }
 
 Texture *TextureCache::get(const char *name)
@@ -261,15 +645,32 @@ Texture *TextureCache::get(const char *name)
 void TextureCache::alias(Texture *from, Texture *to)
 {
 	assert(from);
+	assert(from != to);
+	from->aliasOf_ = to;
+}
 
-	if (!to)
-	{
-		aliases_.erase(from);
-	}
-	else
+void TextureCache::printStats() const
+{
+	size_t nResident = 0, nDroppedMips = 0, nEvicted = 0, memorySize = 0;
+
+	for (const std::unique_ptr<Texture> &texture : textures_)
 	{
-		aliases_.insert(std::make_pair(from, to));
+		if (!texture->sharesHandle_)
+			nResident++;
+
+		if (texture->droppedMips_ > 0)
+			nDroppedMips++;
+
+		if (texture->evicted_)
+			nEvicted++;
+
+		memorySize += texture->memorySize_;
 	}
+
+	interface::Printf("%u textures, %u resident, %u pending\n", (uint32_t)textures_.size(), (uint32_t)nResident, (uint32_t)pendingTextures_.size());
+	interface::Printf("%u with dropped mips, %u evicted\n", (uint32_t)nDroppedMips, (uint32_t)nEvicted);
+	interface::Printf("%0.2f MB texture memory\n", memorySize / (1024.0f * 1024.0f));
+	interface::Printf("%u duplicate textures, %0.2f MB saved\n", (uint32_t)nDuplicateTextures_, duplicateMemorySize_ / (1024.0f * 1024.0f));
 }
 
 void TextureCache::hashTexture(Texture *texture)
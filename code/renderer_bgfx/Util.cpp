@@ -21,16 +21,82 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "Precompiled.h"
 #pragma hdrstop
+#include "bx/uint32_t.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TOKENIZER_SSE2 1
+#include <emmintrin.h>
+#else
+#define TOKENIZER_SSE2 0
+#endif
 
 namespace renderer {
 namespace util {
 
-static	char	com_token[MAX_TOKEN_CHARS];
-static	char	com_parsename[MAX_TOKEN_CHARS];
-static	int		com_lines;
-static	int		com_tokenline;
+#if TOKENIZER_SSE2
+/// @brief Scans 16 bytes at a time for the first character matching a predicate.
+/// @remarks Loads are aligned, so they never cross into the next page even when reading past the string terminator. The predicates must match '\0'.
+template<typename VectorPredicate>
+static char *FindFirst(char *str, VectorPredicate predicate)
+{
+	const uintptr_t misalignment = uintptr_t(str) & 15;
+	const char *block = str - misalignment;
+	uint32_t mask = _mm_movemask_epi8(predicate(_mm_load_si128((const __m128i *)block))) & (0xFFFFu << misalignment);
 
-static char *SkipWhitespace(char *data, bool *hasNewLines)
+	while (!mask)
+	{
+		block += 16;
+		mask = _mm_movemask_epi8(predicate(_mm_load_si128((const __m128i *)block)));
+	}
+
+	return (char *)block + bx::uint32_cnttz(mask);
+}
+#endif
+
+/// @brief The first whitespace, control character or terminator.
+/// @remarks Signed, like the char comparisons in the scalar code: characters with the high bit set end a word.
+static char *FindWordEnd(char *str)
+{
+#if TOKENIZER_SSE2
+	const __m128i space = _mm_set1_epi8(' ' + 1);
+	return FindFirst(str, [space](__m128i v) { return _mm_cmplt_epi8(v, space); });
+#else
+	while (*str > ' ')
+		str++;
+
+	return str;
+#endif
+}
+
+/// @brief The first '\n' or terminator.
+static char *FindLineEnd(char *str)
+{
+#if TOKENIZER_SSE2
+	const __m128i newline = _mm_set1_epi8('\n'), zero = _mm_setzero_si128();
+	return FindFirst(str, [newline, zero](__m128i v) { return _mm_or_si128(_mm_cmpeq_epi8(v, newline), _mm_cmpeq_epi8(v, zero)); });
+#else
+	while (*str && *str != '\n')
+		str++;
+
+	return str;
+#endif
+}
+
+/// @brief The first c, '\n' or terminator.
+static char *FindCharOrLineEnd(char *str, char c)
+{
+#if TOKENIZER_SSE2
+	const __m128i search = _mm_set1_epi8(c), newline = _mm_set1_epi8('\n'), zero = _mm_setzero_si128();
+	return FindFirst(str, [search, newline, zero](__m128i v) { return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, search), _mm_cmpeq_epi8(v, newline)), _mm_cmpeq_epi8(v, zero)); });
+#else
+	while (*str && *str != c && *str != '\n')
+		str++;
+
+	return str;
+#endif
+}
+
+char *Tokenizer::skipWhitespace(char *data, bool *hasNewLines)
 {
 	int c;
 
@@ -39,7 +105,7 @@ static char *SkipWhitespace(char *data, bool *hasNewLines)
 			return NULL;
 		}
 		if (c == '\n') {
-			com_lines++;
+			lines_++;
 			*hasNewLines = true;
 		}
 		data++;
@@ -48,24 +114,24 @@ static char *SkipWhitespace(char *data, bool *hasNewLines)
 	return data;
 }
 
-void BeginParseSession(const char *name)
+void Tokenizer::beginParseSession(const char *name)
 {
-	com_lines = 1;
-	com_tokenline = 0;
-	Sprintf(com_parsename, sizeof(com_parsename), "%s", name);
+	lines_ = 1;
+	tokenLine_ = 0;
+	Sprintf(parseName_, sizeof(parseName_), "%s", name);
 }
 
-int GetCurrentParseLine()
+int Tokenizer::getCurrentParseLine() const
 {
-	if (com_tokenline)
+	if (tokenLine_)
 	{
-		return com_tokenline;
+		return tokenLine_;
 	}
 
-	return com_lines;
+	return lines_;
 }
 
-char *Parse(char **data_p, bool allowLineBreaks)
+char *Tokenizer::parse(char **data_p, bool allowLineBreaks)
 {
 	int c = 0, len;
 	bool hasNewLines = false;
@@ -73,29 +139,29 @@ char *Parse(char **data_p, bool allowLineBreaks)
 
 	data = *data_p;
 	len = 0;
-	com_token[0] = 0;
-	com_tokenline = 0;
+	token_[0] = 0;
+	tokenLine_ = 0;
 
 	// make sure incoming data is valid
 	if (!data)
 	{
 		*data_p = NULL;
-		return com_token;
+		return token_;
 	}
 
 	while (1)
 	{
 		// skip whitespace
-		data = SkipWhitespace(data, &hasNewLines);
+		data = skipWhitespace(data, &hasNewLines);
 		if (!data)
 		{
 			*data_p = NULL;
-			return com_token;
+			return token_;
 		}
 		if (hasNewLines && !allowLineBreaks)
 		{
 			*data_p = data;
-			return com_token;
+			return token_;
 		}
 
 		c = *data;
@@ -103,20 +169,23 @@ char *Parse(char **data_p, bool allowLineBreaks)
 		// skip double slash comments
 		if (c == '/' && data[1] == '/')
 		{
-			data += 2;
-			while (*data && *data != '\n') {
-				data++;
-			}
+			data = FindLineEnd(data + 2);
 		}
 		// skip /* */ comments
 		else if (c == '/' && data[1] == '*')
 		{
 			data += 2;
-			while (*data && (*data != '*' || data[1] != '/'))
+
+			for (;;)
 			{
+				data = FindCharOrLineEnd(data, '*');
+
+				if (!*data || (data[0] == '*' && data[1] == '/'))
+					break;
+
 				if (*data == '\n')
 				{
-					com_lines++;
+					lines_++;
 				}
 				data++;
 			}
@@ -132,7 +201,7 @@ char *Parse(char **data_p, bool allowLineBreaks)
 	}
 
 	// token starts on this line
-	com_tokenline = com_lines;
+	tokenLine_ = lines_;
 
 	// handle quoted strings
 	if (c == '\"')
@@ -140,47 +209,44 @@ char *Parse(char **data_p, bool allowLineBreaks)
 		data++;
 		while (1)
 		{
-			c = *data++;
+			char *end = FindCharOrLineEnd(data, '\"');
+			const int n = std::min(int(end - data), MAX_TOKEN_CHARS - 1 - len);
+			memcpy(&token_[len], data, n);
+			len += n;
+			data = end;
+			c = *data;
 			if (c == '\"' || !c)
 			{
-				com_token[len] = 0;
-				*data_p = (char *)data;
-				return com_token;
-			}
-			if (c == '\n')
-			{
-				com_lines++;
+				// don't step past the terminator of an unterminated string
+				token_[len] = 0;
+				*data_p = c ? data + 1 : data;
+				return token_;
 			}
+			// newline, part of the token
+			data++;
+			lines_++;
 			if (len < MAX_TOKEN_CHARS - 1)
 			{
-				com_token[len] = c;
+				token_[len] = c;
 				len++;
 			}
 		}
 	}
 
 	// parse a regular word
-	do
-	{
-		if (len < MAX_TOKEN_CHARS - 1)
-		{
-			com_token[len] = c;
-			len++;
-		}
-		data++;
-		c = *data;
-	} while (c>32);
+	char *end = FindWordEnd(data + 1);
+	len = std::min(int(end - data), MAX_TOKEN_CHARS - 1);
+	memcpy(token_, data, len);
+	token_[len] = 0;
 
-	com_token[len] = 0;
-
-	*data_p = (char *)data;
-	return com_token;
+	*data_p = end;
+	return token_;
 }
 
-bool SkipBracedSection(char **program, int depth)
+bool Tokenizer::skipBracedSection(char **program, int depth)
 {
 	do {
-		char *token = Parse(program, true);
+		char *token = parse(program, true);
 		if (token[1] == 0) {
 			if (token[0] == '{') {
 				depth++;
@@ -194,26 +260,50 @@ bool SkipBracedSection(char **program, int depth)
 	return (depth == 0);
 }
 
-void SkipRestOfLine(char **data)
+void Tokenizer::skipRestOfLine(char **data)
 {
-	char	*p;
-	int		c;
-
-	p = *data;
+	char *p = *data;
 
 	if (!*p)
 		return;
 
-	while ((c = *p++) != 0) {
-		if (c == '\n') {
-			com_lines++;
-			break;
-		}
+	p = FindLineEnd(p);
+
+	if (*p == '\n') {
+		lines_++;
+		p++;
 	}
 
 	*data = p;
 }
 
+static thread_local Tokenizer s_tokenizer;
+
+void BeginParseSession(const char *name)
+{
+	s_tokenizer.beginParseSession(name);
+}
+
+int GetCurrentParseLine()
+{
+	return s_tokenizer.getCurrentParseLine();
+}
+
+char *Parse(char **data_p, bool allowLineBreaks)
+{
+	return s_tokenizer.parse(data_p, allowLineBreaks);
+}
+
+bool SkipBracedSection(char **program, int depth)
+{
+	return s_tokenizer.skipBracedSection(program, depth);
+}
+
+void SkipRestOfLine(char **data)
+{
+	s_tokenizer.skipRestOfLine(data);
+}
+
 int Compress(char *data_p)
 {
 	char *in, *out;
@@ -319,7 +409,7 @@ std::array<Vertex *, 4> ExtractQuadCorners(Vertex *vertices, const uint16_t *ind
 	return corners;
 }
 
-bool IsGeometryOffscreen(const mat4 &mvp, const uint16_t *indices, size_t nIndices, const Vertex *vertices)
+bool IsGeometryOffscreen(const mat4 &mvp, const uint32_t *indices, size_t nIndices, const Vertex *vertices)
 {
 	uint32_t pointAnd = (uint32_t)~0;
 
@@ -346,7 +436,30 @@ bool IsGeometryOffscreen(const mat4 &mvp, const uint16_t *indices, size_t nIndic
 	return pointAnd != 0;
 }
 
-bool IsGeometryBackfacing(vec3 cameraPosition, const uint16_t *indices, size_t nIndices, const Vertex *vertices, float *shortestVertexDistanceSquared)
+bool CalculateGeometryScreenBounds(const mat4 &mvp, const uint32_t *indices, size_t nIndices, const Vertex *vertices, vec2 *mins, vec2 *maxs)
+{
+	assert(mins);
+	assert(maxs);
+
+	for (size_t i = 0; i < nIndices; i++)
+	{
+		const vec4 clip = mvp.transform(vec4(vertices[indices[i]].pos, 1));
+
+		// Behind the camera, the projected position can't be used.
+		if (clip.w <= 0.001f)
+			return false;
+
+		const vec2 ndc(clip.x / clip.w, clip.y / clip.w);
+		mins->x = std::min(mins->x, ndc.x);
+		mins->y = std::min(mins->y, ndc.y);
+		maxs->x = std::max(maxs->x, ndc.x);
+		maxs->y = std::max(maxs->y, ndc.y);
+	}
+
+	return true;
+}
+
+bool IsGeometryBackfacing(vec3 cameraPosition, const uint32_t *indices, size_t nIndices, const Vertex *vertices, float *shortestVertexDistanceSquared)
 {
 	size_t nTriangles = nIndices / 3;
 
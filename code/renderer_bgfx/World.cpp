@@ -39,26 +39,35 @@ static vec2 AtlasTexCoord(vec2 uv, int index, vec2i lightmapAtlasSize)
 	return result;
 }
 
-static bool SurfaceCompare(const Surface *s1, const Surface *s2)
+static bool SurfaceCompare(uint32_t surfaceIndex1, uint32_t surfaceIndex2)
 {
+	const Surface *s1 = &s_world->surfaces[surfaceIndex1];
+	const Surface *s2 = &s_world->surfaces[surfaceIndex2];
+
 	if (s1->material->index < s2->material->index)
-	{
 		return true;
-	}
-	else if (s1->material->index == s2->material->index)
-	{
-		if (s1->fogIndex < s2->fogIndex)
-		{
-			return true;
-		}
-		else if (s1->fogIndex == s2->fogIndex)
-		{
-			if (s1->bufferIndex < s2->bufferIndex)
-				return true;
-		}
-	}
 
-	return false;
+	return s1->material->index == s2->material->index && s1->fogIndex < s2->fogIndex;
+}
+
+/// @brief Copy index data for a world index buffer, narrowing to 16-bit if 32-bit indices aren't required.
+static const bgfx::Memory *CopyIndices(const std::vector<uint32_t> &indices)
+{
+	if (s_world->use32BitIndices)
+		return bgfx::copy(indices.data(), uint32_t(indices.size() * sizeof(uint32_t)));
+
+	const bgfx::Memory *mem = bgfx::alloc(uint32_t(indices.size() * sizeof(uint16_t)));
+	auto dest = (uint16_t *)mem->data;
+
+	for (size_t i = 0; i < indices.size(); i++)
+		dest[i] = (uint16_t)indices[i];
+
+	return mem;
+}
+
+static uint16_t GetIndexBufferFlags()
+{
+	return s_world->use32BitIndices ? BGFX_BUFFER_INDEX32 : BGFX_BUFFER_NONE;
 }
 
 static bool IgnoreSurface(const Surface &surface)
@@ -112,6 +121,11 @@ public:
 		return surface.material;
 	}
 
+	int findFogIndex(const renderer::Entity &entity) const override
+	{
+		return -1; // Surfaces have their own fog index.
+	}
+
 	bool isCulled(renderer::Entity *entity, const Frustum &cameraFrustum) const override
 	{
 		return cameraFrustum.clipBounds(getBounds(), mat4::transform(entity->rotation, entity->position)) == Frustum::ClipResult::Outside;
@@ -127,90 +141,91 @@ public:
 		assert(drawCallList);
 		assert(entity);
 		const mat4 modelMatrix = mat4::transform(entity->rotation, entity->position);
+		const Bounds bounds = modelMatrix.transform(getBounds());
 
 		for (const BatchedSurface &surface : batchedSurfaces_)
 		{
 			DrawCall dc;
+			dc.bounds = bounds;
+			dc.hasBounds = true;
 			dc.entity = entity;
 			dc.flags = 0;
 			dc.fogIndex = surface.fogIndex;
 			dc.material = surface.material;
 			dc.modelMatrix = modelMatrix;
 			dc.vb.type = DrawCall::BufferType::Static;
-			dc.vb.staticHandle = s_world->vertexBuffers[surface.bufferIndex].handle;
-			dc.vb.nVertices = (uint32_t)s_world->vertices[surface.bufferIndex].size();
+			dc.vb.staticHandle = s_world->vertexBuffer.handle;
+			dc.vb.nVertices = (uint32_t)s_world->vertices.size();
 			dc.ib.type = DrawCall::BufferType::Static;
-			dc.ib.staticHandle = indexBuffers_[surface.bufferIndex].handle;
+			dc.ib.staticHandle = indexBuffer_.handle;
 			dc.ib.firstIndex = surface.firstIndex;
 			dc.ib.nIndices = surface.nIndices;
 			drawCallList->push_back(dc);
 		}
 	}
 
-	void buildGeometry()
+	/// @brief Sort and batch surfaces. Only reads world data, so models can be batched in parallel.
+	void batchSurfaces()
 	{
 		const ModelDef &def = s_world->modelDefs[index_];
 
 		// Grab surfaces we aren't ignoring and sort them.
-		std::vector<const Surface *> surfaces;
+		std::vector<uint32_t> surfaces;
 
 		for (size_t i = 0; i < def.nSurfaces; i++)
 		{
-			const Surface &surface = s_world->surfaces[def.firstSurface + i];
+			const uint32_t surfaceIndex = uint32_t(def.firstSurface + i);
 
-			if (!IgnoreSurface(surface))
-				surfaces.push_back(&surface);
+			if (!IgnoreSurface(s_world->surfaces[surfaceIndex]))
+				surfaces.push_back(surfaceIndex);
 		}
 
 		std::sort(surfaces.begin(), surfaces.end(), SurfaceCompare);
 
 		// Batch surfaces.
+		std::vector<uint32_t> &indices = batchedIndices_;
+		indices.clear();
 		size_t firstSurface = 0;
 
 		for (size_t i = 0; i < surfaces.size(); i++)
 		{
-			const Surface *surface = surfaces[i];
+			const Surface *surface = &s_world->surfaces[surfaces[i]];
 			const bool isLast = i == surfaces.size() - 1;
-			const Surface *nextSurface = isLast ? nullptr : surfaces[i + 1];
+			const Surface *nextSurface = isLast ? nullptr : &s_world->surfaces[surfaces[i + 1]];
 
 			// Create new batch on certain surface state changes.
-			if (!nextSurface || nextSurface->material != surface->material || nextSurface->fogIndex != surface->fogIndex || nextSurface->bufferIndex != surface->bufferIndex)
+			if (!nextSurface || nextSurface->material != surface->material || nextSurface->fogIndex != surface->fogIndex)
 			{
 				BatchedSurface bs;
 				bs.fogIndex = surface->fogIndex;
 				bs.material = surface->material;
 
 				// Grab the indices for all surfaces in this batch.
-				bs.bufferIndex = surface->bufferIndex;
-				std::vector<uint16_t> &indices = indices_[bs.bufferIndex];
 				bs.firstIndex = (uint32_t)indices.size();
 				bs.nIndices = 0;
 
 				for (size_t j = firstSurface; j <= i; j++)
 				{
-					const Surface *s = surfaces[j];
-					const size_t copyIndex = indices.size();
-					indices.resize(indices.size() + s->indices.size());
-					memcpy(&indices[copyIndex], &s->indices[0], s->indices.size() * sizeof(uint16_t));
-					bs.nIndices += (uint32_t)s->indices.size();
+					const SurfaceGeometry &g = s_world->surfaceGeometry[surfaces[j]];
+					indices.insert(indices.end(), &s_world->surfaceIndices[g.firstIndex], &s_world->surfaceIndices[g.firstIndex] + g.nIndices);
+					bs.nIndices += g.nIndices;
 				}
 
 				batchedSurfaces_.push_back(bs);
 				firstSurface = i + 1;
 			}
 		}
+	}
 
-		// Create static index buffers.
-		for (size_t i = 0; i < s_world->currentGeometryBuffer + 1; i++)
+	/// @brief Create the static index buffer from the batched indices. Must be called on the main thread.
+	void createBuffers()
+	{
+		if (!batchedIndices_.empty())
 		{
-			IndexBuffer &ib = indexBuffers_[i];
-			std::vector<uint16_t> &indices = indices_[i];
-
-			if (indices.empty())
-				continue;
-
-			ib.handle = bgfx::createIndexBuffer(bgfx::makeRef(indices.data(), uint32_t(indices.size() * sizeof(uint16_t))));
+			indexBuffer_.handle = bgfx::createIndexBuffer(CopyIndices(batchedIndices_), GetIndexBufferFlags());
 		}
+
+		std::vector<uint32_t>().swap(batchedIndices_);
 	}
 
 private:
@@ -218,30 +233,35 @@ private:
 	{
 		Material *material;
 		int fogIndex;
-		size_t bufferIndex;
 		uint32_t firstIndex;
 		uint32_t nIndices;
 	};
 
 	int index_;
 	std::vector<BatchedSurface> batchedSurfaces_;
-	std::vector<uint16_t> indices_[s_maxWorldGeometryBuffers];
-	IndexBuffer indexBuffers_[s_maxWorldGeometryBuffers];
+	std::vector<uint32_t> batchedIndices_; ///< Only used between batchSurfaces and createBuffers.
+	IndexBuffer indexBuffer_;
 };
 
-static Material *FindMaterial(int materialIndex, int lightmapIndex)
+/// @brief Lightmaps are packed into atlases, and materials reference the atlas.
+static int MaterialLightmapIndex(int lightmapIndex)
 {
-	if (materialIndex < 0 || materialIndex >= (int)s_world->materials.size())
+	if (lightmapIndex > 0)
 	{
-		interface::Error("%s: bad material index %i", s_world->name, materialIndex);
+		lightmapIndex /= s_world->nLightmapsPerAtlas;
 	}
 
-	if (lightmapIndex > 0)
+	return lightmapIndex;
+}
+
+static Material *FindMaterial(int materialIndex, int lightmapIndex)
+{
+	if (materialIndex < 0 || materialIndex >= (int)s_world->materials.size())
 	{
-		lightmapIndex /= s_world->nLightmapsPerAtlas;
+		interface::Error("%s: bad material index %i", s_world->name, materialIndex);
 	}
 
-	Material *material = g_materialCache->findMaterial(s_world->materials[materialIndex].name, lightmapIndex, true);
+	Material *material = g_materialCache->findMaterial(s_world->materials[materialIndex].name, MaterialLightmapIndex(lightmapIndex), true);
 
 	// If the material had errors, just use default material.
 	if (!material)
@@ -250,20 +270,11 @@ static Material *FindMaterial(int materialIndex, int lightmapIndex)
 	return material;
 }
 
-static void SetSurfaceGeometry(Surface *surface, const Vertex *vertices, int nVertices, const uint16_t *indices, size_t nIndices, int lightmapIndex)
+static void SetSurfaceGeometry(size_t surfaceIndex, const Vertex *vertices, int nVertices, const uint16_t *indices, size_t nIndices, int lightmapIndex)
 {
-	std::vector<Vertex> *bufferVertices = &s_world->vertices[s_world->currentGeometryBuffer];
-
-	// Increment the current vertex buffer if the vertices won't fit.
-	if (bufferVertices->size() + nVertices >= UINT16_MAX)
-	{
-		if (++s_world->currentGeometryBuffer == s_maxWorldGeometryBuffers)
-			interface::Error("Not enough world vertex buffers");
+	std::vector<Vertex> *bufferVertices = &s_world->vertices;
 
-		bufferVertices = &s_world->vertices[s_world->currentGeometryBuffer];
-	}
-
-	// Append the vertices into the current vertex buffer.
+	// Append the vertices into the vertex buffer.
 	auto startVertex = (const uint32_t)bufferVertices->size();
 	bufferVertices->resize(bufferVertices->size() + nVertices);
 	memcpy(&(*bufferVertices)[startVertex], vertices, nVertices * sizeof(Vertex));
@@ -280,28 +291,100 @@ static void SetSurfaceGeometry(Surface *surface, const Vertex *vertices, int nVe
 		}
 	}
 
-	// The surface needs to know which vertex buffer to use.
-	surface->bufferIndex = s_world->currentGeometryBuffer;
-
 	// CPU deforms need to know which vertices to use.
-	surface->firstVertex = startVertex;
-	surface->nVertices = (uint32_t)nVertices;
+	SurfaceGeometry &geometry = s_world->surfaceGeometry[surfaceIndex];
+	geometry.firstVertex = startVertex;
+	geometry.nVertices = (uint32_t)nVertices;
 
-	// Copy indices into the surface. Relative indices are made absolute.
-	surface->indices.resize(nIndices);
+	// Copy indices into the shared index pool. Relative indices are made absolute.
+	geometry.firstIndex = (uint32_t)s_world->surfaceIndices.size();
+	geometry.nIndices = (uint32_t)nIndices;
+	s_world->surfaceIndices.resize(s_world->surfaceIndices.size() + nIndices);
 
 	for (size_t i = 0; i < nIndices; i++)
 	{
-		surface->indices[i] = indices[i] + startVertex;
+		s_world->surfaceIndices[geometry.firstIndex + i] = indices[i] + startVertex;
 	}
 }
 
+/// @brief The maximum lod error for each patch LOD level. Rows and columns with a higher error are skipped.
+/// @remarks Lod errors are the inverse of the distance from the true curve, so lower levels skip rows and columns that are closer to the curve.
+static const float s_patchLodMaxErrors[s_nPatchLods] = { FLT_MAX, 1.0f, 0.25f, 0.0625f };
+
+/// @brief Append index data for each reduced patch LOD level. Must be called after SetSurfaceGeometry.
+static void SetPatchLodGeometry(size_t surfaceIndex, const Patch &patch)
+{
+	SurfaceGeometry &geometry = s_world->surfaceGeometry[surfaceIndex];
+	std::vector<uint16_t> indexes(patch.numIndexes);
+	SurfaceGeometry::Lod previousLod;
+	previousLod.firstIndex = geometry.firstIndex;
+	previousLod.nIndices = geometry.nIndices;
+
+	for (size_t i = 1; i < s_nPatchLods; i++)
+	{
+		SurfaceGeometry::Lod &lod = geometry.lods[i - 1];
+		const int nIndexes = Patch_MakeLodIndexes(&patch, s_patchLodMaxErrors[i], indexes.data());
+
+		// Levels are subsets of each other, so the same number of indices means the same rows and columns.
+		if ((uint32_t)nIndexes == previousLod.nIndices)
+		{
+			lod = previousLod;
+			continue;
+		}
+
+		lod.firstIndex = (uint32_t)s_world->surfaceIndices.size();
+		lod.nIndices = (uint32_t)nIndexes;
+
+		for (int j = 0; j < nIndexes; j++)
+		{
+			s_world->surfaceIndices.push_back(indexes[j] + geometry.firstVertex);
+		}
+
+		previousLod = lod;
+	}
+}
+
+/// @brief Choose the coarsest patch LOD level that still has every row and column needed at this distance.
+/// @remarks All patches in a lod group share a lod origin and radius, so they always choose the same level.
+static uint8_t CalculatePatchLod(const Patch &patch, vec3 cameraPosition, float curveError)
+{
+	if (curveError <= 0)
+		return 0;
+
+	const float d = std::max(1.0f, vec3::distance(cameraPosition, patch.lodOrigin) - patch.lodRadius);
+	const float lodError = curveError / d;
+	uint8_t lod = 0;
+
+	while (size_t(lod) + 1 < s_nPatchLods && s_patchLodMaxErrors[lod + 1] >= lodError)
+	{
+		lod++;
+	}
+
+	return lod;
+}
+
+/// @brief Get the index range for a surface at its current LOD level.
+/// @param patchLods Indexed by surface index. nullptr means full detail. Only patch surfaces have levels other than 0.
+static SurfaceGeometry::Lod GetSurfaceIndexRange(uint32_t surfaceIndex, const uint8_t *patchLods)
+{
+	const SurfaceGeometry &g = s_world->surfaceGeometry[surfaceIndex];
+	const uint8_t lod = patchLods ? patchLods[surfaceIndex] : 0;
+
+	if (lod > 0)
+		return g.lods[lod - 1];
+
+	SurfaceGeometry::Lod range;
+	range.firstIndex = g.firstIndex;
+	range.nIndices = g.nIndices;
+	return range;
+}
+
 static void ReleaseLightmapAtlasImage(void *data, void *userData)
 {
 	free(data);
 }
 
-static void CreateBatchedSurfaces(const std::vector<Surface *> &surfaces, std::vector<BatchedSurface> *batchedSurfaces, std::vector<uint16_t> *batchedIndices, std::vector<Vertex> *cpuDeformVertices, std::vector<uint16_t> *cpuDeformIndices)
+static void CreateBatchedSurfaces(const std::vector<uint32_t> &surfaces, std::vector<BatchedSurface> *batchedSurfaces, std::vector<uint32_t> *batchedIndices, std::vector<Vertex> *cpuDeformVertices, std::vector<uint16_t> *cpuDeformIndices, const uint8_t *patchLods = nullptr)
 {
 	assert(batchedSurfaces);
 	assert(batchedIndices);
@@ -309,10 +392,7 @@ static void CreateBatchedSurfaces(const std::vector<Surface *> &surfaces, std::v
 	assert(cpuDeformIndices);
 
 	// Clear indices.
-	for (size_t i = 0; i < s_world->currentGeometryBuffer + 1; i++)
-	{
-		batchedIndices[i].clear();
-	}
+	batchedIndices->clear();
 
 	// Clear CPU deform geometry.
 	cpuDeformIndices->clear();
@@ -324,12 +404,12 @@ static void CreateBatchedSurfaces(const std::vector<Surface *> &surfaces, std::v
 
 	for (size_t i = 0; i < surfaces.size(); i++)
 	{
-		Surface *surface = surfaces[i];
+		const Surface *surface = &s_world->surfaces[surfaces[i]];
 		const bool isLast = i == surfaces.size() - 1;
-		Surface *nextSurface = isLast ? nullptr : surfaces[i + 1];
+		const Surface *nextSurface = isLast ? nullptr : &s_world->surfaces[surfaces[i + 1]];
 
 		// Create new batch on certain surface state changes.
-		if (!nextSurface || nextSurface->material != surface->material || nextSurface->fogIndex != surface->fogIndex || nextSurface->bufferIndex != surface->bufferIndex)
+		if (!nextSurface || nextSurface->material != surface->material || nextSurface->fogIndex != surface->fogIndex)
 		{
 			if (IgnoreSurface(*surface))
 			{
@@ -349,7 +429,7 @@ static void CreateBatchedSurfaces(const std::vector<Surface *> &surfaces, std::v
 
 			for (size_t j = firstSurface; j <= i; j++)
 			{
-				bs.bounds.addPoints(surfaces[j]->cullinfo.bounds);
+				bs.bounds.addPoints(s_world->surfaceCullData[surfaces[j]].cullinfo.bounds);
 			}
 
 			if (bs.material->hasAutoSpriteDeform())
@@ -363,43 +443,42 @@ static void CreateBatchedSurfaces(const std::vector<Surface *> &surfaces, std::v
 
 				for (size_t j = firstSurface; j <= i; j++)
 				{
-					Surface *s = surfaces[j];
+					const SurfaceGeometry &g = s_world->surfaceGeometry[surfaces[j]];
+					const SurfaceGeometry::Lod range = GetSurfaceIndexRange(surfaces[j], patchLods);
+					const uint32_t *surfaceIndices = &s_world->surfaceIndices[range.firstIndex];
 
 					// Make room in destination.
 					const size_t firstDestIndex = cpuDeformIndices->size();
-					cpuDeformIndices->resize(cpuDeformIndices->size() + s->indices.size());
+					cpuDeformIndices->resize(cpuDeformIndices->size() + range.nIndices);
 					const size_t firstDestVertex = cpuDeformVertices->size();
-					cpuDeformVertices->resize(cpuDeformVertices->size() + s->nVertices);
+					cpuDeformVertices->resize(cpuDeformVertices->size() + g.nVertices);
 
 					// Append geometry.
-					memcpy(&(*cpuDeformVertices)[firstDestVertex], &s_world->vertices[surface->bufferIndex][s->firstVertex], sizeof(Vertex) * s->nVertices);
+					memcpy(&(*cpuDeformVertices)[firstDestVertex], &s_world->vertices[g.firstVertex], sizeof(Vertex) * g.nVertices);
 
-					for (size_t k = 0; k < s->indices.size(); k++)
+					for (size_t k = 0; k < range.nIndices; k++)
 					{
 						// Make indices relative.
-						(*cpuDeformIndices)[firstDestIndex + k] = uint16_t(s->indices[k] - s->firstVertex + bs.nVertices);
+						(*cpuDeformIndices)[firstDestIndex + k] = uint16_t(surfaceIndices[k] - g.firstVertex + bs.nVertices);
 					}
 
-					bs.nVertices += s->nVertices;
-					bs.nIndices += (uint32_t)s->indices.size();
+					bs.nVertices += g.nVertices;
+					bs.nIndices += range.nIndices;
 				}
 			}
 			else
 			{
 				// Grab the indices for all surfaces in this batch.
 				// They will be used directly by a dynamic index buffer.
-				bs.bufferIndex = surface->bufferIndex;
-				std::vector<uint16_t> &indices = batchedIndices[bs.bufferIndex];
+				std::vector<uint32_t> &indices = *batchedIndices;
 				bs.firstIndex = (uint32_t)indices.size();
 				bs.nIndices = 0;
 
 				for (size_t j = firstSurface; j <= i; j++)
 				{
-					Surface *s = surfaces[j];
-					const size_t copyIndex = indices.size();
-					indices.resize(indices.size() + s->indices.size());
-					memcpy(&indices[copyIndex], &s->indices[0], s->indices.size() * sizeof(uint16_t));
-					bs.nIndices += (uint32_t)s->indices.size();
+					const SurfaceGeometry::Lod range = GetSurfaceIndexRange(surfaces[j], patchLods);
+					indices.insert(indices.end(), &s_world->surfaceIndices[range.firstIndex], &s_world->surfaceIndices[range.firstIndex] + range.nIndices);
+					bs.nIndices += range.nIndices;
 				}
 			}
 
@@ -409,8 +488,10 @@ static void CreateBatchedSurfaces(const std::vector<Surface *> &surfaces, std::v
 	}
 }
 
-static void CreateOrAppendSkySurface(std::vector<SkySurface> &skySurfaces, const Surface &surface)
+static void CreateOrAppendSkySurface(std::vector<SkySurface> &skySurfaces, uint32_t surfaceIndex)
 {
+	const Surface &surface = s_world->surfaces[surfaceIndex];
+	const SurfaceGeometry &geometry = s_world->surfaceGeometry[surfaceIndex];
 	SkySurface *skySurface = nullptr;
 
 	for (SkySurface &ss : skySurfaces)
@@ -430,14 +511,107 @@ static void CreateOrAppendSkySurface(std::vector<SkySurface> &skySurfaces, const
 	}
 
 	const size_t startVertex = skySurface->vertices.size();
-	skySurface->vertices.resize(skySurface->vertices.size() + surface.indices.size());
+	skySurface->vertices.resize(skySurface->vertices.size() + geometry.nIndices);
 
-	for (size_t l = 0; l < surface.indices.size(); l++)
+	for (size_t l = 0; l < geometry.nIndices; l++)
 	{
-		skySurface->vertices[startVertex + l] = s_world->vertices[surface.bufferIndex][surface.indices[l]];
+		skySurface->vertices[startVertex + l] = s_world->vertices[s_world->surfaceIndices[geometry.firstIndex + l]];
 	}
 }
 
+static vec3 DecodeLightGridDirection(const uint8_t *data)
+{
+	int lat = data[7];
+	int lng = data[6];
+	lat *= (g_funcTableSize / 256);
+	lng *= (g_funcTableSize / 256);
+
+	// decode X as cos(lat) * sin(long)
+	// decode Y as sin(lat) * sin(long)
+	// decode Z as cos(long)
+	vec3 normal;
+	normal[0] = g_sinTable[(lat + (g_funcTableSize / 4)) & g_funcTableMask] * g_sinTable[lng];
+	normal[1] = g_sinTable[lat] * g_sinTable[lng];
+	normal[2] = g_sinTable[(lng + (g_funcTableSize / 4)) & g_funcTableMask];
+	return normal;
+}
+
+/// @brief Decode the packed light grid bytes to floats so SampleLightGrid doesn't have to.
+static void DecodeLightGrid()
+{
+	const size_t nGridPoints = s_world->lightGridData.size() / 8;
+	s_world->lightGridAmbient.resize(nGridPoints);
+	s_world->lightGridDirected.resize(nGridPoints);
+	s_world->lightGridDirection.resize(nGridPoints);
+
+	g_jobSystem->parallelFor(nGridPoints, 4096, [](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const uint8_t *data = &s_world->lightGridData[i * 8];
+
+			// Ignore samples in walls.
+			if (!(data[0] + data[1] + data[2] + data[3] + data[4] + data[5]))
+			{
+				s_world->lightGridAmbient[i] = vec4::empty;
+				s_world->lightGridDirected[i] = vec4::empty;
+				s_world->lightGridDirection[i] = vec4::empty;
+				continue;
+			}
+
+			s_world->lightGridAmbient[i] = vec4(data[0], data[1], data[2], 1);
+			s_world->lightGridDirected[i] = vec4(data[3], data[4], data[5], 0);
+			s_world->lightGridDirection[i] = vec4(DecodeLightGridDirection(data), 0);
+		}
+	});
+}
+
+/// @brief Upload the light grid as volume textures so entity lighting can be sampled per pixel.
+/// @remarks Values are premultiplied by alpha, which is 0 for samples in walls. Dividing the filtered value by alpha ignores those samples, same as SampleLightGrid.
+static void CreateLightGridTextures()
+{
+	const vec3i &bounds = s_world->lightGridBounds;
+	const size_t nGridPoints = size_t(bounds.x * bounds.y * bounds.z);
+	const bgfx::Memory *ambientMem = bgfx::alloc(uint32_t(nGridPoints * 4));
+	const bgfx::Memory *directedMem = bgfx::alloc(uint32_t(nGridPoints * 4));
+	const bgfx::Memory *directionMem = bgfx::alloc(uint32_t(nGridPoints * 4));
+
+	g_jobSystem->parallelFor(nGridPoints, 4096, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const uint8_t *data = &s_world->lightGridData[i * 8];
+			uint8_t *ambient = &ambientMem->data[i * 4];
+			uint8_t *directed = &directedMem->data[i * 4];
+			uint8_t *direction = &directionMem->data[i * 4];
+
+			if (!(data[0] + data[1] + data[2] + data[3] + data[4] + data[5]))
+			{
+				memset(ambient, 0, 4);
+				memset(directed, 0, 4);
+				memset(direction, 0, 4);
+				continue;
+			}
+
+			const vec3 normal = DecodeLightGridDirection(data);
+
+			for (size_t j = 0; j < 3; j++)
+			{
+				ambient[j] = data[j];
+				directed[j] = data[3 + j];
+				direction[j] = uint8_t(math::Clamped(normal[j] * 127.5f + 127.5f, 0.0f, 255.0f));
+			}
+
+			ambient[3] = directed[3] = direction[3] = 255;
+		}
+	});
+
+	const uint32_t flags = BGFX_TEXTURE_U_CLAMP | BGFX_TEXTURE_V_CLAMP | BGFX_TEXTURE_W_CLAMP;
+	s_world->lightGridAmbientTexture = g_textureCache->create("*lightgrid_ambient", bgfx::createTexture3D(bounds.x, bounds.y, bounds.z, false, bgfx::TextureFormat::RGBA8, flags, ambientMem));
+	s_world->lightGridDirectedTexture = g_textureCache->create("*lightgrid_directed", bgfx::createTexture3D(bounds.x, bounds.y, bounds.z, false, bgfx::TextureFormat::RGBA8, flags, directedMem));
+	s_world->lightGridDirectionTexture = g_textureCache->create("*lightgrid_direction", bgfx::createTexture3D(bounds.x, bounds.y, bounds.z, false, bgfx::TextureFormat::RGBA8, flags, directionMem));
+}
+
 void Load(const char *name)
 {
 	s_world = std::make_unique<World>();
@@ -466,6 +640,15 @@ void Load(const char *name)
 		return;
 	}
 
+	// Hash the BSP before anything is modified in place.
+	const bool useCache = g_cvars.worldCache.getBool();
+	CacheKey cacheKey;
+
+	if (useCache)
+	{
+		cacheKey = CalculateCacheKey(fileData, file.getLength());
+	}
+
 	// Swap all the lumps and validate sizes.
 	const int lumpSizes[] =
 	{
@@ -498,6 +681,11 @@ void Load(const char *name)
 		interface::Error("%s: lump %d has bad size", s_world->name, (int)i);
 	}
 
+	// If this BSP has been loaded before, read the processed vertices, surfaces, patches, light grid and lightmaps from the cache instead of deriving them again.
+	const size_t nSurfaces = header->lumps[LUMP_SURFACES].filelen / sizeof(dsurface_t);
+	std::vector<uint8_t> lightmapAtlasData;
+	const bool cacheHit = useCache && ReadCache(cacheKey, nSurfaces, &lightmapAtlasData);
+
 	// Entities
 	lump_t &lump = header->lumps[LUMP_ENTITIES];
 
@@ -510,10 +698,11 @@ void Load(const char *name)
 	char *p = s_world->entityString.data();
 	bool parsingEntity = false;
 	Entity entity;
+	util::Tokenizer tokenizer;
 
 	for (;;)
 	{
-		char *token = util::Parse(&p);
+		char *token = tokenizer.parse(&p);
 
 		if (!token[0])
 			break; // End of entity string.
@@ -563,7 +752,7 @@ void Load(const char *name)
 
 			EntityKVP &kvp = entity.kvps[entity.nKvps];
 			util::Strncpyz(kvp.key, token, sizeof(kvp.key));
-			token = util::Parse(&p);
+			token = tokenizer.parse(&p);
 
 			if (!token[0])
 			{
@@ -671,72 +860,74 @@ void Load(const char *name)
 		if (nLightmaps)
 		{
 			// Figure out how atlas dimensions by packing lightmaps into cells.
-			const int maxCells = 4; // 4x128 = 512
-
-			if (nLightmaps <= maxCells)
-			{
-				// Simple case.
-				s_world->lightmapAtlasSize.x = (int)nLightmaps;
-				s_world->lightmapAtlasSize.y = 1;
-			}
-			else
-			{
-				if ((nLightmaps & (nLightmaps - 1)) == 0)
-				{
-					// Power of two. Use square size.
-					s_world->lightmapAtlasSize.x = s_world->lightmapAtlasSize.y = (int)ceil(sqrtf((float)nLightmaps));
-				}
-				else
-				{
-					s_world->lightmapAtlasSize.x = std::min(maxCells, (int)nLightmaps);
-					s_world->lightmapAtlasSize.y = (int)ceil(nLightmaps / (float)s_world->lightmapAtlasSize.x);
-				}
-			}
-
-			s_world->lightmapAtlasSize.x = std::min(s_world->lightmapAtlasSize.x, maxCells);
-			s_world->lightmapAtlasSize.y = std::min(s_world->lightmapAtlasSize.y, maxCells);
+			// Use as few atlases as the max texture size allows. Materials are created per atlas, so with a single atlas every lightmapped surface using the same material can be batched together.
+			const int maxCells = std::max(1, (int)bgfx::getCaps()->limits.maxTextureSize / s_world->lightmapSize);
+			s_world->lightmapAtlasSize.x = std::min(maxCells, (int)ceil(sqrtf((float)nLightmaps)));
+			s_world->lightmapAtlasSize.y = std::min(maxCells, (int)ceil(nLightmaps / (float)s_world->lightmapAtlasSize.x));
 			s_world->nLightmapsPerAtlas = s_world->lightmapAtlasSize.x * s_world->lightmapAtlasSize.y;
 			s_world->lightmapAtlases.resize((size_t)ceil(nLightmaps / (float)s_world->nLightmapsPerAtlas));
 
 			// Pack lightmaps into atlas(es).
 			interface::Printf("Packing %d lightmaps into %d atlas(es) sized %dx%d.\n", (int)nLightmaps, (int)s_world->lightmapAtlases.size(), s_world->lightmapAtlasSize.x * s_world->lightmapSize, s_world->lightmapAtlasSize.y * s_world->lightmapSize);
-			size_t lightmapIndex = 0;
+			std::vector<Image> atlasImages(s_world->lightmapAtlases.size());
 
-			for (size_t i = 0; i < s_world->lightmapAtlases.size(); i++)
+			for (Image &image : atlasImages)
 			{
-				Image image;
 				image.width = s_world->lightmapAtlasSize.x * s_world->lightmapSize;
 				image.height = s_world->lightmapAtlasSize.y * s_world->lightmapSize;
 				image.nComponents = 4;
 				image.dataSize = image.width * image.height * image.nComponents;
 				image.data = (uint8_t *)malloc(image.dataSize);
 				image.release = ReleaseLightmapAtlasImage;
-				int nAtlasedLightmaps = 0;
+			}
 
-				for (;;)
+			if (cacheHit && lightmapAtlasData.size() == atlasImages.size() * atlasImages[0].dataSize)
+			{
+				for (size_t i = 0; i < atlasImages.size(); i++)
 				{
-					// Expand from 24bpp to 32bpp with overbright and RGBM encoding.
-					for (int y = 0; y < s_world->lightmapSize; y++)
+					memcpy(atlasImages[i].data, &lightmapAtlasData[i * atlasImages[i].dataSize], atlasImages[i].dataSize);
+				}
+			}
+			else
+			{
+				// Each lightmap writes to its own atlas cell, so they can be packed in any order.
+				g_jobSystem->parallelFor(nLightmaps, 1, [&](size_t begin, size_t end)
+				{
+					for (size_t lightmapIndex = begin; lightmapIndex < end; lightmapIndex++)
 					{
-						for (int x = 0; x < s_world->lightmapSize; x++)
+						Image &image = atlasImages[lightmapIndex / s_world->nLightmapsPerAtlas];
+						const int cell = int(lightmapIndex % s_world->nLightmapsPerAtlas);
+						const int lightmapX = cell % s_world->lightmapAtlasSize.x;
+						const int lightmapY = cell / s_world->lightmapAtlasSize.x;
+						const uint8_t *lightmapData = &srcData[lightmapIndex * srcDataSize];
+
+						// Expand from 24bpp to 32bpp with overbright and RGBM encoding.
+						for (int y = 0; y < s_world->lightmapSize; y++)
 						{
-							const uint8_t *src = &srcData[(x + y * s_world->lightmapSize) * 3];
-							const int lightmapX = (nAtlasedLightmaps % s_world->nLightmapsPerAtlas) % s_world->lightmapAtlasSize.x;
-							const int lightmapY = (nAtlasedLightmaps % s_world->nLightmapsPerAtlas) / s_world->lightmapAtlasSize.x;
-							auto dest = (vec4b *)&image.data[((lightmapX * s_world->lightmapSize + x) + (lightmapY * s_world->lightmapSize + y) * (s_world->lightmapAtlasSize.x * s_world->lightmapSize)) * image.nComponents];
-							*dest = vec4b(vec4(util::OverbrightenColor(vec3::fromBytes(src)), 1));
+							for (int x = 0; x < s_world->lightmapSize; x++)
+							{
+								const uint8_t *src = &lightmapData[(x + y * s_world->lightmapSize) * 3];
+								auto dest = (vec4b *)&image.data[((lightmapX * s_world->lightmapSize + x) + (lightmapY * s_world->lightmapSize + y) * (s_world->lightmapAtlasSize.x * s_world->lightmapSize)) * image.nComponents];
+								*dest = vec4b(vec4(util::OverbrightenColor(vec3::fromBytes(src)), 1));
+							}
 						}
 					}
+				});
 
-					nAtlasedLightmaps++;
-					lightmapIndex++;
-					srcData += srcDataSize;
+				if (useCache)
+				{
+					lightmapAtlasData.resize(atlasImages.size() * atlasImages[0].dataSize);
 
-					if (nAtlasedLightmaps >= s_world->nLightmapsPerAtlas || lightmapIndex >= nLightmaps)
-						break;
+					for (size_t i = 0; i < atlasImages.size(); i++)
+					{
+						memcpy(&lightmapAtlasData[i * atlasImages[i].dataSize], atlasImages[i].data, atlasImages[i].dataSize);
+					}
 				}
+			}
 
-				s_world->lightmapAtlases[i] = g_textureCache->create(util::VarArgs("*lightmap%d", (int)i), image, TextureFlags::ClampToEdge | TextureFlags::Mutable);
+			for (size_t i = 0; i < s_world->lightmapAtlases.size(); i++)
+			{
+				s_world->lightmapAtlases[i] = g_textureCache->create(util::VarArgs("*lightmap%d", (int)i), atlasImages[i], TextureFlags::ClampToEdge | TextureFlags::Mutable);
 			}
 		}
 	}
@@ -777,17 +968,30 @@ void Load(const char *name)
 		{
 			interface::PrintWarningf("WARNING: light grid mismatch\n");
 		}
-		else
+		else if (!cacheHit)
 		{
 			s_world->lightGridData.resize(lump.filelen);
 			memcpy(s_world->lightGridData.data(), &fileData[lump.fileofs], lump.filelen);
+
+			// deal with overbright bits
+			g_jobSystem->parallelFor(s_world->lightGridData.size() / 8, 4096, [](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					util::OverbrightenColor(&s_world->lightGridData[i*8], &s_world->lightGridData[i*8]);
+					util::OverbrightenColor(&s_world->lightGridData[i*8+3], &s_world->lightGridData[i*8+3]);
+				}
+			});
 		}
 
-		// deal with overbright bits
-		for (int i = 0; i < numGridPoints; i++)
+		if (!s_world->lightGridData.empty())
 		{
-			util::OverbrightenColor(&s_world->lightGridData[i*8], &s_world->lightGridData[i*8]);
-			util::OverbrightenColor(&s_world->lightGridData[i*8+3], &s_world->lightGridData[i*8+3]);
+			DecodeLightGrid();
+
+			if ((bgfx::getCaps()->supported & BGFX_CAPS_TEXTURE_3D) != 0)
+			{
+				CreateLightGridTextures();
+			}
 		}
 	}
 
@@ -803,47 +1007,85 @@ void Load(const char *name)
 		fileMaterial++;
 	}
 
-	// Vertices
-	std::vector<Vertex> vertices(header->lumps[LUMP_DRAWVERTS].filelen / sizeof(drawVert_t));
-	auto fileDrawVerts = (const drawVert_t *)(fileData + header->lumps[LUMP_DRAWVERTS].fileofs);
+	// Vertices and indices are only needed to build surface geometry, which is read from the cache on a hit.
+	std::vector<Vertex> vertices;
+	std::vector<uint16_t> indices;
 
-	for (size_t i = 0; i < vertices.size(); i++)
+	if (!cacheHit)
 	{
-		Vertex &v = vertices[i];
-		const drawVert_t &fv = fileDrawVerts[i];
-		v.pos = vec3(LittleFloat(fv.xyz[0]), LittleFloat(fv.xyz[1]), LittleFloat(fv.xyz[2]));
-		v.setNormal(LittleFloat(fv.normal[0]), LittleFloat(fv.normal[1]), LittleFloat(fv.normal[2]));
-		v.setTexCoord(LittleFloat(fv.st[0]), LittleFloat(fv.st[1]), LittleFloat(fv.lightmap[0]), LittleFloat(fv.lightmap[1]));
-		v.setColor(util::ToLinear(vec4(util::OverbrightenColor(vec3::fromBytes(fv.color)), fv.color[3] / 255.0f)));
-	}
+		// Vertices
+		vertices.resize(header->lumps[LUMP_DRAWVERTS].filelen / sizeof(drawVert_t));
+		auto fileDrawVerts = (const drawVert_t *)(fileData + header->lumps[LUMP_DRAWVERTS].fileofs);
 
-	// Indices
-	std::vector<uint16_t> indices(header->lumps[LUMP_DRAWINDEXES].filelen / sizeof(int));
-	auto fileDrawIndices = (const int *)(fileData + header->lumps[LUMP_DRAWINDEXES].fileofs);
+		g_jobSystem->parallelFor(vertices.size(), 4096, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				Vertex &v = vertices[i];
+				const drawVert_t &fv = fileDrawVerts[i];
+				v.pos = vec3(LittleFloat(fv.xyz[0]), LittleFloat(fv.xyz[1]), LittleFloat(fv.xyz[2]));
+				v.setNormal(LittleFloat(fv.normal[0]), LittleFloat(fv.normal[1]), LittleFloat(fv.normal[2]));
+				v.setTexCoord(LittleFloat(fv.st[0]), LittleFloat(fv.st[1]), LittleFloat(fv.lightmap[0]), LittleFloat(fv.lightmap[1]));
+				v.setColor(util::ToLinear(vec4(util::OverbrightenColor(vec3::fromBytes(fv.color)), fv.color[3] / 255.0f)));
+			}
+		});
 
-	for (size_t i = 0; i < indices.size(); i++)
-	{
-		indices[i] = LittleLong(fileDrawIndices[i]);
+		// Indices
+		indices.resize(header->lumps[LUMP_DRAWINDEXES].filelen / sizeof(int));
+		auto fileDrawIndices = (const int *)(fileData + header->lumps[LUMP_DRAWINDEXES].fileofs);
+
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			indices[i] = LittleLong(fileDrawIndices[i]);
+		}
 	}
 
 	// Surfaces
-	s_world->surfaces.resize(header->lumps[LUMP_SURFACES].filelen / sizeof(dsurface_t));
+	s_world->surfaces.resize(nSurfaces);
+	s_world->surfaceGeometry.resize(nSurfaces);
+	s_world->surfaceCullData.resize(nSurfaces);
+	s_world->surfaceIndices.reserve(indices.size());
 	auto fileSurfaces = (const dsurface_t *)(fileData + header->lumps[LUMP_SURFACES].fileofs);
 
-	for (size_t i = 0; i < s_world->surfaces.size(); i++)
+	std::vector<int> surfaceLightmapIndices(nSurfaces);
+	std::vector<MaterialCache::PrecompileRequest> precompileRequests;
+	precompileRequests.reserve(nSurfaces);
+
+	for (size_t i = 0; i < nSurfaces; i++)
 	{
-		Surface &s = s_world->surfaces[i];
 		const dsurface_t &fs = fileSurfaces[i];
-		s.fogIndex = LittleLong(fs.fogNum); // -1 means no fog
-		const int type = LittleLong(fs.surfaceType);
 		int lightmapIndex = LittleLong(fs.lightmapNum);
 
 		// Trisoup is always vertex lit.
-		if (type == MST_TRIANGLE_SOUP)
+		if (LittleLong(fs.surfaceType) == MST_TRIANGLE_SOUP)
 		{
 			lightmapIndex = MaterialLightmapId::Vertex;
 		}
 
+		surfaceLightmapIndices[i] = lightmapIndex;
+		const int shaderNum = LittleLong(fs.shaderNum);
+
+		// Bad indices are reported by FindMaterial.
+		if (shaderNum >= 0 && shaderNum < (int)s_world->materials.size())
+		{
+			MaterialCache::PrecompileRequest request;
+			request.name = s_world->materials[shaderNum].name;
+			request.lightmapIndex = MaterialLightmapIndex(lightmapIndex);
+			precompileRequests.push_back(request);
+		}
+	}
+
+	// Parse the world materials in parallel, so FindMaterial only has to look them up.
+	g_materialCache->precompileMaterials(precompileRequests);
+
+	// Materials must be looked up on the main thread.
+	for (size_t i = 0; i < nSurfaces; i++)
+	{
+		Surface &s = s_world->surfaces[i];
+		const dsurface_t &fs = fileSurfaces[i];
+		s.fogIndex = LittleLong(fs.fogNum); // -1 means no fog
+		const int type = LittleLong(fs.surfaceType);
+		const int lightmapIndex = surfaceLightmapIndices[i];
 		const int shaderNum = LittleLong(fs.shaderNum);
 		s.material = FindMaterial(shaderNum, lightmapIndex);
 		s.flags = s_world->materials[shaderNum].surfaceFlags;
@@ -857,48 +1099,14 @@ void Load(const char *name)
 		else if (type == MST_PLANAR)
 		{
 			s.type = SurfaceType::Face;
-			const int firstVertex = LittleLong(fs.firstVert);
-			const int nVertices = LittleLong(fs.numVerts);
-			SetSurfaceGeometry(&s, &vertices[firstVertex], nVertices, &indices[LittleLong(fs.firstIndex)], LittleLong(fs.numIndexes), lightmapIndex);
-
-			// Setup cullinfo.
-			s.cullinfo.type = CullInfoType::Box | CullInfoType::Plane;
-			s.cullinfo.bounds.setupForAddingPoints();
-
-			for (int i = 0; i < nVertices; i++)
-			{
-				s.cullinfo.bounds.addPoint(vertices[firstVertex + i].pos);
-			}
-
-			// take the plane information from the lightmap vector
-			for (int i = 0; i < 3; i++)
-			{
-				s.cullinfo.plane.normal[i] = LittleFloat(fs.lightmapVecs[2][i]);
-			}
-
-			s.cullinfo.plane.distance = vec3::dotProduct(vertices[firstVertex].pos, s.cullinfo.plane.normal);
-			s.cullinfo.plane.setupFastBoundsTest();
 		}
 		else if (type == MST_TRIANGLE_SOUP)
 		{
 			s.type = SurfaceType::Mesh;
-			const int firstVertex = LittleLong(fs.firstVert);
-			const int nVertices = LittleLong(fs.numVerts);
-			SetSurfaceGeometry(&s, &vertices[firstVertex], nVertices, &indices[LittleLong(fs.firstIndex)], LittleLong(fs.numIndexes), lightmapIndex);
-
-			// Setup cullinfo.
-			s.cullinfo.bounds.setupForAddingPoints();
-
-			for (int i = 0; i < nVertices; i++)
-			{
-				s.cullinfo.bounds.addPoint(vertices[firstVertex + i].pos);
-			}
 		}
 		else if (type == MST_PATCH)
 		{
 			s.type = SurfaceType::Patch;
-			s.patch = Patch_Subdivide(LittleLong(fs.patchWidth), LittleLong(fs.patchHeight), &vertices[LittleLong(fs.firstVert)]);
-			SetSurfaceGeometry(&s, s.patch->verts, s.patch->numVerts, s.patch->indexes, s.patch->numIndexes, lightmapIndex);
 		}
 		else if (type == MST_FLARE)
 		{
@@ -906,12 +1114,112 @@ void Load(const char *name)
 		}
 	}
 
-	// Create brush models.
-	for (size_t i = 1; i < s_world->modelDefs.size(); i++)
+	if (!cacheHit)
 	{
-		auto model = std::make_unique<WorldModel>((int)i);
-		model->buildGeometry();
-		g_modelCache->addModel(std::move(model));
+		// Subdivide patches and setup cullinfo. Each surface only writes to its own cull data.
+		// Geometry is built from the BSP surface type, not Surface::type, so nodraw surfaces still get it. The world cache key doesn't cover materials.
+		g_jobSystem->parallelFor(nSurfaces, 16, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				CullInfo &cullinfo = s_world->surfaceCullData[i].cullinfo;
+				const dsurface_t &fs = fileSurfaces[i];
+				const int type = LittleLong(fs.surfaceType);
+
+				if (type == MST_PLANAR)
+				{
+					const int firstVertex = LittleLong(fs.firstVert);
+					const int nVertices = LittleLong(fs.numVerts);
+					cullinfo.type = CullInfoType::Box | CullInfoType::Plane;
+					cullinfo.bounds.setupForAddingPoints();
+
+					for (int j = 0; j < nVertices; j++)
+					{
+						cullinfo.bounds.addPoint(vertices[firstVertex + j].pos);
+					}
+
+					// take the plane information from the lightmap vector
+					for (int j = 0; j < 3; j++)
+					{
+						cullinfo.plane.normal[j] = LittleFloat(fs.lightmapVecs[2][j]);
+					}
+
+					cullinfo.plane.distance = vec3::dotProduct(vertices[firstVertex].pos, cullinfo.plane.normal);
+					cullinfo.plane.setupFastBoundsTest();
+				}
+				else if (type == MST_TRIANGLE_SOUP)
+				{
+					const int firstVertex = LittleLong(fs.firstVert);
+					const int nVertices = LittleLong(fs.numVerts);
+					cullinfo.bounds.setupForAddingPoints();
+
+					for (int j = 0; j < nVertices; j++)
+					{
+						cullinfo.bounds.addPoint(vertices[firstVertex + j].pos);
+					}
+				}
+				else if (type == MST_PATCH)
+				{
+					Patch *patch = Patch_Subdivide(LittleLong(fs.patchWidth), LittleLong(fs.patchHeight), &vertices[LittleLong(fs.firstVert)]);
+
+					// Copy the level of detail origin, which is the center of the group of all curves that must subdivide the same to avoid cracking.
+					Bounds lodBounds;
+					lodBounds.min = vec3(LittleFloat(fs.lightmapVecs[0][0]), LittleFloat(fs.lightmapVecs[0][1]), LittleFloat(fs.lightmapVecs[0][2]));
+					lodBounds.max = vec3(LittleFloat(fs.lightmapVecs[1][0]), LittleFloat(fs.lightmapVecs[1][1]), LittleFloat(fs.lightmapVecs[1][2]));
+					patch->lodOrigin = lodBounds.midpoint();
+					patch->lodRadius = (lodBounds.min - patch->lodOrigin).length();
+					cullinfo.type = CullInfoType::Box;
+					cullinfo.bounds = patch->cullBounds;
+					s_world->surfaceCullData[i].patch = patch;
+				}
+			}
+		});
+
+		// Patches in the same lod group must choose the same rows and columns on shared edges.
+		std::vector<Patch *> patches;
+
+		for (const SurfaceCullData &cd : s_world->surfaceCullData)
+		{
+			if (cd.patch)
+				patches.push_back(cd.patch);
+		}
+
+		Patch_FixSharedVertexLodError(patches.data(), patches.size());
+
+		// Append surface geometry in surface order, so the vertex and index layout doesn't depend on how the work above was split.
+		for (size_t i = 0; i < nSurfaces; i++)
+		{
+			const dsurface_t &fs = fileSurfaces[i];
+			const int type = LittleLong(fs.surfaceType);
+
+			if (type == MST_PLANAR || type == MST_TRIANGLE_SOUP)
+			{
+				SetSurfaceGeometry(i, &vertices[LittleLong(fs.firstVert)], LittleLong(fs.numVerts), &indices[LittleLong(fs.firstIndex)], LittleLong(fs.numIndexes), surfaceLightmapIndices[i]);
+			}
+			else if (type == MST_PATCH)
+			{
+				const Patch *patch = s_world->surfaceCullData[i].patch;
+				SetSurfaceGeometry(i, patch->verts, patch->numVerts, patch->indexes, patch->numIndexes, surfaceLightmapIndices[i]);
+				SetPatchLodGeometry(i, *patch);
+			}
+		}
+
+		if (useCache)
+		{
+			WriteCache(cacheKey, lightmapAtlasData);
+		}
+	}
+
+	// Use 32-bit indices if all the world geometry won't fit in one vertex buffer with 16-bit indices.
+	// 0xffff is excluded, since it's the primitive restart index on some backends.
+	s_world->use32BitIndices = s_world->vertices.size() > UINT16_MAX;
+
+	if (s_world->use32BitIndices)
+	{
+		if (!(bgfx::getCaps()->supported & BGFX_CAPS_INDEX32))
+			interface::Error("%s: %d vertices requires 32-bit indices, which aren't supported by this renderer backend", s_world->name, (int)s_world->vertices.size());
+
+		interface::Printf("Using 32-bit world indices for %d vertices\n", (int)s_world->vertices.size());
 	}
 
 	// Leaf surfaces
@@ -992,41 +1300,68 @@ void Load(const char *name)
 
 	// Initialize geometry buffers.
 	// Index buffer is initialized on first use, not here.
-	for (size_t i = 0; i < s_world->currentGeometryBuffer + 1; i++)
+	if (!s_world->vertices.empty())
 	{
-		s_world->vertexBuffers[i].handle = bgfx::createVertexBuffer(bgfx::makeRef(&s_world->vertices[i][0], uint32_t(s_world->vertices[i].size() * sizeof(Vertex))), Vertex::decl);
+		s_world->vertexBuffer.handle = bgfx::createVertexBuffer(bgfx::makeRef(s_world->vertices.data(), uint32_t(s_world->vertices.size() * sizeof(Vertex))), Vertex::decl);
 	}
 
 	// Create batched surfaces for frustum culling.
-	std::vector<Surface *> sortedSurfaces;
+	std::vector<uint32_t> sortedSurfaces;
 	sortedSurfaces.reserve(s_world->modelDefs[0].nSurfaces); // Reserve maximum possible size. Actual size will probably be less due to ignored surfaces.
 
-	for (Surface &surface : s_world->surfaces)
+	for (uint32_t i = 0; i < (uint32_t)s_world->surfaces.size(); i++)
 	{
+		const Surface &surface = s_world->surfaces[i];
+
 		if (IgnoreSurface(surface) || surface.material->isPortal) // Ignore portals too.
 			continue;
 
 		if (surface.material->isSky)
 		{
-			CreateOrAppendSkySurface(s_world->skySurfaces, surface);
+			CreateOrAppendSkySurface(s_world->skySurfaces, i);
 		}
 		else
 		{
-			sortedSurfaces.push_back(&surface);
+			sortedSurfaces.push_back(i);
 		}
 	}
 
-	std::sort(sortedSurfaces.begin(), sortedSurfaces.end(), SurfaceCompare);
-	std::vector<uint16_t> batchedIndices[s_maxWorldGeometryBuffers];
-	CreateBatchedSurfaces(sortedSurfaces, &s_world->batchedSurfaces, batchedIndices, &s_world->cpuDeformVertices, &s_world->cpuDeformIndices);
+	// Brush models are batched alongside the world. Batching only reads world data and each job writes to its own output, so the result is the same as batching serially.
+	std::vector<std::unique_ptr<WorldModel>> brushModels(s_world->modelDefs.size() > 0 ? s_world->modelDefs.size() - 1 : 0);
 
-	for (size_t i = 0; i < s_world->currentGeometryBuffer + 1; i++)
+	for (size_t i = 0; i < brushModels.size(); i++)
 	{
-		if (batchedIndices[i].empty())
-			continue;
+		brushModels[i] = std::make_unique<WorldModel>(int(i + 1));
+	}
+
+	std::vector<uint32_t> batchedIndices;
 
-		const bgfx::Memory *mem = bgfx::copy(batchedIndices[i].data(), uint32_t(batchedIndices[i].size() * sizeof(uint16_t)));
-		s_world->indexBuffers[i].handle = bgfx::createIndexBuffer(mem);
+	g_jobSystem->parallelFor(brushModels.size() + 1, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			if (i == 0)
+			{
+				std::sort(sortedSurfaces.begin(), sortedSurfaces.end(), SurfaceCompare);
+				CreateBatchedSurfaces(sortedSurfaces, &s_world->batchedSurfaces, &batchedIndices, &s_world->cpuDeformVertices, &s_world->cpuDeformIndices);
+			}
+			else
+			{
+				brushModels[i - 1]->batchSurfaces();
+			}
+		}
+	});
+
+	if (!batchedIndices.empty())
+	{
+		s_world->indexBuffer.handle = bgfx::createIndexBuffer(CopyIndices(batchedIndices), GetIndexBufferFlags());
+	}
+
+	// Create brush models. bgfx and the model cache are only used on the main thread, in model order.
+	for (std::unique_ptr<WorldModel> &model : brushModels)
+	{
+		model->createBuffers();
+		g_modelCache->addModel(std::move(model));
 	}
 }
 
@@ -1181,14 +1516,24 @@ const Surface &GetSurface(int modelIndex, int surfaceIndex)
 	return s_world->surfaces[s_world->modelDefs[modelIndex].firstSurface + surfaceIndex];
 }
 
-int GetNumVertexBuffers()
+const SurfaceGeometry &GetSurfaceGeometry(int modelIndex, int surfaceIndex)
+{
+	return s_world->surfaceGeometry[s_world->modelDefs[modelIndex].firstSurface + surfaceIndex];
+}
+
+const SurfaceCullData &GetSurfaceCullData(int modelIndex, int surfaceIndex)
+{
+	return s_world->surfaceCullData[s_world->modelDefs[modelIndex].firstSurface + surfaceIndex];
+}
+
+const uint32_t *GetSurfaceIndices(const SurfaceGeometry &geometry)
 {
-	return (int)s_world->currentGeometryBuffer + 1;
+	return &s_world->surfaceIndices[geometry.firstIndex];
 }
 
-const std::vector<Vertex> &GetVertexBuffer(int index)
+const std::vector<Vertex> &GetVertices()
 {
-	return s_world->vertices[index];
+	return s_world->vertices;
 }
 
 bool GetEntityToken(char *buffer, int size)
@@ -1210,101 +1555,119 @@ bool HasLightGrid()
 	return !s_world->lightGridData.empty();
 }
 
-void SampleLightGrid(vec3 position, vec3 *ambientLight, vec3 *directedLight, vec3 *lightDir)
+bool HasLightGridTextures()
 {
-	assert(ambientLight);
-	assert(directedLight);
-	assert(lightDir);
-	assert(HasLightGrid()); // false with -nolight maps
+	return s_world->lightGridAmbientTexture != nullptr;
+}
 
-	vec3 lightPosition = position - s_world->lightGridOrigin;
-	int pos[3];
-	float frac[3];
+void SetLightGridUniforms(Uniforms_Entity *uniforms, vec3 lightOffset)
+{
+	assert(uniforms);
+	assert(HasLightGridTextures());
+
+	// Grid point centers are at texel centers.
+	vec3 scale, bias;
 
 	for (size_t i = 0; i < 3; i++)
 	{
-		float v = lightPosition[i] * s_world->lightGridInverseSize[i];
-		pos[i] = (int)floor(v),
-		frac[i] = v - pos[i];
-		pos[i] = math::Clamped(pos[i], 0, s_world->lightGridBounds[i] - 1);
+		scale[i] = s_world->lightGridInverseSize[i] / s_world->lightGridBounds[i];
+		bias[i] = (0.5f - s_world->lightGridOrigin[i] * s_world->lightGridInverseSize[i]) / s_world->lightGridBounds[i] + lightOffset[i] * scale[i];
 	}
 
-	*ambientLight = vec3::empty;
-	*directedLight = vec3::empty;
-	vec3 direction;
+	uniforms->lightGridScale.set(scale);
+	uniforms->lightGrid_Bias_MinLight.set(vec4(bias, g_identityLight * 32 / 255.0f));
+	bgfx::setTexture(TextureUnit::LightGridAmbient, uniforms->lightGridAmbientSampler.handle, s_world->lightGridAmbientTexture->getHandle());
+	bgfx::setTexture(TextureUnit::LightGridDirected, uniforms->lightGridDirectedSampler.handle, s_world->lightGridDirectedTexture->getHandle());
+	bgfx::setTexture(TextureUnit::LightGridDirection, uniforms->lightGridDirectionSampler.handle, s_world->lightGridDirectionTexture->getHandle());
+}
 
-	// Trilerp the light value.
-	int gridStep[3];
-	gridStep[0] = 8;
-	gridStep[1] = 8 * s_world->lightGridBounds[0];
-	gridStep[2] = 8 * s_world->lightGridBounds[0] * s_world->lightGridBounds[1];
-	const uint8_t *gridData = &s_world->lightGridData[pos[0] * gridStep[0] + pos[1] * gridStep[1] + pos[2] * gridStep[2]];
+void SampleLightGrid(vec3 position, vec3 *ambientLight, vec3 *directedLight, vec3 *lightDir)
+{
+	SampleLightGrid(&position, 1, ambientLight, directedLight, lightDir);
+}
 
-	float totalFactor = 0;
+static bx::simd128_t LoadLightGridValue(const vec4 &v)
+{
+	return bx::simd_ld<bx::simd128_t>(v.x, v.y, v.z, v.w);
+}
+
+void SampleLightGrid(const vec3 *positions, size_t n, vec3 *ambientLight, vec3 *directedLight, vec3 *lightDir)
+{
+	assert(positions);
+	assert(ambientLight);
+	assert(directedLight);
+	assert(lightDir);
+	assert(HasLightGrid()); // false with -nolight maps
+	using namespace bx;
+	const vec3i &bounds = s_world->lightGridBounds;
+	const size_t gridStep[3] = { 1, size_t(bounds[0]), size_t(bounds[0] * bounds[1]) };
 
-	for (int i = 0; i < 8; i++)
+	for (size_t p = 0; p < n; p++)
 	{
-		float factor = 1.0;
-		const uint8_t *data = gridData;
-		int j;
+		const vec3 lightPosition = positions[p] - s_world->lightGridOrigin;
+		size_t index = 0;
+		size_t step[3];
+		float frac[3];
 
-		for (j = 0; j < 3; j++)
+		for (size_t i = 0; i < 3; i++)
 		{
-			if (i & (1<<j))
-			{
-				// Ignore values outside lightgrid.
-				if (pos[j] + 1 > s_world->lightGridBounds[j] - 1)
-					break;
+			const float v = lightPosition[i] * s_world->lightGridInverseSize[i];
+			int pos = (int)std::floor(v);
+			frac[i] = v - pos;
+			pos = math::Clamped(pos, 0, bounds[i] - 1);
+			index += pos * gridStep[i];
 
-				factor *= frac[j];
-				data += gridStep[j];
-			}
-			else
-			{
-				factor *= 1.0f - frac[j];
-			}
+			// Ignore values outside lightgrid.
+			step[i] = pos + 1 > bounds[i] - 1 ? 0 : gridStep[i];
 		}
 
-		if (j != 3)
-			continue;
+		// Trilerp the light values. The grid values are premultiplied by their weight, so samples in walls add nothing.
+		simd128_t ambient = simd_zero<simd128_t>();
+		simd128_t directed = simd_zero<simd128_t>();
+		simd128_t direction = simd_zero<simd128_t>();
 
-		// Ignore samples in walls.
-		if (!(data[0] + data[1] + data[2] + data[3] + data[4] + data[5]))
-			continue;
+		for (int i = 0; i < 8; i++)
+		{
+			float factor = 1.0f;
+			size_t cornerIndex = index;
 
-		totalFactor += factor;
+			for (int j = 0; j < 3; j++)
+			{
+				if (i & (1<<j))
+				{
+					factor = step[j] ? factor * frac[j] : 0;
+					cornerIndex += step[j];
+				}
+				else
+				{
+					factor *= 1.0f - frac[j];
+				}
+			}
 
-		(*ambientLight)[0] += factor * data[0];
-		(*ambientLight)[1] += factor * data[1];
-		(*ambientLight)[2] += factor * data[2];
-		(*directedLight)[0] += factor * data[3];
-		(*directedLight)[1] += factor * data[4];
-		(*directedLight)[2] += factor * data[5];
+			if (factor <= 0)
+				continue;
 
-		int lat = data[7];
-		int lng = data[6];
-		lat *= (g_funcTableSize / 256);
-		lng *= (g_funcTableSize / 256);
+			const simd128_t f = simd_splat<simd128_t>(factor);
+			ambient = simd_madd(f, LoadLightGridValue(s_world->lightGridAmbient[cornerIndex]), ambient);
+			directed = simd_madd(f, LoadLightGridValue(s_world->lightGridDirected[cornerIndex]), directed);
+			direction = simd_madd(f, LoadLightGridValue(s_world->lightGridDirection[cornerIndex]), direction);
+		}
 
-		// decode X as cos(lat) * sin(long)
-		// decode Y as sin(lat) * sin(long)
-		// decode Z as cos(long)
-		vec3 normal;
-		normal[0] = g_sinTable[(lat + (g_funcTableSize / 4)) & g_funcTableMask] * g_sinTable[lng];
-		normal[1] = g_sinTable[lat] * g_sinTable[lng];
-		normal[2] = g_sinTable[(lng + (g_funcTableSize / 4)) & g_funcTableMask];
-		direction += normal * factor;
-	}
+		// Ambient w is the total factor of the samples that aren't in walls.
+		const float totalFactor = simd_w(ambient);
 
-	if (totalFactor > 0 && totalFactor < 0.99)
-	{
-		totalFactor = 1.0f / totalFactor;
-		(*ambientLight) *= totalFactor;
-		(*directedLight) *= totalFactor;
-	}
+		if (totalFactor > 0 && totalFactor < 0.99f)
+		{
+			const simd128_t scale = simd_splat<simd128_t>(1.0f / totalFactor);
+			ambient = simd_mul(ambient, scale);
+			directed = simd_mul(directed, scale);
+		}
 
-	(*lightDir) = direction;
-	lightDir->normalizeFast();
+		ambientLight[p] = vec3(simd_x(ambient), simd_y(ambient), simd_z(ambient));
+		directedLight[p] = vec3(simd_x(directed), simd_y(directed), simd_z(directed));
+		lightDir[p] = vec3(simd_x(direction), simd_y(direction), simd_z(direction));
+		lightDir[p].normalizeFast();
+	}
 }
 
 Node *LeafFromPosition(vec3 pos)
@@ -1367,50 +1730,72 @@ int FindFogIndex(const Bounds &bounds)
 	return -1;
 }
 
-void CalculateFog(int fogIndex, const mat4 &modelMatrix, const mat4 &modelViewMatrix, vec3 cameraPosition, vec3 localViewPosition, const mat3 &cameraRotation, vec4 *fogColor, vec4 *fogDistance, vec4 *fogDepth, float *eyeT)
+size_t GetNumFogs()
+{
+	return s_world->fogs.size();
+}
+
+void CalculateFog(int fogIndex, vec3 cameraPosition, const mat3 &cameraRotation, const mat4 &viewMatrix, FogCameraParameters *parameters)
 {
 	assert(fogIndex != -1);
-	assert(fogDistance);
-	assert(fogDepth);
-	assert(eyeT);
+	assert(parameters);
 	const Fog &fog = s_world->fogs[fogIndex];
+	parameters->color[0] = ((unsigned char *)(&fog.colorInt))[0] / 255.0f;
+	parameters->color[1] = ((unsigned char *)(&fog.colorInt))[1] / 255.0f;
+	parameters->color[2] = ((unsigned char *)(&fog.colorInt))[2] / 255.0f;
+	parameters->color[3] = ((unsigned char *)(&fog.colorInt))[3] / 255.0f;
+
+	// Scale the fog vectors based on the fog's thickness.
+	// The model view matrix z row is the view matrix z row rotated by the model rotation, and the model position offsets the distance along the camera forward vector.
+	parameters->distance = vec4(-viewMatrix[2], -viewMatrix[6], -viewMatrix[10], -vec3::dotProduct(cameraPosition, cameraRotation[0])) * fog.tcScale;
+	parameters->distanceForward = cameraRotation[0] * fog.tcScale;
+	parameters->hasSurface = fog.hasSurface;
 
-	if (fogColor)
+	if (fog.hasSurface)
+	{
+		parameters->depth = vec4(fog.surface.xyz(), -fog.surface[3]);
+		parameters->eyeT = vec3::dotProduct(cameraPosition, parameters->depth.xyz()) + parameters->depth[3];
+	}
+	else
 	{
-		(*fogColor)[0] = ((unsigned char *)(&fog.colorInt))[0] / 255.0f;
-		(*fogColor)[1] = ((unsigned char *)(&fog.colorInt))[1] / 255.0f;
-		(*fogColor)[2] = ((unsigned char *)(&fog.colorInt))[2] / 255.0f;
-		(*fogColor)[3] = ((unsigned char *)(&fog.colorInt))[3] / 255.0f;
+		parameters->depth = vec4::empty;
+		parameters->eyeT = 1; // non-surface fog always has eye inside
 	}
+}
+
+void TransformFog(const FogCameraParameters &parameters, const mat4 &modelMatrix, vec3 localViewPosition, vec4 *fogDistance, vec4 *fogDepth, float *eyeT)
+{
+	assert(fogDistance);
+	assert(fogDepth);
+	assert(eyeT);
 
 	// Grab the entity position and rotation from the model matrix instead of passing them in as more parameters.
 	const vec3 position(modelMatrix[12], modelMatrix[13], modelMatrix[14]);
 	const mat3 rotation(modelMatrix);
-	vec3 local = position - cameraPosition;
-	(*fogDistance)[0] = -modelViewMatrix[2];
-	(*fogDistance)[1] = -modelViewMatrix[6];
-	(*fogDistance)[2] = -modelViewMatrix[10];
-	(*fogDistance)[3] = vec3::dotProduct(local, cameraRotation[0]);
-
-	// scale the fog vectors based on the fog's thickness
-	(*fogDistance) *= fog.tcScale;
+	const vec3 distance(parameters.distance.xyz());
+	(*fogDistance)[0] = vec3::dotProduct(distance, rotation[0]);
+	(*fogDistance)[1] = vec3::dotProduct(distance, rotation[1]);
+	(*fogDistance)[2] = vec3::dotProduct(distance, rotation[2]);
+	(*fogDistance)[3] = parameters.distance[3] + vec3::dotProduct(position, parameters.distanceForward);
 
 	// rotate the gradient vector for this orientation
-	if (fog.hasSurface)
+	if (parameters.hasSurface)
 	{
-		(*fogDepth)[0] = fog.surface[0] * rotation[0][0] + fog.surface[1] * rotation[0][1] + fog.surface[2] * rotation[0][2];
-		(*fogDepth)[1] = fog.surface[0] * rotation[1][0] + fog.surface[1] * rotation[1][1] + fog.surface[2] * rotation[1][2];
-		(*fogDepth)[2] = fog.surface[0] * rotation[2][0] + fog.surface[1] * rotation[2][1] + fog.surface[2] * rotation[2][2];
-		(*fogDepth)[3] = -fog.surface[3] + vec3::dotProduct(position, fog.surface.xyz());
+		const vec3 surface(parameters.depth.xyz());
+		(*fogDepth)[0] = vec3::dotProduct(surface, rotation[0]);
+		(*fogDepth)[1] = vec3::dotProduct(surface, rotation[1]);
+		(*fogDepth)[2] = vec3::dotProduct(surface, rotation[2]);
+		(*fogDepth)[3] = parameters.depth[3] + vec3::dotProduct(position, surface);
 		*eyeT = vec3::dotProduct(localViewPosition, fogDepth->xyz()) + (*fogDepth)[3];
 	}
 	else
 	{
-		*eyeT = 1; // non-surface fog always has eye inside
+		*fogDepth = parameters.depth;
+		*eyeT = 1;
 	}
 }
 
-static void BoxSurfaces_recursive(Node *node, Bounds bounds, Surface **list, int listsize, int *listlength, vec3 dir)
+static void BoxSurfaces_recursive(Node *node, Bounds bounds, uint32_t *list, int listsize, int *listlength, vec3 dir)
 {
 	// do the tail recursion in a loop
 	while (!node->leaf)
@@ -1435,7 +1820,9 @@ static void BoxSurfaces_recursive(Node *node, Bounds bounds, Surface **list, int
 	// add the individual surfaces
 	for (int i = 0; i < node->nSurfaces; i++)
 	{
-		Surface *surface = &s_world->surfaces[s_world->leafSurfaces[node->firstSurface + i]];
+		const uint32_t surfaceIndex = (uint32_t)s_world->leafSurfaces[node->firstSurface + i];
+		const Surface *surface = &s_world->surfaces[surfaceIndex];
+		SurfaceCullData *cullData = &s_world->surfaceCullData[surfaceIndex];
 
 		if (*listlength >= listsize)
 			break;
@@ -1443,34 +1830,34 @@ static void BoxSurfaces_recursive(Node *node, Bounds bounds, Surface **list, int
 		// check if the surface has NOIMPACT or NOMARKS set
 		if ((surface->material->surfaceFlags & (SURF_NOIMPACT | SURF_NOMARKS)) || (surface->material->contentFlags & CONTENTS_FOG))
 		{
-			surface->decalDuplicateId = s_world->decalDuplicateSurfaceId;
+			cullData->decalDuplicateId = s_world->decalDuplicateSurfaceId;
 		}
 		// extra check for surfaces to avoid list overflows
 		else if (surface->type == SurfaceType::Face)
 		{
 			// the face plane should go through the box
-			int s = surface->cullinfo.plane.testBounds(bounds);
+			int s = cullData->cullinfo.plane.testBounds(bounds);
 
 			if (s == 1 || s == 2)
 			{
-				surface->decalDuplicateId = s_world->decalDuplicateSurfaceId;
+				cullData->decalDuplicateId = s_world->decalDuplicateSurfaceId;
 			}
-			else if (vec3::dotProduct(surface->cullinfo.plane.normal, dir) > -0.5)
+			else if (vec3::dotProduct(cullData->cullinfo.plane.normal, dir) > -0.5)
 			{
 				// don't add faces that make sharp angles with the projection direction
-				surface->decalDuplicateId = s_world->decalDuplicateSurfaceId;
+				cullData->decalDuplicateId = s_world->decalDuplicateSurfaceId;
 			}
 		}
 		else if (surface->type != SurfaceType::Patch && surface->type != SurfaceType::Mesh)
 		{
-			surface->decalDuplicateId = s_world->decalDuplicateSurfaceId;
+			cullData->decalDuplicateId = s_world->decalDuplicateSurfaceId;
 		}
 
 		// check the viewCount because the surface may have already been added if it spans multiple leafs
-		if (surface->decalDuplicateId != s_world->decalDuplicateSurfaceId)
+		if (cullData->decalDuplicateId != s_world->decalDuplicateSurfaceId)
 		{
-			surface->decalDuplicateId = s_world->decalDuplicateSurfaceId;
-			list[*listlength] = surface;
+			cullData->decalDuplicateId = s_world->decalDuplicateSurfaceId;
+			list[*listlength] = surfaceIndex;
 			(*listlength)++;
 		}
 	}
@@ -1561,20 +1948,24 @@ int MarkFragments(int numPoints, const vec3 *points, vec3 projection, int maxPoi
 	numPlanes = numPoints + 2;
 
 	numsurfaces = 0;
-	Surface *surfaces[64];
+	uint32_t surfaces[64];
 	BoxSurfaces_recursive(&s_world->nodes[0], bounds, surfaces, 64, &numsurfaces, projectionDir);
 	returnedPoints = 0;
 	returnedFragments = 0;
 
 	for (i = 0; i < numsurfaces; i++)
 	{
-		Surface *surface = surfaces[i];
+		const Surface *surface = &s_world->surfaces[surfaces[i]];
+		const SurfaceGeometry &geometry = s_world->surfaceGeometry[surfaces[i]];
+		const SurfaceCullData &cullData = s_world->surfaceCullData[surfaces[i]];
 
 		if (surface->type == SurfaceType::Patch)
 		{
-			for (m = 0; m < surface->patch->height - 1; m++)
+			const Patch *patch = cullData.patch;
+
+			for (m = 0; m < patch->height - 1; m++)
 			{
-				for (n = 0; n < surface->patch->width - 1; n++)
+				for (n = 0; n < patch->width - 1; n++)
 				{
 					/*
 					We triangulate the grid and chop all triangles within the bounding planes of the to be projected polygon. LOD is not taken into account, not such a big deal though.
@@ -1584,9 +1975,9 @@ int MarkFragments(int numPoints, const vec3 *points, vec3 projection, int maxPoi
 					To avoid issues when LOD applied to "hollow curves" (like the ones around many jump pads) we now just add a 2 unit offset to the triangle vertices. The offset is added in the vertex normal vector direction so all triangles will still fit together. The 2 unit offset should avoid pretty much all LOD problems.
 					*/
 					numClipPoints = 3;
-					Vertex *dv = surface->patch->verts + m * surface->patch->width + n;
+					Vertex *dv = patch->verts + m * patch->width + n;
 					clipPoints[0][0] = dv[0].pos + dv[0].getNormal() * MARKER_OFFSET;
-					clipPoints[0][1] = dv[surface->patch->width].pos + dv[surface->patch->width].getNormal() * MARKER_OFFSET;
+					clipPoints[0][1] = dv[patch->width].pos + dv[patch->width].getNormal() * MARKER_OFFSET;
 					clipPoints[0][2] = dv[1].pos + dv[1].getNormal() * MARKER_OFFSET;
 
 					// check the normal of this triangle
@@ -1605,8 +1996,8 @@ int MarkFragments(int numPoints, const vec3 *points, vec3 projection, int maxPoi
 					}
 
 					clipPoints[0][0] = dv[1].pos + dv[1].getNormal() * MARKER_OFFSET;
-					clipPoints[0][1] = dv[surface->patch->width].pos + dv[surface->patch->width].getNormal() * MARKER_OFFSET;
-					clipPoints[0][2] = dv[surface->patch->width + 1].pos + dv[surface->patch->width + 1].getNormal() * MARKER_OFFSET;
+					clipPoints[0][1] = dv[patch->width].pos + dv[patch->width].getNormal() * MARKER_OFFSET;
+					clipPoints[0][2] = dv[patch->width + 1].pos + dv[patch->width + 1].getNormal() * MARKER_OFFSET;
 
 					// check the normal of this triangle
 					v1 = clipPoints[0][0] - clipPoints[0][1];
@@ -1628,16 +2019,16 @@ int MarkFragments(int numPoints, const vec3 *points, vec3 projection, int maxPoi
 		else if (surface->type == SurfaceType::Face)
 		{
 			// check the normal of this face
-			if (vec3::dotProduct(surface->cullinfo.plane.normal, projectionDir) > -0.5)
+			if (vec3::dotProduct(cullData.cullinfo.plane.normal, projectionDir) > -0.5)
 				continue;
 
-			uint16_t *tri;
+			const uint32_t *tri;
 
-			for (k = 0, tri = &surface->indices[0]; k < (int)surface->indices.size(); k += 3, tri += 3)
+			for (k = 0, tri = &s_world->surfaceIndices[geometry.firstIndex]; k < (int)geometry.nIndices; k += 3, tri += 3)
 			{
 				for (j = 0; j < 3; j++)
 				{
-					clipPoints[0][j] = s_world->vertices[surface->bufferIndex][tri[j]].pos + surface->cullinfo.plane.normal * MARKER_OFFSET;
+					clipPoints[0][j] = s_world->vertices[tri[j]].pos + cullData.cullinfo.plane.normal * MARKER_OFFSET;
 				}
 
 				// add the fragments of this face
@@ -1649,13 +2040,13 @@ int MarkFragments(int numPoints, const vec3 *points, vec3 projection, int maxPoi
 		}
 		else if (surface->type == SurfaceType::Mesh)
 		{
-			uint16_t *tri;
+			const uint32_t *tri;
 
-			for (k = 0, tri = &surface->indices[0]; k < (int)surface->indices.size(); k += 3, tri += 3)
+			for (k = 0, tri = &s_world->surfaceIndices[geometry.firstIndex]; k < (int)geometry.nIndices; k += 3, tri += 3)
 			{
 				for (j = 0; j < 3; j++)
 				{
-					clipPoints[0][j] = s_world->vertices[surface->bufferIndex][tri[j]].pos + s_world->vertices[surface->bufferIndex][tri[j]].getNormal() * MARKER_OFFSET;
+					clipPoints[0][j] = s_world->vertices[tri[j]].pos + s_world->vertices[tri[j]].getNormal() * MARKER_OFFSET;
 				}
 
 				// add the fragments of this face
@@ -1719,27 +2110,31 @@ bool CalculatePortalCamera(VisibilityId visId, vec3 mainCameraPosition, mat3 mai
 	// Calculate which portal surfaces in the PVS are visible to the camera.
 	vis.cameraPortalSurfaces.clear();
 
-	for (Surface *portalSurface : vis.portalSurfaces)
+	for (uint32_t surfaceIndex : vis.portalSurfaces)
 	{
+		const Surface *portalSurface = &s_world->surfaces[surfaceIndex];
+		const SurfaceGeometry &geometry = s_world->surfaceGeometry[surfaceIndex];
+		const uint32_t *indices = &s_world->surfaceIndices[geometry.firstIndex];
+
 		// Trivially reject.
-		if (util::IsGeometryOffscreen(mvp, portalSurface->indices.data(), portalSurface->indices.size(), s_world->vertices[portalSurface->bufferIndex].data()))
+		if (util::IsGeometryOffscreen(mvp, indices, geometry.nIndices, s_world->vertices.data()))
 			continue;
 
 		// Determine if this surface is backfaced and also determine the distance to the nearest vertex so we can cull based on portal range.
 		// Culling based on vertex distance isn't 100% correct (we should be checking for range to the surface), but it's good enough for the types of portals we have in the game right now.
 		float shortest;
 
-		if (util::IsGeometryBackfacing(mainCameraPosition, portalSurface->indices.data(), portalSurface->indices.size(), s_world->vertices[portalSurface->bufferIndex].data(), &shortest))
+		if (util::IsGeometryBackfacing(mainCameraPosition, indices, geometry.nIndices, s_world->vertices.data(), &shortest))
 			continue;
 
 		// Calculate surface plane.
 		Plane plane;
 
-		if (portalSurface->indices.size() >= 3)
+		if (geometry.nIndices >= 3)
 		{
-			const vec3 v1(s_world->vertices[portalSurface->bufferIndex][portalSurface->indices[0]].pos);
-			const vec3 v2(s_world->vertices[portalSurface->bufferIndex][portalSurface->indices[1]].pos);
-			const vec3 v3(s_world->vertices[portalSurface->bufferIndex][portalSurface->indices[2]].pos);
+			const vec3 v1(s_world->vertices[indices[0]].pos);
+			const vec3 v2(s_world->vertices[indices[1]].pos);
+			const vec3 v3(s_world->vertices[indices[2]].pos);
 			plane.normal = vec3::crossProduct(v3 - v1, v2 - v1).normal();
 			plane.distance = vec3::dotProduct(v1, plane.normal);
 		}
@@ -1785,7 +2180,7 @@ bool CalculatePortalCamera(VisibilityId visId, vec3 mainCameraPosition, mat3 mai
 		portal.entity = portalEntity;
 		portal.isMirror = isPortalMirror;
 		portal.plane = plane;
-		portal.surface = portalSurface;
+		portal.surfaceIndex = surfaceIndex;
 		vis.cameraPortalSurfaces.push_back(portal);
 	}
 
@@ -1871,25 +2266,28 @@ bool CalculateReflectionCamera(VisibilityId visId, vec3 mainCameraPosition, mat3
 	// Calculate which reflective surfaces in the PVS are visible to the camera.
 	vis.cameraReflectiveSurfaces.clear();
 
-	for (Surface *surface : vis.reflectiveSurfaces)
+	for (uint32_t surfaceIndex : vis.reflectiveSurfaces)
 	{
+		const SurfaceGeometry &geometry = s_world->surfaceGeometry[surfaceIndex];
+		const uint32_t *indices = &s_world->surfaceIndices[geometry.firstIndex];
+
 		// Trivially reject.
-		if (util::IsGeometryOffscreen(mvp, surface->indices.data(), surface->indices.size(), s_world->vertices[surface->bufferIndex].data()))
+		if (util::IsGeometryOffscreen(mvp, indices, geometry.nIndices, s_world->vertices.data()))
 			continue;
 
 		// Determine if this surface is backfaced.
-		if (util::IsGeometryBackfacing(mainCameraPosition, surface->indices.data(), surface->indices.size(), s_world->vertices[surface->bufferIndex].data()))
+		if (util::IsGeometryBackfacing(mainCameraPosition, indices, geometry.nIndices, s_world->vertices.data()))
 			continue;
 
 		// Reflective surface is visible to the camera.
 		Visibility::Reflective reflective;
-		reflective.surface = surface;
+		reflective.surfaceIndex = surfaceIndex;
 
-		if (surface->indices.size() >= 3)
+		if (geometry.nIndices >= 3)
 		{
-			const vec3 v1(s_world->vertices[surface->bufferIndex][surface->indices[0]].pos);
-			const vec3 v2(s_world->vertices[surface->bufferIndex][surface->indices[1]].pos);
-			const vec3 v3(s_world->vertices[surface->bufferIndex][surface->indices[2]].pos);
+			const vec3 v1(s_world->vertices[indices[0]].pos);
+			const vec3 v2(s_world->vertices[indices[1]].pos);
+			const vec3 v3(s_world->vertices[indices[2]].pos);
 			reflective.plane.normal = vec3::crossProduct(v3 - v1, v2 - v1).normal();
 			reflective.plane.distance = vec3::dotProduct(v1, reflective.plane.normal);
 		}
@@ -1923,6 +2321,35 @@ bool CalculateReflectionCamera(VisibilityId visId, vec3 mainCameraPosition, mat3
 	return true;
 }
 
+template<typename T>
+static bool CalculateSurfacesScreenBounds(const std::vector<T> &surfaces, const mat4 &mvp, vec2 *mins, vec2 *maxs)
+{
+	assert(mins);
+	assert(maxs);
+	*mins = vec2(1, 1);
+	*maxs = vec2(-1, -1);
+
+	for (const T &surface : surfaces)
+	{
+		const SurfaceGeometry &geometry = s_world->surfaceGeometry[surface.surfaceIndex];
+
+		if (!util::CalculateGeometryScreenBounds(mvp, &s_world->surfaceIndices[geometry.firstIndex], geometry.nIndices, s_world->vertices.data(), mins, maxs))
+			return false;
+	}
+
+	return true;
+}
+
+bool CalculatePortalScreenBounds(VisibilityId visId, const mat4 &mvp, vec2 *mins, vec2 *maxs)
+{
+	return CalculateSurfacesScreenBounds(s_world->visibility[(int)visId].cameraPortalSurfaces, mvp, mins, maxs);
+}
+
+bool CalculateReflectionScreenBounds(VisibilityId visId, const mat4 &mvp, vec2 *mins, vec2 *maxs)
+{
+	return CalculateSurfacesScreenBounds(s_world->visibility[(int)visId].cameraReflectiveSurfaces, mvp, mins, maxs);
+}
+
 void RenderPortal(VisibilityId visId, DrawCallList *drawCallList)
 {
 	assert(drawCallList);
@@ -1930,8 +2357,10 @@ void RenderPortal(VisibilityId visId, DrawCallList *drawCallList)
 
 	for (const Visibility::Portal &portal : vis.cameraPortalSurfaces)
 	{
+		const Surface &surface = s_world->surfaces[portal.surfaceIndex];
+		const SurfaceGeometry &geometry = s_world->surfaceGeometry[portal.surfaceIndex];
 		bgfx::TransientIndexBuffer tib;
-		auto nIndices = (const uint32_t)portal.surface->indices.size();
+		const uint32_t nIndices = geometry.nIndices;
 
 		if (bgfx::getAvailTransientIndexBuffer(nIndices) < nIndices)
 		{
@@ -1939,14 +2368,19 @@ void RenderPortal(VisibilityId visId, DrawCallList *drawCallList)
 			return;
 		}
 
+		// Transient index buffers are 16-bit only. Make the indices relative to the first surface vertex and offset the vertex buffer instead.
 		bgfx::allocTransientIndexBuffer(&tib, nIndices);
-		memcpy(tib.data, portal.surface->indices.data(), nIndices * sizeof(uint16_t));
+		auto tibIndices = (uint16_t *)tib.data;
+
+		for (size_t i = 0; i < nIndices; i++)
+			tibIndices[i] = uint16_t(s_world->surfaceIndices[geometry.firstIndex + i] - geometry.firstVertex);
 
 		DrawCall dc;
-		dc.material = portal.surface->material;
+		dc.material = surface.material;
 		dc.vb.type = DrawCall::BufferType::Static;
-		dc.vb.staticHandle = s_world->vertexBuffers[portal.surface->bufferIndex].handle;
-		dc.vb.nVertices = (uint32_t)s_world->vertices[portal.surface->bufferIndex].size();
+		dc.vb.staticHandle = s_world->vertexBuffer.handle;
+		dc.vb.firstVertex = geometry.firstVertex;
+		dc.vb.nVertices = geometry.nVertices;
 		dc.ib.type = DrawCall::BufferType::Transient;
 		dc.ib.transientHandle = tib;
 		dc.ib.nIndices = nIndices;
@@ -1961,8 +2395,10 @@ void RenderReflective(VisibilityId visId, DrawCallList *drawCallList)
 
 	for (const Visibility::Reflective &reflective : vis.cameraReflectiveSurfaces)
 	{
+		const Surface &surface = s_world->surfaces[reflective.surfaceIndex];
+		const SurfaceGeometry &geometry = s_world->surfaceGeometry[reflective.surfaceIndex];
 		bgfx::TransientIndexBuffer tib;
-		auto nIndices = (const uint32_t)reflective.surface->indices.size();
+		const uint32_t nIndices = geometry.nIndices;
 
 		if (bgfx::getAvailTransientIndexBuffer(nIndices) < nIndices)
 		{
@@ -1970,15 +2406,20 @@ void RenderReflective(VisibilityId visId, DrawCallList *drawCallList)
 			return;
 		}
 
+		// Transient index buffers are 16-bit only. Make the indices relative to the first surface vertex and offset the vertex buffer instead.
 		bgfx::allocTransientIndexBuffer(&tib, nIndices);
-		memcpy(tib.data, reflective.surface->indices.data(), nIndices * sizeof(uint16_t));
+		auto tibIndices = (uint16_t *)tib.data;
+
+		for (size_t i = 0; i < nIndices; i++)
+			tibIndices[i] = uint16_t(s_world->surfaceIndices[geometry.firstIndex + i] - geometry.firstVertex);
 
 		DrawCall dc;
-		dc.material = reflective.surface->material->reflectiveFrontSideMaterial;
+		dc.material = surface.material->reflectiveFrontSideMaterial;
 		assert(dc.material);
 		dc.vb.type = DrawCall::BufferType::Static;
-		dc.vb.staticHandle = s_world->vertexBuffers[reflective.surface->bufferIndex].handle;
-		dc.vb.nVertices = (uint32_t)s_world->vertices[reflective.surface->bufferIndex].size();
+		dc.vb.staticHandle = s_world->vertexBuffer.handle;
+		dc.vb.firstVertex = geometry.firstVertex;
+		dc.vb.nVertices = geometry.nVertices;
 		dc.ib.type = DrawCall::BufferType::Transient;
 		dc.ib.transientHandle = tib;
 		dc.ib.nIndices = nIndices;
@@ -1986,21 +2427,36 @@ void RenderReflective(VisibilityId visId, DrawCallList *drawCallList)
 	}
 }
 
-static void UpdatePvsVisibility(VisibilityId visId, vec3 cameraPosition, const uint8_t *areaMask)
+/// @brief Update the LOD level of visible patches.
+/// @return true if any patch changed level.
+static bool UpdatePatchLods(Visibility &vis, vec3 cameraPosition)
 {
-	assert(areaMask);
-	Visibility &vis = s_world->visibility[(int)visId];
-	vis.method = VisibilityMethod::PVS;
+	const float curveError = g_cvars.lodCurveError.getFloat();
+	bool changed = false;
 
-	// Get the PVS for the camera leaf cluster.
-	Node *cameraLeaf = LeafFromPosition(cameraPosition);
+	for (uint32_t si : vis.patchSurfaces)
+	{
+		const uint8_t lod = CalculatePatchLod(*s_world->surfaceCullData[si].patch, cameraPosition, curveError);
 
-	// Build a list of visible surfaces.
-	// Don't need to refresh visible surfaces if the camera cluster or the area bitmask haven't changed.
-	if (vis.lastCameraLeaf != nullptr && vis.lastCameraLeaf->cluster == cameraLeaf->cluster && std::equal(areaMask, areaMask + MAX_MAP_AREA_BYTES, vis.lastAreaMask))
-		return;
+		if (lod != vis.patchLods[si])
+		{
+			vis.patchLods[si] = lod;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+/// @brief Gather the surfaces visible from the camera leaf cluster, then sort and batch them.
+/// @remarks Only reads the hot Surface array for each surface in a visible leaf. Geometry is only touched when building batches.
+static void GatherPvsSurfaces(Visibility &vis, vec3 cameraPosition, const Node *cameraLeaf, const uint8_t *areaMask)
+{
+	PROFILE_SCOPED(world::GatherPvsSurfaces)
 
 	// Clear data that will be recalculated.
+	vis.patchSurfaces.clear();
+	vis.patchLods.resize(s_world->surfaces.size());
 	vis.portalSurfaces.clear();
 	vis.reflectiveSurfaces.clear();
 	vis.skySurfaces.clear();
@@ -2028,12 +2484,13 @@ static void UpdatePvsVisibility(VisibilityId visId, vec3 cameraPosition, const u
 		for (int j = 0; j < leaf.nSurfaces; j++)
 		{
 			const int si = s_world->leafSurfaces[leaf.firstSurface + j];
-			Surface &surface = s_world->surfaces[si];
 
 			// Ignore surfaces in brush models.
 			if (si < 0 || si >= (int)s_world->modelDefs[0].nSurfaces)
 				continue;
 
+			Surface &surface = s_world->surfaces[si];
+
 			// Don't add duplicates.
 			if (surface.duplicateId == s_world->duplicateSurfaceId)
 				continue;
@@ -2047,21 +2504,26 @@ static void UpdatePvsVisibility(VisibilityId visId, vec3 cameraPosition, const u
 					
 			if (surface.material->isSky)
 			{
-				CreateOrAppendSkySurface(vis.skySurfaces, surface);
+				CreateOrAppendSkySurface(vis.skySurfaces, (uint32_t)si);
 			}
 			else
 			{
 				if (surface.material->reflective == MaterialReflective::BackSide)
 				{
-					vis.reflectiveSurfaces.push_back(&surface);
+					vis.reflectiveSurfaces.push_back((uint32_t)si);
 				}
 
 				if (surface.material->isPortal)
 				{
-					vis.portalSurfaces.push_back(&surface);
+					vis.portalSurfaces.push_back((uint32_t)si);
 				}
 
-				vis.surfaces.push_back(&surface);
+				if (surface.type == SurfaceType::Patch)
+				{
+					vis.patchSurfaces.push_back((uint32_t)si);
+				}
+
+				vis.surfaces.push_back((uint32_t)si);
 			}
 		}
 	}
@@ -2069,31 +2531,57 @@ static void UpdatePvsVisibility(VisibilityId visId, vec3 cameraPosition, const u
 	// Sort visible surfaces.
 	std::sort(vis.surfaces.begin(), vis.surfaces.end(), SurfaceCompare);
 
-	CreateBatchedSurfaces(vis.surfaces, &vis.batchedSurfaces, vis.indices, &vis.cpuDeformVertices, &vis.cpuDeformIndices);
+	UpdatePatchLods(vis, cameraPosition);
+	CreateBatchedSurfaces(vis.surfaces, &vis.batchedSurfaces, &vis.indices, &vis.cpuDeformVertices, &vis.cpuDeformIndices, vis.patchLods.data());
+
+	s_world->duplicateSurfaceId++;
+}
+
+/// @brief Upload the batched surface indices to the dynamic index buffer.
+static void UpdatePvsIndexBuffer(Visibility &vis)
+{
+	if (vis.indices.empty())
+		return;
 
-	// Update dynamic index buffers.
-	for (size_t i = 0; i < s_world->currentGeometryBuffer + 1; i++)
+	const bgfx::Memory *mem = CopyIndices(vis.indices);
+
+	// Buffer is created on first use.
+	if (!bgfx::isValid(vis.indexBuffer.handle))
+	{
+		vis.indexBuffer.handle = bgfx::createDynamicIndexBuffer(mem, BGFX_BUFFER_ALLOW_RESIZE | GetIndexBufferFlags());
+	}
+	else
 	{
-		DynamicIndexBuffer &ib = vis.indexBuffers[i];
-		std::vector<uint16_t> &indices = vis.indices[i];
+		bgfx::updateDynamicIndexBuffer(vis.indexBuffer.handle, 0, mem);
+	}
+}
 
-		if (indices.empty())
-			continue;
+static void UpdatePvsVisibility(VisibilityId visId, vec3 cameraPosition, const uint8_t *areaMask)
+{
+	assert(areaMask);
+	Visibility &vis = s_world->visibility[(int)visId];
+	vis.method = VisibilityMethod::PVS;
 
-		const bgfx::Memory *mem = bgfx::copy(indices.data(), uint32_t(indices.size() * sizeof(uint16_t)));
+	// Get the PVS for the camera leaf cluster.
+	Node *cameraLeaf = LeafFromPosition(cameraPosition);
 
-		// Buffer is created on first use.
-		if (!bgfx::isValid(ib.handle))
-		{
-			ib.handle = bgfx::createDynamicIndexBuffer(mem, BGFX_BUFFER_ALLOW_RESIZE);
-		}
-		else				
-		{
-			bgfx::updateDynamicIndexBuffer(ib.handle, 0, mem);
-		}
+	// Build a list of visible surfaces.
+	// Don't need to refresh visible surfaces if the camera cluster or the area bitmask haven't changed.
+	if (vis.lastCameraLeaf != nullptr && vis.lastCameraLeaf->cluster == cameraLeaf->cluster && std::equal(areaMask, areaMask + MAX_MAP_AREA_BYTES, vis.lastAreaMask))
+	{
+		// Patch LOD levels change with camera distance, so the batches may still need to be rebuilt.
+		if (!UpdatePatchLods(vis, cameraPosition))
+			return;
+
+		CreateBatchedSurfaces(vis.surfaces, &vis.batchedSurfaces, &vis.indices, &vis.cpuDeformVertices, &vis.cpuDeformIndices, vis.patchLods.data());
+	}
+	else
+	{
+		GatherPvsSurfaces(vis, cameraPosition, cameraLeaf, areaMask);
 	}
 
-	s_world->duplicateSurfaceId++;
+	UpdatePvsIndexBuffer(vis);
+
 	vis.lastCameraLeaf = cameraLeaf;
 	memcpy(vis.lastAreaMask, areaMask, sizeof(vis.lastAreaMask));
 }
@@ -2122,7 +2610,7 @@ void UpdateVisibility(VisibilityId visId, vec3 cameraPosition, const uint8_t *ar
 	}
 }
 
-void Render(VisibilityId visId, DrawCallList *drawCallList, const mat3 &sceneRotation)
+void Render(VisibilityId visId, DrawCallList *drawCallList, const mat3 &sceneRotation, const Frustum &cameraFrustum)
 {
 	assert(drawCallList);
 	const Visibility &vis = s_world->visibility[(int)visId];
@@ -2145,7 +2633,13 @@ void Render(VisibilityId visId, DrawCallList *drawCallList, const mat3 &sceneRot
 
 	for (const BatchedSurface &surface : *batchedSurfaces)
 	{
+		// Vertex deforms can move geometry outside the bounds, so don't cull those.
+		if (surface.material->numDeforms == 0 && !surface.material->hasAutoSpriteDeform() && cameraFrustum.clipBounds(surface.bounds) == Frustum::ClipResult::Outside)
+			continue;
+
 		DrawCall dc;
+		dc.bounds = surface.bounds;
+		dc.hasBounds = true;
 		dc.flags = 0;
 
 		if (surface.surfaceFlags & SURF_SKY)
@@ -2193,18 +2687,18 @@ void Render(VisibilityId visId, DrawCallList *drawCallList, const mat3 &sceneRot
 		else
 		{
 			dc.vb.type = DrawCall::BufferType::Static;
-			dc.vb.staticHandle = s_world->vertexBuffers[surface.bufferIndex].handle;
-			dc.vb.nVertices = (uint32_t)s_world->vertices[surface.bufferIndex].size();
+			dc.vb.staticHandle = s_world->vertexBuffer.handle;
+			dc.vb.nVertices = (uint32_t)s_world->vertices.size();
 
 			if (vis.method == VisibilityMethod::PVS)
 			{
 				dc.ib.type = DrawCall::BufferType::Dynamic;
-				dc.ib.dynamicHandle = vis.indexBuffers[surface.bufferIndex].handle;
+				dc.ib.dynamicHandle = vis.indexBuffer.handle;
 			}
 			else
 			{
 				dc.ib.type = DrawCall::BufferType::Static;
-				dc.ib.staticHandle = s_world->indexBuffers[surface.bufferIndex].handle;
+				dc.ib.staticHandle = s_world->indexBuffer.handle;
 			}
 
 			dc.ib.firstIndex = surface.firstIndex;
@@ -2215,6 +2709,36 @@ void Render(VisibilityId visId, DrawCallList *drawCallList, const mat3 &sceneRot
 	}
 }
 
+void BenchmarkVisibility(int nIterations)
+{
+	Visibility &vis = s_world->visibility[(int)VisibilityId::Main];
+
+	if (!vis.lastCameraLeaf || vis.method != VisibilityMethod::PVS)
+	{
+		interface::Printf("No main camera PVS visibility to rebuild\n");
+		return;
+	}
+
+	// Rebuild with the same camera leaf and area mask. Patch LOD levels may still change, so the index buffer is uploaded again afterwards.
+	int64_t minTime = INT64_MAX, maxTime = 0, totalTime = 0;
+
+	for (int i = 0; i < nIterations; i++)
+	{
+		const int64_t start = bx::getHPCounter();
+		GatherPvsSurfaces(vis, main::GetMainCameraTransform().position, vis.lastCameraLeaf, vis.lastAreaMask);
+		const int64_t elapsed = bx::getHPCounter() - start;
+		minTime = std::min(minTime, elapsed);
+		maxTime = std::max(maxTime, elapsed);
+		totalTime += elapsed;
+	}
+
+	UpdatePvsIndexBuffer(vis);
+
+	const double toMs = 1000.0 / (double)bx::getHPFrequency();
+	interface::Printf("%d visibility rebuilds, %d surfaces in %d batches\n", nIterations, (int)vis.surfaces.size(), (int)vis.batchedSurfaces.size());
+	interface::Printf("   min %.3f ms, max %.3f ms, avg %.3f ms\n", minTime * toMs, maxTime * toMs, totalTime * toMs / nIterations);
+}
+
 void PickMaterial()
 {
 	const Transform camera = main::GetMainCameraTransform();
@@ -2226,13 +2750,15 @@ void PickMaterial()
 		for (size_t si = 0; si < model.nSurfaces; si++)
 		{
 			const Surface &surface = s_world->surfaces[model.firstSurface + si];
+			const SurfaceGeometry &geometry = s_world->surfaceGeometry[model.firstSurface + si];
+			const uint32_t *indices = &s_world->surfaceIndices[geometry.firstIndex];
 
-			for (size_t i = 0; i < surface.indices.size(); i += 3)
+			for (size_t i = 0; i < geometry.nIndices; i += 3)
 			{
 				const Vertex *verts[3];
 
 				for (size_t vi = 0; vi < 3; vi++)
-					verts[vi] = &s_world->vertices[surface.bufferIndex][surface.indices[i + 2 - vi]];
+					verts[vi] = &s_world->vertices[indices[i + 2 - vi]];
 
 				// Fast Minimum Storage Ray/Triangle Intersection by Moller and Trumbore
 				const vec3 edge1 = verts[1]->pos - verts[0]->pos;
@@ -208,15 +208,11 @@ typedef struct {
 
 struct BatchedSurface
 {
-	Bounds bounds; // frustum culling only
+	Bounds bounds; // frustum and dlight culling only
 	Material *material;
 	int fogIndex;
 	int surfaceFlags;
 	int contentFlags;
-
-	/// @remarks Undefined if the material has CPU deforms.
-	size_t bufferIndex;
-
 	uint32_t firstIndex;
 	uint32_t nIndices;
 
@@ -326,43 +322,61 @@ enum class SurfaceType
 	Flare
 };
 
+/// @brief Surface state read when visibility is rebuilt and visible surfaces are batched.
+/// @remarks Kept small so the PVS leaf loop and the batch sort stay in cache. Geometry and cull data are stored in parallel arrays in World, indexed by the same surface index.
 struct Surface
 {
-	~Surface()
-	{
-		if (patch)
-			Patch_Free(patch);
-	}
-
-	SurfaceType type;
 	Material *material;
+	SurfaceType type;
 	int fogIndex;
 	int flags; // SURF *
 	int contentFlags;
-	std::vector<uint16_t> indices;
-
-	/// Which geometry buffer to use.
-	size_t bufferIndex;
-
-	CullInfo cullinfo;
-
-	// SurfaceType::Patch
-	Patch *patch = nullptr;
 
 	/// Used at runtime to avoid adding duplicate visible surfaces.
 	int duplicateId = -1;
+};
 
-	/// Used at runtime to avoid processing surfaces multiple times when adding a decal.
-	int decalDuplicateId = -1;
+/// @brief Number of patch LOD levels, including full detail.
+static const size_t s_nPatchLods = 4;
+
+/// @brief Surface geometry, only touched when a batch is built or a surface is drawn individually.
+struct SurfaceGeometry
+{
+	/// Index into World::surfaceIndices.
+	uint32_t firstIndex;
+
+	uint32_t nIndices;
 
 	/// @remarks Used by CPU deforms only.
 	uint32_t firstVertex;
 
 	/// @remarks Used by CPU deforms only.
 	uint32_t nVertices;
+
+	struct Lod
+	{
+		/// Index into World::surfaceIndices.
+		uint32_t firstIndex;
+
+		uint32_t nIndices;
+	};
+
+	/// @brief SurfaceType::Patch only. Reduced levels of detail, using the same vertices as full detail.
+	/// @remarks Level 0 is full detail, i.e. firstIndex and nIndices, so lods[0] is level 1.
+	std::array<Lod, s_nPatchLods - 1> lods;
 };
 
-static const size_t s_maxWorldGeometryBuffers = 8;
+/// @brief Surface data used for culling, decals and light baking.
+struct SurfaceCullData
+{
+	CullInfo cullinfo;
+
+	// SurfaceType::Patch
+	Patch *patch = nullptr;
+
+	/// Used at runtime to avoid processing surfaces multiple times when adding a decal.
+	int decalDuplicateId = -1;
+};
 
 enum class VisibilityMethod
 {
@@ -377,13 +391,13 @@ struct Visibility
 		const renderer::Entity *entity;
 		bool isMirror;
 		Plane plane;
-		Surface *surface;
+		uint32_t surfaceIndex;
 	};
 
 	struct Reflective
 	{
 		Plane plane;
-		Surface *surface;
+		uint32_t surfaceIndex;
 	};
 
 	/// Visible surfaces batched by material.
@@ -401,10 +415,10 @@ struct Visibility
 	std::vector<Vertex> cpuDeformVertices;
 	std::vector<uint16_t> cpuDeformIndices;
 
-	DynamicIndexBuffer indexBuffers[s_maxWorldGeometryBuffers];
+	DynamicIndexBuffer indexBuffer;
 
 	/// Temporary index data populated at runtime when surface visibility changes.
-	std::vector<uint16_t> indices[s_maxWorldGeometryBuffers];
+	std::vector<uint32_t> indices;
 
 	/// The camera leaf from the last UpdateVisibility call.
 	/// @remarks Visibility is only recalculated if the camera leaf cluster or area mask changes.
@@ -416,20 +430,35 @@ struct Visibility
 
 	VisibilityMethod method;
 
+	/// Patch surfaces visible to the PVS.
+	std::vector<uint32_t> patchSurfaces;
+
+	/// The current LOD level of each patch surface in patchSurfaces, indexed by surface index.
+	std::vector<uint8_t> patchLods;
+
 	/// Portal surface visible to the PVS.
-	std::vector<Surface *> portalSurfaces;
+	std::vector<uint32_t> portalSurfaces;
 
 	/// Reflective surfaces visible to the PVS.
-	std::vector<Surface *> reflectiveSurfaces;
+	std::vector<uint32_t> reflectiveSurfaces;
 
 	std::vector<SkySurface> skySurfaces;
 
-	/// Surfaces visible from the camera leaf cluster.
-	std::vector<Surface *> surfaces;
+	/// Indices of surfaces visible from the camera leaf cluster.
+	std::vector<uint32_t> surfaces;
 };
 
 struct World
 {
+	~World()
+	{
+		for (SurfaceCullData &cd : surfaceCullData)
+		{
+			if (cd.patch)
+				Patch_Free(cd.patch);
+		}
+	}
+
 	char name[MAX_QPATH]; // ie: maps/tim_dm2.bsp
 	char baseName[MAX_QPATH]; // ie: tim_dm2
 
@@ -446,20 +475,46 @@ struct World
 	std::vector<uint8_t> lightGridData;
 	vec3 lightGridOrigin;
 	vec3i lightGridBounds;
+
+	/// @brief Light grid decoded to floats at load for SampleLightGrid. One element per grid point.
+	/// @remarks Premultiplied by the grid point weight, which is 0 for points in walls. Ambient w is the weight, directed and direction w are not used.
+	/// @{
+	std::vector<vec4> lightGridAmbient;
+	std::vector<vec4> lightGridDirected;
+	std::vector<vec4> lightGridDirection;
+	/// @}
+
+	/// @brief Light grid volume textures. Premultiplied by alpha, which is 0 for samples in walls.
+	/// @remarks nullptr if 3D textures aren't supported.
+	/// @{
+	Texture *lightGridAmbientTexture = nullptr;
+	Texture *lightGridDirectedTexture = nullptr;
+	Texture *lightGridDirectionTexture = nullptr;
+	/// @}
 	std::vector<MaterialDef> materials;
 	std::vector<ModelDef> modelDefs;
 	std::vector<Plane> planes;
 
-	/// All model surfaces.
+	/// @name Model surfaces
+	/// @remarks Structure of arrays, all indexed by surface index.
+	/// @{
 	std::vector<Surface> surfaces;
+	std::vector<SurfaceGeometry> surfaceGeometry;
+	std::vector<SurfaceCullData> surfaceCullData;
+	/// @}
 
-	VertexBuffer vertexBuffers[s_maxWorldGeometryBuffers];
+	/// Index data for all surfaces, referenced by SurfaceGeometry. Indices are absolute.
+	std::vector<uint32_t> surfaceIndices;
+
+	/// All world geometry is in a single vertex buffer.
+	VertexBuffer vertexBuffer;
 
 	/// Vertex data populated at load time.
-	std::vector<Vertex> vertices[s_maxWorldGeometryBuffers];
+	std::vector<Vertex> vertices;
 
-	/// Incremented when a surface won't fit in the current geometry buffer (16-bit indices).
-	size_t currentGeometryBuffer = 0;
+	/// True if there are too many vertices for 16-bit indices.
+	/// @remarks Index data is always 32-bit on the CPU side, and narrowed when copied to index buffers if this is false.
+	bool use32BitIndices = false;
 
 	std::vector<Node> nodes;
 	std::vector<int> leafSurfaces;
@@ -483,7 +538,7 @@ struct World
 	std::vector<BatchedSurface> batchedSurfaces;
 	std::vector<Vertex> cpuDeformVertices;
 	std::vector<uint16_t> cpuDeformIndices;
-	IndexBuffer indexBuffers[s_maxWorldGeometryBuffers];
+	IndexBuffer indexBuffer;
 	std::vector<SkySurface> skySurfaces;
 };
 
@@ -493,8 +548,32 @@ Node *LeafFromPosition(vec3 pos);
 int GetNumModels();
 int GetNumSurfaces(int modelIndex);
 const Surface &GetSurface(int modelIndex, int surfaceIndex);
-int GetNumVertexBuffers();
-const std::vector<Vertex> &GetVertexBuffer(int index);
+const SurfaceGeometry &GetSurfaceGeometry(int modelIndex, int surfaceIndex);
+const SurfaceCullData &GetSurfaceCullData(int modelIndex, int surfaceIndex);
+const uint32_t *GetSurfaceIndices(const SurfaceGeometry &geometry);
+const std::vector<Vertex> &GetVertices();
+
+/// @name World cache
+/// @remarks Processed world data that is expensive to derive from the BSP is written to disk after loading, and read back on later loads of the same BSP.
+/// @{
+
+/// @brief Identifies the BSP a cache was built from.
+struct CacheKey
+{
+	uint32_t bspHash;
+	uint32_t bspLength;
+	uint32_t maxTextureSize; ///< Lightmap atlas packing depends on the max texture size.
+};
+
+CacheKey CalculateCacheKey(const uint8_t *bspData, size_t bspLength);
+
+/// @brief Read vertices, surface indices, surface geometry and cull data, patches, the light grid and lightmap atlas pixels into s_world.
+/// @return false if the cache is missing or stale, in which case nothing is read.
+bool ReadCache(const CacheKey &key, size_t nSurfaces, std::vector<uint8_t> *lightmapAtlasData);
+
+void WriteCache(const CacheKey &key, const std::vector<uint8_t> &lightmapAtlasData);
+
+/// @}
 
 } // namespace world
 } // namespace renderer
@@ -0,0 +1,356 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+#include "Precompiled.h"
+#pragma hdrstop
+#include "bx/hash.h"
+#include "World.h"
+
+namespace renderer {
+namespace world {
+
+/// @brief Bump this whenever the processed world data changes, e.g. vertex format, patch subdivision or lightmap packing.
+static const uint32_t s_cacheVersion = 6;
+
+static const char s_cacheId[4] = { 'R', 'B', 'W', 'C' };
+
+struct CacheHeader
+{
+	char id[4];
+	uint32_t version;
+	CacheKey key;
+
+	/// @name Layout validation
+	/// @{
+	uint32_t vertexSize;
+	uint32_t cullInfoSize;
+	uint32_t surfaceGeometrySize;
+	/// @}
+
+	uint32_t nLightmapAtlasBytes;
+	uint32_t nLightGridBytes;
+	uint32_t nVertices;
+	uint32_t nSurfaceIndices;
+	uint32_t nSurfaces;
+	uint32_t nPatches;
+};
+
+/// @brief Patch data that can't be cheaply recalculated. Followed by verts, indexes, widthLodError and heightLodError.
+struct CachePatch
+{
+	uint32_t surfaceIndex;
+	int width, height;
+	int numVerts;
+	int numIndexes;
+	Bounds cullBounds;
+	vec3 cullOrigin;
+	float cullRadius;
+	vec3 lodOrigin;
+	float lodRadius;
+};
+
+class CacheReader
+{
+public:
+	CacheReader(const uint8_t *data, size_t length) : data_(data), length_(length) {}
+	size_t getRemaining() const { return length_ - offset_; }
+
+	template<typename T>
+	bool read(T *dest, size_t n = 1)
+	{
+		const size_t size = sizeof(T) * n;
+
+		if (size > getRemaining())
+			return false;
+
+		memcpy(dest, &data_[offset_], size);
+		offset_ += size;
+		return true;
+	}
+
+	template<typename T>
+	bool read(std::vector<T> *dest, size_t n)
+	{
+		if (sizeof(T) * n > getRemaining())
+			return false;
+
+		dest->resize(n);
+		return n == 0 || read(dest->data(), n);
+	}
+
+private:
+	const uint8_t *data_;
+	size_t length_;
+	size_t offset_ = 0;
+};
+
+template<typename T>
+static void CacheWrite(std::vector<uint8_t> *buffer, const T *data, size_t n = 1)
+{
+	const size_t size = sizeof(T) * n;
+	const size_t offset = buffer->size();
+	buffer->resize(offset + size);
+
+	if (size > 0)
+		memcpy(&(*buffer)[offset], data, size);
+}
+
+static bool IsRangeValid(uint32_t first, uint32_t n, size_t size)
+{
+	return (uint64_t)first + n <= size;
+}
+
+/// @brief Check that geometry ranges and indices are in bounds, so a damaged cache can't cause out of bounds reads later.
+static bool ValidateGeometry()
+{
+	const size_t nIndices = s_world->surfaceIndices.size();
+	const size_t nVertices = s_world->vertices.size();
+
+	for (const SurfaceGeometry &geometry : s_world->surfaceGeometry)
+	{
+		if (!IsRangeValid(geometry.firstIndex, geometry.nIndices, nIndices) || !IsRangeValid(geometry.firstVertex, geometry.nVertices, nVertices))
+			return false;
+
+		for (const SurfaceGeometry::Lod &lod : geometry.lods)
+		{
+			if (!IsRangeValid(lod.firstIndex, lod.nIndices, nIndices))
+				return false;
+		}
+	}
+
+	for (uint32_t index : s_world->surfaceIndices)
+	{
+		if (index >= nVertices)
+			return false;
+	}
+
+	return true;
+}
+
+static void GetCacheFilename(char *filename, size_t size)
+{
+	util::Sprintf(filename, (int)size, "cache/%s.worldcache", s_world->baseName);
+}
+
+CacheKey CalculateCacheKey(const uint8_t *bspData, size_t bspLength)
+{
+	bx::HashMurmur2A hash;
+	hash.begin();
+	hash.add(bspData, (int)bspLength);
+	CacheKey key;
+	key.bspHash = hash.end();
+	key.bspLength = (uint32_t)bspLength;
+	key.maxTextureSize = bgfx::getCaps()->limits.maxTextureSize;
+	return key;
+}
+
+static bool ReadCacheData(const char *filename, const CacheKey &key, size_t nSurfaces, std::vector<uint8_t> *lightmapAtlasData)
+{
+	ReadOnlyFile file(filename);
+
+	if (!file.isValid())
+		return false;
+
+	CacheReader reader(file.getData(), file.getLength());
+	CacheHeader header;
+
+	if (!reader.read(&header))
+		return false;
+
+	if (memcmp(header.id, s_cacheId, sizeof(s_cacheId)) != 0 || header.version != s_cacheVersion || header.key.bspHash != key.bspHash || header.key.bspLength != key.bspLength || header.key.maxTextureSize != key.maxTextureSize)
+		return false;
+
+	if (header.vertexSize != sizeof(Vertex) || header.cullInfoSize != sizeof(CullInfo) || header.surfaceGeometrySize != sizeof(SurfaceGeometry) || header.nSurfaces != nSurfaces)
+		return false;
+
+	std::vector<CullInfo> cullInfo;
+
+	if (!reader.read(lightmapAtlasData, header.nLightmapAtlasBytes) ||
+		!reader.read(&s_world->lightGridData, header.nLightGridBytes) ||
+		!reader.read(&s_world->vertices, header.nVertices) ||
+		!reader.read(&s_world->surfaceIndices, header.nSurfaceIndices) ||
+		!reader.read(&s_world->surfaceGeometry, header.nSurfaces) ||
+		!reader.read(&cullInfo, header.nSurfaces))
+	{
+		interface::PrintWarningf("World cache %s is truncated\n", filename);
+		return false;
+	}
+
+	if (!ValidateGeometry())
+	{
+		interface::PrintWarningf("World cache %s has bad geometry data\n", filename);
+		return false;
+	}
+
+	s_world->surfaceCullData.resize(nSurfaces);
+
+	for (size_t i = 0; i < nSurfaces; i++)
+	{
+		s_world->surfaceCullData[i].cullinfo = cullInfo[i];
+	}
+
+	for (uint32_t i = 0; i < header.nPatches; i++)
+	{
+		CachePatch cp;
+
+		if (!reader.read(&cp) || cp.surfaceIndex >= nSurfaces || s_world->surfaceCullData[cp.surfaceIndex].patch || cp.width <= 0 || cp.height <= 0 || cp.numVerts != (int64_t)cp.width * cp.height || cp.numIndexes < 0 || cp.numIndexes % 3 != 0 || cp.numIndexes > (int64_t)(cp.width - 1) * (cp.height - 1) * 6 || cp.numVerts * sizeof(Vertex) + cp.numIndexes * sizeof(uint16_t) > reader.getRemaining())
+		{
+			interface::PrintWarningf("World cache %s has bad patch data\n", filename);
+			return false;
+		}
+
+		// Allocate the same way as R_CreateSurfaceGridMesh so Patch_Free works.
+		auto patch = new (malloc(sizeof(Patch))) Patch();
+		patch->width = cp.width;
+		patch->height = cp.height;
+		patch->numVerts = cp.numVerts;
+		patch->numIndexes = cp.numIndexes;
+		patch->cullBounds = cp.cullBounds;
+		patch->cullOrigin = cp.cullOrigin;
+		patch->cullRadius = cp.cullRadius;
+		patch->lodOrigin = cp.lodOrigin;
+		patch->lodRadius = cp.lodRadius;
+		patch->verts = (Vertex *)malloc(cp.numVerts * sizeof(Vertex));
+		patch->indexes = (uint16_t *)malloc(cp.numIndexes * sizeof(uint16_t));
+		patch->widthLodError = (float *)malloc(cp.width * sizeof(float));
+		patch->heightLodError = (float *)malloc(cp.height * sizeof(float));
+		s_world->surfaceCullData[cp.surfaceIndex].patch = patch;
+
+		// Batches are culled by the merged surface bounds, so patches need theirs.
+		CullInfo &cullinfo = s_world->surfaceCullData[cp.surfaceIndex].cullinfo;
+		cullinfo.type = CullInfoType::Box;
+		cullinfo.bounds = cp.cullBounds;
+
+		if (!reader.read(patch->verts, cp.numVerts) || !reader.read(patch->indexes, cp.numIndexes) || !reader.read(patch->widthLodError, cp.width) || !reader.read(patch->heightLodError, cp.height))
+		{
+			interface::PrintWarningf("World cache %s is truncated\n", filename);
+			return false;
+		}
+
+		for (int j = 0; j < cp.numIndexes; j++)
+		{
+			if (patch->indexes[j] >= cp.numVerts)
+			{
+				interface::PrintWarningf("World cache %s has bad patch data\n", filename);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool ReadCache(const CacheKey &key, size_t nSurfaces, std::vector<uint8_t> *lightmapAtlasData)
+{
+	assert(lightmapAtlasData);
+	char filename[MAX_QPATH];
+	GetCacheFilename(filename, sizeof(filename));
+
+	if (ReadCacheData(filename, key, nSurfaces, lightmapAtlasData))
+	{
+		interface::Printf("Loaded world cache %s\n", filename);
+		return true;
+	}
+
+	// Discard anything read from a stale or damaged cache.
+	for (SurfaceCullData &cd : s_world->surfaceCullData)
+	{
+		if (cd.patch)
+			Patch_Free(cd.patch);
+	}
+
+	s_world->surfaceCullData.clear();
+	s_world->surfaceGeometry.clear();
+	s_world->surfaceIndices.clear();
+	s_world->vertices.clear();
+	s_world->lightGridData.clear();
+	lightmapAtlasData->clear();
+	return false;
+}
+
+void WriteCache(const CacheKey &key, const std::vector<uint8_t> &lightmapAtlasData)
+{
+	CacheHeader header;
+	memcpy(header.id, s_cacheId, sizeof(s_cacheId));
+	header.version = s_cacheVersion;
+	header.key = key;
+	header.vertexSize = sizeof(Vertex);
+	header.cullInfoSize = sizeof(CullInfo);
+	header.surfaceGeometrySize = sizeof(SurfaceGeometry);
+	header.nLightmapAtlasBytes = (uint32_t)lightmapAtlasData.size();
+	header.nLightGridBytes = (uint32_t)s_world->lightGridData.size();
+	header.nVertices = (uint32_t)s_world->vertices.size();
+	header.nSurfaceIndices = (uint32_t)s_world->surfaceIndices.size();
+	header.nSurfaces = (uint32_t)s_world->surfaces.size();
+	header.nPatches = 0;
+	std::vector<CullInfo> cullInfo(s_world->surfaceCullData.size());
+
+	for (size_t i = 0; i < s_world->surfaceCullData.size(); i++)
+	{
+		cullInfo[i] = s_world->surfaceCullData[i].cullinfo;
+
+		if (s_world->surfaceCullData[i].patch)
+			header.nPatches++;
+	}
+
+	std::vector<uint8_t> buffer;
+	buffer.reserve(sizeof(header) + lightmapAtlasData.size() + s_world->lightGridData.size() + s_world->vertices.size() * sizeof(Vertex) + s_world->surfaceIndices.size() * sizeof(uint32_t) + s_world->surfaces.size() * (sizeof(SurfaceGeometry) + sizeof(CullInfo)));
+	CacheWrite(&buffer, &header);
+	CacheWrite(&buffer, lightmapAtlasData.data(), lightmapAtlasData.size());
+	CacheWrite(&buffer, s_world->lightGridData.data(), s_world->lightGridData.size());
+	CacheWrite(&buffer, s_world->vertices.data(), s_world->vertices.size());
+	CacheWrite(&buffer, s_world->surfaceIndices.data(), s_world->surfaceIndices.size());
+	CacheWrite(&buffer, s_world->surfaceGeometry.data(), s_world->surfaceGeometry.size());
+	CacheWrite(&buffer, cullInfo.data(), cullInfo.size());
+
+	for (size_t i = 0; i < s_world->surfaceCullData.size(); i++)
+	{
+		const Patch *patch = s_world->surfaceCullData[i].patch;
+
+		if (!patch)
+			continue;
+
+		CachePatch cp;
+		cp.surfaceIndex = (uint32_t)i;
+		cp.width = patch->width;
+		cp.height = patch->height;
+		cp.numVerts = patch->numVerts;
+		cp.numIndexes = patch->numIndexes;
+		cp.cullBounds = patch->cullBounds;
+		cp.cullOrigin = patch->cullOrigin;
+		cp.cullRadius = patch->cullRadius;
+		cp.lodOrigin = patch->lodOrigin;
+		cp.lodRadius = patch->lodRadius;
+		CacheWrite(&buffer, &cp);
+		CacheWrite(&buffer, patch->verts, patch->numVerts);
+		CacheWrite(&buffer, patch->indexes, patch->numIndexes);
+		CacheWrite(&buffer, patch->widthLodError, patch->width);
+		CacheWrite(&buffer, patch->heightLodError, patch->height);
+	}
+
+	char filename[MAX_QPATH];
+	GetCacheFilename(filename, sizeof(filename));
+	interface::FS_WriteFile(filename, buffer.data(), buffer.size());
+	interface::Printf("Wrote world cache %s\n", filename);
+}
+
+} // namespace world
+} // namespace renderer
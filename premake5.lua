@@ -167,6 +167,7 @@ newaction
 		{
 			{ "AlphaTest", "USE_ALPHA_TEST" },
 			{ "DynamicLights", "USE_DYNAMIC_LIGHTS" },
+			{ "LightGrid", "USE_LIGHT_GRID" },
 			{ "SoftSprite", "USE_SOFT_SPRITE" },
 			{ "SunLight", "USE_SUN_LIGHT" }
 		}
@@ -3,9 +3,11 @@ USAMPLER2D(u_DynamicLightCellsSampler, 4); // TU_DYNAMIC_LIGHT_CELLS
 USAMPLER2D(u_DynamicLightIndicesSampler, 5); // TU_DYNAMIC_LIGHT_INDICES
 SAMPLER2D(u_DynamicLightsSampler, 6); // TU_DYNAMIC_LIGHTS
 
-uniform vec4 u_DynamicLightCellSize; // xyz is size
-uniform vec4 u_DynamicLightGridOffset; // w not used
-uniform vec4 u_DynamicLightGridSize; // w not used
+uniform vec4 u_DynamicLightFroxelPosition; // w is the near plane distance
+uniform vec4 u_DynamicLightFroxelForward; // w is the number of depth slices per log depth unit
+uniform vec4 u_DynamicLightFroxelLeft; // w is 1 / tan(fovX / 2)
+uniform vec4 u_DynamicLightFroxelUp; // w is 1 / tan(fovY / 2)
+uniform vec4 u_DynamicLightGridSize; // w is the offset of the indices list containing every light
 uniform vec4 u_DynamicLight_Num_Intensity; // x is the number of dynamic lights, y is the intensity scale
 uniform vec4 u_DynamicLightTextureSizes_Cells_Indices_Lights; // w not used
 
@@ -34,10 +36,23 @@ DynamicLight GetDynamicLight(uint index)
 
 uint GetDynamicLightIndicesOffset(vec3 position)
 {
-	vec3 local = u_DynamicLightGridOffset.xyz + position;
-	uint cellX = min(uint(max(0, local.x / u_DynamicLightCellSize.x)), uint(u_DynamicLightGridSize.x) - 1u);
-	uint cellY = min(uint(max(0, local.y / u_DynamicLightCellSize.y)), uint(u_DynamicLightGridSize.y) - 1u);
-	uint cellZ = min(uint(max(0, local.z / u_DynamicLightCellSize.z)), uint(u_DynamicLightGridSize.z) - 1u);
+	// Positions outside the froxel grid use the list containing every light.
+	uint allLightsOffset = uint(u_DynamicLightGridSize.w);
+	vec3 dir = position - u_DynamicLightFroxelPosition.xyz;
+	float depth = dot(dir, u_DynamicLightFroxelForward.xyz);
+
+	if (depth < u_DynamicLightFroxelPosition.w)
+		return allLightsOffset;
+
+	vec2 ndc = vec2(dot(dir, u_DynamicLightFroxelLeft.xyz) * u_DynamicLightFroxelLeft.w, dot(dir, u_DynamicLightFroxelUp.xyz) * u_DynamicLightFroxelUp.w) / depth;
+	float slice = log(depth / u_DynamicLightFroxelPosition.w) * u_DynamicLightFroxelForward.w;
+
+	if (abs(ndc.x) > 1.0 || abs(ndc.y) > 1.0 || slice >= u_DynamicLightGridSize.z)
+		return allLightsOffset;
+
+	uint cellX = min(uint((ndc.x * 0.5 + 0.5) * u_DynamicLightGridSize.x), uint(u_DynamicLightGridSize.x) - 1u);
+	uint cellY = min(uint((ndc.y * 0.5 + 0.5) * u_DynamicLightGridSize.y), uint(u_DynamicLightGridSize.y) - 1u);
+	uint cellZ = uint(slice);
 	uint cellOffset = cellX + (cellY * uint(u_DynamicLightGridSize.x)) + (cellZ * uint(u_DynamicLightGridSize.x) * uint(u_DynamicLightGridSize.y));
 	int u = int(cellOffset) % int(u_DynamicLightTextureSizes_Cells_Indices_Lights.x);
 	int v = int(cellOffset) / int(u_DynamicLightTextureSizes_Cells_Indices_Lights.x);
@@ -39,6 +39,35 @@ uniform vec4 u_AmbientLight;
 
 uniform vec4 u_LightType; // only x used
 
+#if defined(USE_LIGHT_GRID)
+SAMPLER3D(u_LightGridAmbientSampler, 9); // TU_LIGHT_GRID_AMBIENT
+SAMPLER3D(u_LightGridDirectedSampler, 10); // TU_LIGHT_GRID_DIRECTED
+SAMPLER3D(u_LightGridDirectionSampler, 11); // TU_LIGHT_GRID_DIRECTION
+
+uniform vec4 u_LightGridScale; // w not used
+uniform vec4 u_LightGrid_Bias_MinLight;
+
+// Scale the color so the largest channel is 1, same as ClampEntityLight.
+vec3 ClampLight(vec3 light)
+{
+	float maxChannel = max(light.r, max(light.g, light.b));
+	return maxChannel > 1.0 ? light / maxChannel : light;
+}
+
+// Values are premultiplied by alpha, which is 0 for grid points in walls. Dividing by alpha ignores them.
+void SampleLightGrid(vec3 position, out vec3 ambientLight, out vec3 directedLight, out vec3 lightDir)
+{
+	vec3 texCoord = position * u_LightGridScale.xyz + u_LightGrid_Bias_MinLight.xyz;
+	vec4 ambient = texture3D(u_LightGridAmbientSampler, texCoord);
+	vec4 directed = texture3D(u_LightGridDirectedSampler, texCoord);
+	vec4 direction = texture3D(u_LightGridDirectionSampler, texCoord);
+	float scale = ambient.a > 0.0 ? 1.0 / ambient.a : 0.0;
+	ambientLight = ToLinear(ClampLight(ambient.rgb * scale + vec3_splat(u_LightGrid_Bias_MinLight.w)));
+	directedLight = ToLinear(ClampLight(directed.rgb * scale));
+	lightDir = normalize(direction.rgb * scale * 2.0 - 1.0);
+}
+#endif
+
 void main()
 {
 	if (PortalClipped(v_position))
@@ -116,7 +145,13 @@ void main()
 	}
 	else if (lightType == LIGHT_VECTOR)
 	{
+#if defined(USE_LIGHT_GRID)
+		vec3 ambientLight, directedLight, lightDir;
+		SampleLightGrid(v_position, ambientLight, directedLight, lightDir);
+		diffuseLight = ambientLight + directedLight * Lambert(v_normal.xyz, lightDir);
+#else
 		diffuseLight = u_AmbientLight.xyz + u_DirectedLight.xyz * Lambert(v_normal.xyz, u_LightDirection.xyz);
+#endif
 	}
 
 #if defined(USE_DYNAMIC_LIGHTS)
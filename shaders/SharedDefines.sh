@@ -67,5 +67,8 @@
 #define TU_DYNAMIC_LIGHTS        6
 #define TU_SHADOWMAP             7
 #define TU_NOISE                 8
+#define TU_LIGHT_GRID_AMBIENT    9
+#define TU_LIGHT_GRID_DIRECTED   10
+#define TU_LIGHT_GRID_DIRECTION  11
 
 #define USE_HALF_LAMBERT
\ No newline at end of file